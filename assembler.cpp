@@ -0,0 +1,338 @@
+#include "assembler.h"
+#include "walker.h"
+#include "parse.h"
+
+// the special registers, shared by every assembly and never freed, since
+// an operand that names one stays bound to it until it is folded
+static Expr * specialRegister(const QString & name)
+{
+    static QHash<QString, Expr *> registers;
+
+    if (registers.isEmpty())
+    {
+        for (int i = 0; i < pasmRegisterCount; i++)
+            registers[pasmRegisters[i].name] = new NumberExpr(16, pasmRegisters[i].address);
+    }
+
+    return registers.value(name);
+}
+
+class LabelBinder : public Walker<LabelBinder>
+{
+    QHash<QString, AsmLineExpr *> & _labels;
+
+public:
+    using Walker<LabelBinder>::visit;
+
+    LabelBinder(QHash<QString, AsmLineExpr *> & labels)
+        : _labels(labels)
+    {
+    }
+
+    void visit(IdentExpr & expr)
+    {
+        if (expr._binding != NULL) return;
+
+        AsmLineExpr * line = _labels.value(expr.ident());
+        if (line != NULL && line->_label != &expr)
+            expr._binding = line;
+        else if (line == NULL)
+            expr._binding = specialRegister(expr.ident());
+    }
+};
+
+void Assembler::error(AsmLineExpr * line, QString message)
+{
+    Diagnostic d;
+    d.line = line->_line;
+    d.first_column = line->_first_column;
+    d.last_column = line->_last_column;
+    d.message = message;
+    d.text = line->_text;
+
+    report(_filename, d);
+    _errors++;
+}
+
+bool Assembler::evaluate(Expr * expr, quint32 & value)
+{
+    if (LiteralExpr * l = dynamic_cast<LiteralExpr *>(expr))
+        return evaluate(l->_val, value);
+
+    if (WrapExpr * w = dynamic_cast<WrapExpr *>(expr))
+        return evaluate(w->_val, value);
+
+    if (!expr->isConstant())
+        return false;
+
+    value = expr->value();
+    return true;
+}
+
+bool Assembler::operand(AsmLineExpr * line, Expr * expr, quint32 & value, bool * immediate)
+{
+    bool literal = dynamic_cast<LiteralExpr *>(expr) != NULL;
+
+    if (immediate != NULL)
+        *immediate = literal;
+    else if (literal)
+    {
+        error(line, "destination cannot be immediate");
+        return false;
+    }
+
+    if (!evaluate(expr, value))
+    {
+        error(line, "operand is not a constant or label");
+        return false;
+    }
+
+    if (value > 0x1ff)
+    {
+        error(line, QString("operand $%1 out of range ($0-$1ff)").arg(value, 0, 16));
+        return false;
+    }
+
+    return true;
+}
+
+int Assembler::size(AsmLineExpr * line)
+{
+    // labels are not known yet, but they do not change the size
+    QByteArray data;
+    ::encodeData(line->_data, data);
+
+    return (data.size() + 3) / 4;
+}
+
+void Assembler::layout()
+{
+    int org = 0;
+
+    foreach (AsmLineExpr * line, _lines)
+    {
+        line->_address = org;
+
+        if (line->_data != NULL)
+        {
+            org += size(line);
+            continue;
+        }
+
+        if (line->_mnemonic < 0)
+            continue;
+
+        PasmForm form = pasmMnemonics[line->_mnemonic].form;
+        quint32 value = 0;
+
+        if (form == PasmOrg || form == PasmRes || form == PasmFit)
+        {
+            line->fold();
+
+            if (line->_operands.size() > 1)
+            {
+                error(line, QString("%1 takes at most one operand").arg(pasmMnemonics[line->_mnemonic].name));
+                continue;
+            }
+
+            if (!line->_operands.isEmpty() && !evaluate(line->_operands.first(), value))
+            {
+                error(line, "operand must be known in the first pass");
+                continue;
+            }
+        }
+
+        switch (form)
+        {
+            case PasmOrg:
+                org = value;
+                line->_address = org;
+                break;
+            case PasmRes:
+                org += line->_operands.isEmpty() ? 1 : value;
+                break;
+            case PasmFit:
+                if (line->_operands.isEmpty()) value = 0x1f0;
+                if ((quint32) org > value)
+                    error(line, QString("code ends at $%1, past fit limit $%2").arg(org, 0, 16).arg(value, 0, 16));
+                break;
+            default:
+                org += 1;
+                break;
+        }
+    }
+}
+
+void Assembler::encodeData(AsmLineExpr * line)
+{
+    QByteArray data;
+
+    if (!::encodeData(line->_data, data))
+        error(line, "data is not a constant or label");
+
+    while (data.size() % 4)
+        data.append('\0');
+
+    for (int i = 0; i < data.size(); i += 4)
+    {
+        AsmWord w;
+        w.address = line->_address + i / 4;
+        w.code = (quint8) data[i]
+               | (quint8) data[i + 1] << 8
+               | (quint8) data[i + 2] << 16
+               | (quint32) (quint8) data[i + 3] << 24;
+        w.line = line;
+        _code.append(w);
+    }
+}
+
+void Assembler::encode(AsmLineExpr * line)
+{
+    if (line->_data != NULL)
+    {
+        line->fold();
+        encodeData(line);
+        return;
+    }
+
+    if (line->_mnemonic < 0)
+        return;
+
+    const PasmMnemonic & m = pasmMnemonics[line->_mnemonic];
+    ExprList & operands = line->_operands;
+
+    int expected = 0;
+    switch (m.form)
+    {
+        case PasmOrg:
+        case PasmRes:
+        case PasmFit:   return;
+        case PasmNone:  expected = 0; break;
+        case PasmDS:    expected = 2; break;
+        case PasmS:
+        case PasmD:
+        case PasmCall:  expected = 1; break;
+    }
+
+    if (operands.size() != expected)
+    {
+        error(line, QString("%1 takes %2 operand%3").arg(m.name).arg(expected).arg(expected == 1 ? "" : "s"));
+        return;
+    }
+
+    // call #label stores its return address in label_ret, so find that
+    // before folding turns the target into a number
+    AsmLineExpr * ret = NULL;
+    if (m.form == PasmCall)
+    {
+        LiteralExpr * l = dynamic_cast<LiteralExpr *>(operands[0]);
+        IdentExpr * target = l ? dynamic_cast<IdentExpr *>(l->_val) : NULL;
+
+        if (target == NULL)
+        {
+            error(line, "call needs an immediate label (call #label)");
+            return;
+        }
+
+        ret = _labels.value(target->ident() + "_ret");
+        if (ret == NULL)
+        {
+            error(line, QString("no %1_ret label for call").arg(target->_ident));
+            return;
+        }
+    }
+
+    line->fold();
+
+    if (m.form == PasmNone && m.bits == 0)
+    {
+        AsmWord w = { line->_address, 0, line };
+        _code.append(w);
+        return;
+    }
+
+    quint32 code = m.bits;
+    code |= (line->_condition >= 0 ? pasmConditions[line->_condition].code : 0xf) << 18;
+
+    if (line->_effects & EffectZ)   code |= 1 << 25;
+    if (line->_effects & EffectC)   code |= 1 << 24;
+    if (line->_effects & EffectR)   code |= 1 << 23;
+    if (line->_effects & EffectNR)  code &= ~(1 << 23);
+
+    quint32 d = 0;
+    quint32 s = 0;
+    bool immediate = false;
+
+    switch (m.form)
+    {
+        case PasmDS:
+            if (!operand(line, operands[0], d, NULL)) return;
+            if (!operand(line, operands[1], s, &immediate)) return;
+            break;
+        case PasmS:
+        case PasmCall:
+            if (!operand(line, operands[0], s, &immediate)) return;
+            break;
+        case PasmD:
+            if (!operand(line, operands[0], d, NULL)) return;
+            break;
+        default:
+            break;
+    }
+
+    if (ret != NULL)
+        d = ret->_address;
+
+    if (immediate) code |= 1 << 22;
+    code |= d << 9 | s;
+
+    AsmWord w = { line->_address, code, line };
+    _code.append(w);
+}
+
+bool Assembler::assemble(ObjectExpr * object)
+{
+    _filename = object->name;
+    _labels.clear();
+    _lines.clear();
+    _code.clear();
+    _errors = 0;
+
+    for (Expr * b : object->_blocks)
+    {
+        BlockExpr * block = (BlockExpr *) b;
+        if (block->_block != AsmBlock) continue;
+
+        for (Expr * l : block->_lines)
+        {
+            AsmLineExpr * line = (AsmLineExpr *) l;
+            _lines.append(line);
+
+            QString label = line->_label->ident();
+            if (label.isEmpty()) continue;
+
+            if (specialRegister(label) != NULL)
+                error(line, "label \"" + line->_label->_ident + "\" names a special register");
+            else if (_labels.contains(label))
+                error(line, "label \"" + line->_label->_ident + "\" is already defined");
+            else
+                _labels[label] = line;
+        }
+    }
+
+    LabelBinder binder(_labels);
+    foreach (AsmLineExpr * line, _lines)
+    {
+        for (Expr * o : line->_operands)
+            binder.walk(o);
+        if (line->_data != NULL)
+            binder.walk(line->_data);
+    }
+
+    layout();
+
+    foreach (AsmLineExpr * line, _lines)
+        encode(line);
+
+    return _errors == 0;
+}
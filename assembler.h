@@ -0,0 +1,44 @@
+#pragma once
+
+#include "tree.h"
+#include "pasm.h"
+
+struct AsmWord
+{
+    int address;
+    quint32 code;
+    AsmLineExpr * line;
+};
+
+/*
+ * Assembles the ASM blocks of a folded object into cog longs.
+ *
+ * The first pass gives every line its cog address, which also makes its
+ * label constant; the second folds the operands again, now that labels
+ * have values, and encodes each line. Operands may also name the special
+ * registers (par, cnt, dira and the rest at $1f0-$1ff), which no label
+ * can take over. Errors are reported like parse errors and assembly
+ * carries on, so one run shows all of them.
+ */
+
+class Assembler
+{
+    QString _filename;
+    QHash<QString, AsmLineExpr *> _labels;
+    int _errors;
+
+    void error(AsmLineExpr * line, QString message);
+    bool evaluate(Expr * expr, quint32 & value);
+    bool operand(AsmLineExpr * line, Expr * expr, quint32 & value, bool * immediate);
+
+    int size(AsmLineExpr * line);
+    void layout();
+    void encode(AsmLineExpr * line);
+    void encodeData(AsmLineExpr * line);
+
+public:
+    QList<AsmLineExpr *> _lines;
+    QList<AsmWord> _code;
+
+    bool assemble(ObjectExpr * object);
+};
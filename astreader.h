@@ -0,0 +1,251 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * The binary tree that --ast writes, and a reader for it.
+ *
+ * This header needs neither Qt nor the rest of spindrake, so other tools
+ * can copy it and map a file straight into memory. Everything is little
+ * endian and aligned to four bytes, and every reference is an offset from
+ * the start of the file, so the data can be used where it lies.
+ *
+ * The file starts with an AstHeader. Its major version changes when an
+ * existing field changes meaning; a reader should refuse a major version
+ * it does not know, and can ignore the minor one, which only counts
+ * additions. Offset 0 is the header itself, so a reference of 0 is none.
+ *
+ * Each node of the folded tree is an AstNode followed by its slots: the
+ * offsets of its children, in the same order as the fields of the Expr it
+ * came from. A child list is a node of its own, AstList, whose slots are
+ * the entries. The fields of AstNode hold, by kind:
+ *
+ *   kind         text        extra              slots
+ *   Number       -           base               -
+ *   Ident        spelling    binding            -
+ *   Address      -           -                  ident, offset
+ *   Literal      -           -                  value
+ *   DataType     -           DataType           -
+ *   Block        -           Block              lines
+ *   DatLine      -           -                  symbol, align, items
+ *   DatItem      -           -                  size, data, count
+ *   Unary        operator    -                  value
+ *   Binary       operator    -                  left, right
+ *   ConAssign    -           -                  ident, value
+ *   String       string      -                  -
+ *   ObjLine      path        -                  alias, count, file
+ *   VarLine      -           VAR offset         type, ident, count
+ *   AsmLine      source      see below          label, operands, data
+ *   Method       -           Block              name, params, result, locals, body
+ *   Call         -           -                  name, args
+ *   If           -           -                  condition, then, else
+ *   Repeat       -           Repeat             condition, body
+ *   Return       -           -                  value
+ *   Wrap         brackets    -                  value
+ *   Object       file name   -                  blocks
+ *
+ * The binding of an Ident is the node of its definition, when that is in
+ * the same file. A child's constant is spelled alias#name, and folds like
+ * any other constant. An AsmLine keeps its mnemonic in the low 16 bits of
+ * extra, its condition in the next 8 and its effects in the top 8, each
+ * all ones when the line has none; value is its cog address. Wrap keeps
+ * both brackets in text, as in "[]".
+ *
+ * The symbol table follows the nodes: one AstSymbol for each name the
+ * object defines, sorted by the lower-case name, which is how Spin
+ * compares them.
+ */
+
+static const uint32_t AstMagic = 0x54534153;    // "SAST"
+static const uint16_t AstMajor = 1;
+static const uint16_t AstMinor = 0;
+
+// the same order as ExprKind, with one more for lists
+enum AstKind {
+    AstNumber,
+    AstIdent,
+    AstAddress,
+    AstLiteral,
+    AstDataType,
+    AstBlock,
+    AstDatLine,
+    AstDatItem,
+    AstUnary,
+    AstBinary,
+    AstConAssign,
+    AstString,
+    AstObjLine,
+    AstVarLine,
+    AstAsmLine,
+    AstMethod,
+    AstCall,
+    AstIf,
+    AstRepeat,
+    AstReturn,
+    AstWrap,
+    AstObject,
+    AstList = 0xff
+};
+
+enum AstFlag {
+    AstConstant = 1,    // value holds the folded value
+    AstFloat    = 2,    // the value is the bits of a float
+    AstPost     = 4     // a unary operator written after its operand
+};
+
+struct AstHeader
+{
+    uint32_t magic;
+    uint16_t major;
+    uint16_t minor;
+    uint32_t size;
+    uint32_t root;
+    uint32_t symbols;
+    uint32_t symbolCount;
+};
+
+struct AstNode
+{
+    uint8_t kind;
+    uint8_t flags;
+    uint16_t slots;
+    uint32_t value;
+    uint32_t text;
+    int32_t line;
+    int32_t column;
+    uint32_t extra;
+
+    const uint32_t * slot() const
+    {
+        return (const uint32_t *) (this + 1);
+    }
+};
+
+struct AstSymbol
+{
+    uint32_t name;
+    uint32_t ident;
+    uint32_t definition;
+};
+
+// a string is its length in bytes, then UTF-8 and a terminating zero
+struct AstText
+{
+    uint32_t length;
+
+    const char * data() const
+    {
+        return (const char *) (this + 1);
+    }
+};
+
+/*
+ * Checks every offset it follows against the size of the data, so a
+ * truncated or damaged file gives NULL rather than a read out of bounds.
+ */
+class AstReader
+{
+    const char * _data;
+    size_t _size;
+
+    bool fits(uint32_t offset, size_t size) const
+    {
+        return offset != 0 && offset % 4 == 0 && offset <= _size && size <= _size - offset;
+    }
+
+public:
+    AstReader(const void * data, size_t size)
+        : _data((const char *) data)
+        , _size(size)
+    {
+    }
+
+    bool valid() const
+    {
+        if (_size < sizeof(AstHeader)) return false;
+
+        const AstHeader * h = header();
+        return h->magic == AstMagic && h->major == AstMajor && h->size <= _size;
+    }
+
+    const AstHeader * header() const
+    {
+        return (const AstHeader *) _data;
+    }
+
+    const AstNode * node(uint32_t offset) const
+    {
+        if (!fits(offset, sizeof(AstNode))) return NULL;
+
+        const AstNode * n = (const AstNode *) (_data + offset);
+        if (!fits(offset, sizeof(AstNode) + 4 * (size_t) n->slots)) return NULL;
+        return n;
+    }
+
+    const AstNode * root() const
+    {
+        return node(header()->root);
+    }
+
+    const AstNode * child(const AstNode * parent, int slot) const
+    {
+        if (parent == NULL || slot < 0 || slot >= parent->slots) return NULL;
+        return node(parent->slot()[slot]);
+    }
+
+    // the bound definition of an Ident
+    const AstNode * binding(const AstNode * ident) const
+    {
+        if (ident == NULL || ident->kind != AstIdent) return NULL;
+        return node(ident->extra);
+    }
+
+    const char * string(uint32_t offset) const
+    {
+        if (!fits(offset, sizeof(AstText))) return NULL;
+
+        const AstText * s = (const AstText *) (_data + offset);
+        if (!fits(offset, sizeof(AstText) + (size_t) s->length + 1)) return NULL;
+        if (s->data()[s->length] != '\0') return NULL;
+        return s->data();
+    }
+
+    const char * text(const AstNode * n) const
+    {
+        return n != NULL ? string(n->text) : NULL;
+    }
+
+    int symbolCount() const
+    {
+        const AstHeader * h = header();
+        if (!fits(h->symbols, sizeof(AstSymbol) * (size_t) h->symbolCount)) return 0;
+        return h->symbolCount;
+    }
+
+    const AstSymbol * symbol(int index) const
+    {
+        if (index < 0 || index >= symbolCount()) return NULL;
+        return (const AstSymbol *) (_data + header()->symbols) + index;
+    }
+
+    // name must be in lower case already
+    const AstSymbol * find(const char * name) const
+    {
+        int lo = 0;
+        int hi = symbolCount();
+
+        while (lo < hi)
+        {
+            int mid = (lo + hi) / 2;
+            const char * s = string(symbol(mid)->name);
+            int c = s != NULL ? strcmp(s, name) : -1;
+
+            if (c == 0) return symbol(mid);
+            if (c < 0) lo = mid + 1;
+            else hi = mid;
+        }
+        return NULL;
+    }
+};
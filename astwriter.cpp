@@ -0,0 +1,312 @@
+#include <QStringList>
+
+#include "astwriter.h"
+#include "symbols.h"
+
+static_assert(AstObject == (int) ObjectKind, "AstKind must follow ExprKind");
+
+void AstWriter::put(int at, quint32 value)
+{
+    for (int b = 0; b < 4; b++)
+        _data[at + b] = (char) (value >> (8 * b));
+}
+
+void AstWriter::append(quint32 value)
+{
+    for (int b = 0; b < 4; b++)
+        _data.append((char) (value >> (8 * b)));
+}
+
+quint32 AstWriter::string(const QString & s)
+{
+    if (_strings.contains(s))
+        return _strings[s];
+
+    QByteArray bytes = s.toUtf8();
+    quint32 at = _data.size();
+
+    append(bytes.size());
+    _data.append(bytes);
+    do
+        _data.append('\0');
+    while (_data.size() % 4 != 0);
+
+    _strings[s] = at;
+    return at;
+}
+
+void AstWriter::node(const Pending & p, QList<Pending> & stack)
+{
+    quint32 kind = AstList;
+    quint32 flags = 0;
+    quint32 value = 0;
+    quint32 text = 0;
+    qint32 line = 0;
+    qint32 column = 0;
+    quint32 extra = 0;
+    Expr * binding = NULL;
+    QList<Pending> children;
+
+    if (p.list != NULL)
+    {
+        for (Expr * e : *p.list)
+            children << Pending {e, NULL, -1};
+    }
+    else
+    {
+        Expr * expr = p.expr;
+        kind = expr->_kind;
+
+        if (expr->isConstant())
+        {
+            flags |= AstConstant;
+            value = expr->value();
+            if (expr->isFloat())
+                flags |= AstFloat;
+        }
+
+        switch (expr->_kind)
+        {
+            case NumberKind:
+                extra = ((NumberExpr *) expr)->_base;
+                break;
+
+            case IdentKind:
+            {
+                IdentExpr * e = (IdentExpr *) expr;
+                text = string(e->qualified());
+                line = e->_line;
+                column = e->_column;
+                binding = e->_binding;
+                break;
+            }
+
+            case AddressKind:
+            {
+                AddressExpr * e = (AddressExpr *) expr;
+                children << Pending {e->_ident, NULL, -1} << Pending {e->_offset, NULL, -1};
+                break;
+            }
+
+            case LiteralKind:
+                children << Pending {((LiteralExpr *) expr)->_val, NULL, -1};
+                break;
+
+            case DataTypeKind:
+                extra = ((DataTypeExpr *) expr)->_val;
+                break;
+
+            case BlockKind:
+            {
+                BlockExpr * e = (BlockExpr *) expr;
+                extra = e->_block;
+                children << Pending {NULL, &e->_lines, -1};
+                break;
+            }
+
+            case DatLineKind:
+            {
+                DatLineExpr * e = (DatLineExpr *) expr;
+                children << Pending {e->_symbol, NULL, -1} << Pending {e->_align, NULL, -1}
+                         << Pending {NULL, &e->_items, -1};
+                break;
+            }
+
+            case DatItemKind:
+            {
+                DatItemExpr * e = (DatItemExpr *) expr;
+                children << Pending {e->_size, NULL, -1} << Pending {e->_data, NULL, -1}
+                         << Pending {e->_count, NULL, -1};
+                break;
+            }
+
+            case UnaryKind:
+            {
+                UnaryExpr * e = (UnaryExpr *) expr;
+                text = string(e->_op);
+                if (e->_post)
+                    flags |= AstPost;
+                children << Pending {e->_val, NULL, -1};
+                break;
+            }
+
+            case BinaryKind:
+            {
+                BinaryExpr * e = (BinaryExpr *) expr;
+                text = string(e->_op);
+                children << Pending {e->_left, NULL, -1} << Pending {e->_right, NULL, -1};
+                break;
+            }
+
+            case ConAssignKind:
+            {
+                ConAssignExpr * e = (ConAssignExpr *) expr;
+                children << Pending {e->_ident, NULL, -1} << Pending {e->expr, NULL, -1};
+                break;
+            }
+
+            case StringKind:
+                text = string(((StringExpr *) expr)->_string);
+                break;
+
+            case ObjLineKind:
+            {
+                ObjLineExpr * e = (ObjLineExpr *) expr;
+                text = string(e->_path);
+                children << Pending {e->_alias, NULL, -1} << Pending {e->_count, NULL, -1}
+                         << Pending {e->_file, NULL, -1};
+                break;
+            }
+
+            case VarLineKind:
+            {
+                VarLineExpr * e = (VarLineExpr *) expr;
+                extra = e->_offset;
+                children << Pending {e->_type, NULL, -1} << Pending {e->_ident, NULL, -1}
+                         << Pending {e->_count, NULL, -1};
+                break;
+            }
+
+            case AsmLineKind:
+            {
+                AsmLineExpr * e = (AsmLineExpr *) expr;
+                text = string(e->_text);
+                line = e->_line;
+                column = e->_first_column;
+                value = e->_address;
+                extra = (e->_mnemonic & 0xffff) | (e->_condition & 0xff) << 16 | (e->_effects & 0xff) << 24;
+                children << Pending {e->_label, NULL, -1} << Pending {NULL, &e->_operands, -1}
+                         << Pending {e->_data, NULL, -1};
+                break;
+            }
+
+            case MethodKind:
+            {
+                MethodExpr * e = (MethodExpr *) expr;
+                extra = e->_block;
+                children << Pending {e->_name, NULL, -1} << Pending {NULL, &e->_params, -1}
+                         << Pending {e->_result, NULL, -1} << Pending {NULL, &e->_locals, -1}
+                         << Pending {NULL, &e->_body, -1};
+                break;
+            }
+
+            case CallKind:
+            {
+                CallExpr * e = (CallExpr *) expr;
+                children << Pending {e->_name, NULL, -1} << Pending {NULL, &e->_args, -1};
+                break;
+            }
+
+            case IfKind:
+            {
+                IfExpr * e = (IfExpr *) expr;
+                children << Pending {e->_condition, NULL, -1} << Pending {NULL, &e->_then, -1}
+                         << Pending {NULL, &e->_else, -1};
+                break;
+            }
+
+            case RepeatKind:
+            {
+                RepeatExpr * e = (RepeatExpr *) expr;
+                extra = e->_repeat;
+                children << Pending {e->_condition, NULL, -1} << Pending {NULL, &e->_body, -1};
+                break;
+            }
+
+            case ReturnKind:
+                children << Pending {((ReturnExpr *) expr)->_value, NULL, -1};
+                break;
+
+            case WrapKind:
+            {
+                WrapExpr * e = (WrapExpr *) expr;
+                text = string(QString(e->_left) + QString(e->_right));
+                children << Pending {e->_val, NULL, -1};
+                break;
+            }
+
+            case ObjectKind:
+            {
+                ObjectExpr * e = (ObjectExpr *) expr;
+                text = string(e->name);
+                children << Pending {NULL, &e->_blocks, -1};
+                break;
+            }
+        }
+    }
+
+    // the strings above went first, so the node starts here
+    quint32 at = _data.size();
+    if (p.slot >= 0)
+        put(p.slot, at);
+    if (p.expr != NULL)
+        _offsets[p.expr] = at;
+
+    if (binding != NULL)
+        _bindings.append(qMakePair((int) (at + offsetof(AstNode, extra)), binding));
+
+    append(kind | flags << 8 | children.size() << 16);
+    append(value);
+    append(text);
+    append(line);
+    append(column);
+    append(extra);
+
+    for (int i = children.size() - 1; i >= 0; i--)
+    {
+        children[i].slot = at + sizeof(AstNode) + 4 * i;
+        if (children[i].expr != NULL || children[i].list != NULL)
+            stack.append(children[i]);
+    }
+    for (int i = 0; i < children.size(); i++)
+        append(0);
+}
+
+QByteArray AstWriter::write(ObjectExpr * object)
+{
+    _data.clear();
+    _offsets.clear();
+    _strings.clear();
+    _bindings.clear();
+
+    for (int i = 0; i < (int) sizeof(AstHeader); i++)
+        _data.append('\0');
+
+    QList<Pending> stack;
+    stack << Pending {object, NULL, offsetof(AstHeader, root)};
+    while (!stack.isEmpty())
+    {
+        Pending p = stack.last();
+        stack.removeLast();
+        node(p, stack);
+    }
+
+    // definitions elsewhere, like another object's constants, stay 0
+    for (int i = 0; i < _bindings.size(); i++)
+        put(_bindings[i].first, _offsets.value(_bindings[i].second));
+
+    SymbolTable table(object);
+    QStringList names = table._symbols.keys();
+    names.sort();
+
+    QList<quint32> strings;
+    foreach (QString name, names)
+        strings.append(string(name));
+
+    quint32 symbols = _data.size();
+    for (int i = 0; i < names.size(); i++)
+    {
+        Symbol s = table._symbols[names[i]];
+        append(strings[i]);
+        append(_offsets.value(s.ident));
+        append(_offsets.value(s.definition));
+    }
+
+    put(offsetof(AstHeader, magic), AstMagic);
+    put(offsetof(AstHeader, major), AstMajor | AstMinor << 16);
+    put(offsetof(AstHeader, size), _data.size());
+    put(offsetof(AstHeader, symbols), symbols);
+    put(offsetof(AstHeader, symbolCount), names.size());
+
+    return _data;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <QPair>
+
+#include "tree.h"
+#include "astreader.h"
+
+/*
+ * Writes the folded tree of one object and its symbol table in the
+ * layout described in astreader.h, for tools that would otherwise have
+ * to parse the source again.
+ *
+ * Like the walkers, it keeps the nodes still to be written on a stack of
+ * its own, so a deep tree does not need a deep call stack.
+ */
+
+class AstWriter
+{
+    struct Pending
+    {
+        Expr * expr;
+        const ExprList * list;
+        int slot;
+    };
+
+    QByteArray _data;
+    QHash<Expr *, quint32> _offsets;
+    QHash<QString, quint32> _strings;
+    QList<QPair<int, Expr *> > _bindings;
+
+    void put(int at, quint32 value);
+    void append(quint32 value);
+    quint32 string(const QString & s);
+    void node(const Pending & p, QList<Pending> & stack);
+
+public:
+    QByteArray write(ObjectExpr * object);
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "tree.h"
+#include "symbols.h"
+#include "walker.h"
+#include "exports.h"
+
+/*
+ * Binds identifiers to the CON lines that define them, so constants that
+ * refer to other constants fold, and records which constants each CON
+ * line uses.
+ *
+ * Given the exports of child objects, an alias#name identifier is bound
+ * to the folded value of that constant in the object the alias names.
+ * Those are not lines of this object, so they are not recorded as uses.
+ */
+
+class Binder : public Walker<Binder>
+{
+    SymbolTable & _symbols;
+    ConstantExports * _exports;
+    ConAssignExpr * _current;
+
+    void bindExported(IdentExpr & expr)
+    {
+        _imports = true;
+        if (_exports == NULL) return;
+
+        ObjLineExpr * child = dynamic_cast<ObjLineExpr *>(_symbols.lookup(expr._object).definition);
+        if (child == NULL || child->_path.isEmpty()) return;
+
+        expr._binding = _exports->lookup(child->_path, expr._ident);
+    }
+
+public:
+    using Walker<Binder>::visit;
+
+    QHash<ConAssignExpr *, QList<IdentExpr *> > _uses;
+
+    // whether any identifier names a child's constant
+    bool _imports;
+
+    Binder(SymbolTable & symbols, ConstantExports * exports = NULL)
+        : _symbols(symbols)
+        , _exports(exports)
+    {
+        _current = NULL;
+        _imports = false;
+    }
+
+    void visit(IdentExpr & expr)
+    {
+        if (!expr._object.isEmpty())
+        {
+            bindExported(expr);
+            return;
+        }
+
+        if (!_symbols.contains(expr.ident())) return;
+
+        Symbol s = _symbols.lookup(expr.ident());
+        if (s.ident == &expr) return;
+
+        ConAssignExpr * c = dynamic_cast<ConAssignExpr *>(s.definition);
+        if (c == NULL) return;
+
+        expr._binding = c;
+        if (_current != NULL)
+            _uses[_current].append(&expr);
+    }
+
+    void visit(ConAssignExpr & expr)
+    {
+        _current = &expr;
+        _uses[_current];
+    }
+
+    void visit(BlockExpr &)     { _current = NULL; }
+    void visit(LiteralExpr &)   { _current = NULL; }
+    void visit(DatLineExpr &)   { _current = NULL; }
+    void visit(ObjLineExpr &)   { _current = NULL; }
+    void visit(VarLineExpr &)   { _current = NULL; }
+    void visit(AsmLineExpr &)   { _current = NULL; }
+    void visit(MethodExpr &)    { _current = NULL; }
+};
@@ -0,0 +1,1193 @@
+#include <algorithm>
+#include <QPair>
+
+#include "emitter.h"
+#include "profile.h"
+#include "walker.h"
+#include "parse.h"
+
+// names that a method assigns to or takes the address of, and the
+// strings it uses
+class UsageCollector : public Walker<UsageCollector>
+{
+    QSet<QString> & _written;
+    QList<QString> & _strings;
+
+    void target(Expr * expr)
+    {
+        if (IdentExpr * i = dynamic_cast<IdentExpr *>(expr))
+            _written.insert(i->ident());
+        else if (AddressExpr * a = dynamic_cast<AddressExpr *>(expr))
+            _written.insert(a->_ident->ident());
+    }
+
+public:
+    using Walker<UsageCollector>::visit;
+
+    UsageCollector(QSet<QString> & written, QList<QString> & strings)
+        : _written(written)
+        , _strings(strings)
+    {
+    }
+
+    void visit(BinaryExpr & expr)
+    {
+        if (isAssignmentOp(expr._op))
+            target(expr._left);
+    }
+
+    void visit(UnaryExpr & expr)
+    {
+        if (spinUnaryOp(expr._op) < 0 || expr._post)
+            target(expr._val);
+    }
+
+    void visit(AddressExpr & expr)
+    {
+        if (dynamic_cast<WrapExpr *>(expr._offset) == NULL)
+            _written.insert(expr._ident->ident());
+    }
+
+    void visit(StringExpr & expr)
+    {
+        if (!expr.isConstant())
+            _strings.append(expr._string);
+    }
+};
+
+// constant divisions that the interpreter has no value for, with the
+// name of the line or method each one is in
+class DivisionCheck : public Walker<DivisionCheck>
+{
+    IdentExpr * _where;
+
+public:
+    using Walker<DivisionCheck>::visit;
+
+    QList<QPair<IdentExpr *, BinaryExpr *> > _found;
+
+    DivisionCheck()
+    {
+        _where = NULL;
+    }
+
+    void visit(ConAssignExpr & expr)    { _where = expr._ident; }
+    void visit(DatLineExpr & expr)      { _where = expr._symbol; }
+    void visit(VarLineExpr & expr)      { _where = expr._ident; }
+    void visit(MethodExpr & expr)       { _where = expr._name; }
+    void visit(ObjLineExpr & expr)      { _where = expr._alias; }
+
+    // the assembler reports its own operands
+    void visit(AsmLineExpr &)           { _where = NULL; }
+
+    void visit(BinaryExpr & expr)
+    {
+        int op = spinBinaryOp(expr._op);
+        if ((op == 0xf6 || op == 0xf7) && !expr.hasFloat() && _where != NULL
+                && expr._left->isConstant() && expr._right->isConstant() && !expr.isConstant())
+            _found.append(qMakePair(_where, &expr));
+    }
+};
+
+static bool longerString(const QString & a, const QString & b)
+{
+    return a.size() > b.size();
+}
+
+static bool isJump(const ByteOp & op)
+{
+    return op.kind == ByteOp::Jump
+        || op.kind == ByteOp::JumpZero
+        || op.kind == ByteOp::JumpNotZero;
+}
+
+static bool isTerminal(const ByteOp & op)
+{
+    return op.kind == ByteOp::Jump
+        || op.kind == ByteOp::Return
+        || op.kind == ByteOp::ReturnValue;
+}
+
+static QByteArray pushConstant(quint32 v)
+{
+    QByteArray b;
+
+    if (v == 0xffffffff)    { b.append((char) 0x34); return b; }
+    if (v == 0)             { b.append((char) 0x35); return b; }
+    if (v == 1)             { b.append((char) 0x36); return b; }
+
+    // 2 << n, optionally decremented and/or inverted
+    for (int n = 0; n < 31; n++)
+    {
+        quint32 m = 2u << n;
+        quint32 masks[4] = { m, m - 1, ~m, ~(m - 1) };
+
+        for (int k = 0; k < 4; k++)
+        {
+            if (masks[k] != v) continue;
+
+            b.append((char) 0x37);
+            b.append((char) (n | (k & 1) << 5 | (k & 2) << 5));
+            return b;
+        }
+    }
+
+    int count = v < 0x100 ? 1 : v < 0x10000 ? 2 : v < 0x1000000 ? 3 : 4;
+    b.append((char) (0x37 + count));
+    for (int i = count - 1; i >= 0; i--)
+        b.append((char) (v >> (8 * i)));
+    return b;
+}
+
+// action is 0 to read, 1 to write, 3 for the address
+static QByteArray variable(const ByteOp & op, int action)
+{
+    QByteArray b;
+    quint32 offset = op.value;
+
+    if (op.size == 4 && !op.indexed && op.base != ByteOp::Object && offset % 4 == 0 && offset / 4 < 8)
+    {
+        b.append((char) ((op.base == ByteOp::Local ? 0x60 : 0x40) | offset | action));
+        return b;
+    }
+
+    int size = op.size == 1 ? 0 : op.size == 2 ? 1 : 2;
+    int base = op.base == ByteOp::Local ? 3 : op.base == ByteOp::Var ? 2 : 1;
+
+    b.append((char) (0x80 | size << 5 | (op.indexed ? 0x10 : 0) | base << 2 | action));
+    if (offset < 0x80)
+        b.append((char) offset);
+    else
+    {
+        b.append((char) (0x80 | offset >> 8));
+        b.append((char) offset);
+    }
+    return b;
+}
+
+static QByteArray encodeOp(const ByteOp & op)
+{
+    QByteArray b;
+
+    switch (op.kind)
+    {
+        case ByteOp::Push:          return pushConstant(op.value);
+        case ByteOp::Load:          return variable(op, 0);
+        case ByteOp::Store:         return variable(op, 1);
+        case ByteOp::Address:       return variable(op, 3);
+        case ByteOp::Math:          b.append((char) op.value); break;
+        case ByteOp::Anchor:        b.append((char) op.value); break;
+        case ByteOp::Call:          b.append((char) 0x05); b.append((char) op.value); break;
+        case ByteOp::Return:        b.append((char) 0x32); break;
+        case ByteOp::ReturnValue:   b.append((char) 0x33); break;
+        case ByteOp::Register:      b.append((char) 0x3f); b.append((char) (0x80 | (op.value & 0x1f))); break;
+        default:                    break;
+    }
+
+    return b;
+}
+
+// rewrites the ops at the end of a straight run of code
+static bool rewrite(QList<ByteOp> & ops)
+{
+    int n = ops.size();
+    quint32 r;
+
+    if (n >= 3 && ops[n-1].kind == ByteOp::Math && !spinUnary(ops[n-1].value)
+               && ops[n-2].kind == ByteOp::Push && ops[n-3].kind == ByteOp::Push
+               && spinMath(ops[n-1].value, ops[n-3].value, ops[n-2].value, r))
+    {
+        ops.removeLast();
+        ops.removeLast();
+        ops.last().value = r;
+        return true;
+    }
+
+    if (n >= 2 && ops[n-1].kind == ByteOp::Math && spinUnary(ops[n-1].value)
+               && ops[n-2].kind == ByteOp::Push
+               && spinMath(ops[n-1].value, ops[n-2].value, 0, r))
+    {
+        ops.removeLast();
+        ops.last().value = r;
+        return true;
+    }
+
+    if (n >= 2 && ops[n-1].kind == ByteOp::Store && ops[n-2].kind == ByteOp::Load
+               && ops[n-1].value == ops[n-2].value && ops[n-1].base == ops[n-2].base
+               && ops[n-1].size == ops[n-2].size && !ops[n-1].indexed && !ops[n-2].indexed)
+    {
+        ops.removeLast();
+        ops.removeLast();
+        return true;
+    }
+
+    if (n >= 2 && ops[n-2].kind == ByteOp::Push
+               && (ops[n-1].kind == ByteOp::JumpZero || ops[n-1].kind == ByteOp::JumpNotZero))
+    {
+        bool taken = (ops[n-2].value == 0) == (ops[n-1].kind == ByteOp::JumpZero);
+        ByteOp jump = ops.takeLast();
+        ops.removeLast();
+
+        if (taken)
+        {
+            jump.kind = ByteOp::Jump;
+            ops.append(jump);
+        }
+        return true;
+    }
+
+    if (n >= 2 && ops[n-2].kind == ByteOp::Math && ops[n-2].value == 0xff
+               && (ops[n-1].kind == ByteOp::JumpZero || ops[n-1].kind == ByteOp::JumpNotZero))
+    {
+        ByteOp jump = ops.takeLast();
+        jump.kind = jump.kind == ByteOp::JumpZero ? ByteOp::JumpNotZero : ByteOp::JumpZero;
+        ops.last() = jump;
+        return true;
+    }
+
+    return false;
+}
+
+void Emitter::error(IdentExpr * where, QString message)
+{
+    Diagnostic d;
+    d.line = where->_line;
+    d.first_column = where->_column;
+    d.last_column = where->_column + where->_ident.size();
+    d.message = message;
+
+    report(_filename, d);
+    _errors++;
+}
+
+void Emitter::warning(IdentExpr * where, QString message)
+{
+    Diagnostic d;
+    d.line = where->_line;
+    d.first_column = where->_column;
+    d.last_column = where->_column + where->_ident.size();
+    d.message = message;
+
+    warn(_filename, d);
+}
+
+/*
+ * Moves DAT into the pool as one table in declared order, each label an
+ * offset into it, so that code indexing past a label reaches the lines
+ * after it. Lines before the first label cannot be reached and are left
+ * out, with a warning.
+ */
+void Emitter::data(ObjectExpr * object, const QSet<QString> & written)
+{
+    QByteArray bytes;
+    QHash<QString, ByteOp> labels;
+    IdentExpr * symbol = NULL;
+    bool constant = true;
+    bool share = true;
+
+    for (Expr * b : object->_blocks)
+    {
+        BlockExpr * block = (BlockExpr *) b;
+        if (block->_block != DatBlock) continue;
+
+        for (Expr * l : block->_lines)
+        {
+            DatLineExpr * line = (DatLineExpr *) l;
+            QString name = line->_symbol->ident();
+
+            if (name.isEmpty() && symbol == NULL)
+            {
+                warning(line->_symbol, "data before the first DAT label cannot be reached and is left out");
+                continue;
+            }
+
+            if (!name.isEmpty())
+            {
+                if (!constant)
+                    error(symbol, "data in \"" + symbol->_ident + "\" is not constant");
+
+                symbol = line->_symbol;
+                constant = true;
+
+                DataType type = line->_align->_val;
+                int size = type == DataByte ? 1 : type == DataWord ? 2 : 4;
+                while (bytes.size() % size)
+                    bytes.append('\0');
+
+                if (labels.contains(name) || _vars.contains(name))
+                {
+                    error(symbol, "symbol \"" + symbol->_ident + "\" is already defined");
+                }
+                else
+                {
+                    ByteOp where;
+                    where.kind = ByteOp::Load;
+                    where.value = bytes.size();
+                    where.base = ByteOp::Object;
+                    where.size = size;
+                    where.indexed = false;
+                    labels[name] = where;
+                    share = share && !written.contains(name);
+                }
+            }
+
+            constant = encodeData(line, bytes) && constant;
+        }
+    }
+
+    if (!constant)
+        error(symbol, "data in \"" + symbol->_ident + "\" is not constant");
+
+    if (labels.isEmpty())
+        return;
+
+    int base = _poolBase + _pool.add(bytes, 4, share);
+    foreach (QString name, labels.keys())
+    {
+        ByteOp where = labels[name];
+        where.value += base;
+        _dat[name] = where;
+    }
+}
+
+void Emitter::add(ByteOp::Kind kind, quint32 value)
+{
+    ByteOp op;
+    op.kind = kind;
+    op.value = value;
+    op.base = ByteOp::Local;
+    op.size = 4;
+    op.indexed = false;
+    _ops.append(op);
+}
+
+int Emitter::label()
+{
+    return _labels++;
+}
+
+// finds the variable, or the element of one, that expr names; index is
+// left with the expression to push first when the element is not constant
+bool Emitter::variable(Expr * expr, ByteOp & where, Expr *& index)
+{
+    IdentExpr * ident = dynamic_cast<IdentExpr *>(expr);
+    Expr * element = NULL;
+
+    if (AddressExpr * a = dynamic_cast<AddressExpr *>(expr))
+    {
+        ident = a->_ident;
+        if (WrapExpr * w = dynamic_cast<WrapExpr *>(a->_offset))
+            element = w->_val;
+    }
+
+    if (ident == NULL)
+    {
+        error(_method->_name, "can only assign to variables");
+        return false;
+    }
+
+    where.kind = ByteOp::Load;
+    where.indexed = false;
+    index = NULL;
+
+    if (_locals.contains(ident->ident()))
+    {
+        where.base = ByteOp::Local;
+        where.value = _locals[ident->ident()];
+        where.size = 4;
+    }
+    else if (_vars.contains(ident->ident()))
+    {
+        VarLineExpr * v = _vars[ident->ident()];
+        where.base = ByteOp::Var;
+        where.value = v->_offset;
+        where.size = v->elementSize();
+    }
+    else if (_dat.contains(ident->ident()))
+    {
+        where = _dat[ident->ident()];
+    }
+    else
+    {
+        error(ident, "\"" + ident->_ident + "\" is not a variable");
+        return false;
+    }
+
+    if (element != NULL && element->isConstant())
+    {
+        where.value += element->value() * where.size;
+    }
+    else if (element != NULL)
+    {
+        where.indexed = true;
+        index = element;
+    }
+    return true;
+}
+
+void Emitter::access(ByteOp::Kind kind, ByteOp where, Expr * index)
+{
+    if (index != NULL)
+        expression(index);
+
+    where.kind = kind;
+    _ops.append(where);
+}
+
+// whether evaluating expr twice does the same as evaluating it once
+bool Emitter::pure(Expr * expr)
+{
+    if (expr->isConstant())
+        return true;
+
+    if (IdentExpr * i = dynamic_cast<IdentExpr *>(expr))
+        return _locals.contains(i->ident()) || _vars.contains(i->ident()) || _dat.contains(i->ident());
+
+    if (WrapExpr * w = dynamic_cast<WrapExpr *>(expr))
+        return pure(w->_val);
+
+    if (AddressExpr * a = dynamic_cast<AddressExpr *>(expr))
+        return pure(a->_offset);
+
+    if (UnaryExpr * u = dynamic_cast<UnaryExpr *>(expr))
+        return spinUnaryOp(u->_op) >= 0 && !u->_post && pure(u->_val);
+
+    if (BinaryExpr * b = dynamic_cast<BinaryExpr *>(expr))
+        return !isAssignmentOp(b->_op) && pure(b->_left) && pure(b->_right);
+
+    if (CallExpr * c = dynamic_cast<CallExpr *>(expr))
+    {
+        if (c->intrinsic() < 0) return false;
+
+        for (Expr * a : c->_args)
+        {
+            if (!pure(a)) return false;
+        }
+        return true;
+    }
+
+    return false;
+}
+
+void Emitter::expression(Expr * expr)
+{
+    if (expr->isConstant())
+    {
+        add(ByteOp::Push, expr->value());
+        return;
+    }
+
+    if (IdentExpr * i = dynamic_cast<IdentExpr *>(expr))
+    {
+        ByteOp where;
+        Expr * index;
+
+        if (_locals.contains(i->ident()) || _vars.contains(i->ident()) || _dat.contains(i->ident()))
+        {
+            if (variable(i, where, index))
+                access(ByteOp::Load, where, index);
+        }
+        else if (_indices.contains(i->ident()))
+            call(i, NULL, true);
+        else
+            error(i, "unknown symbol \"" + i->qualified() + "\"");
+        return;
+    }
+
+    if (WrapExpr * w = dynamic_cast<WrapExpr *>(expr))
+    {
+        expression(w->_val);
+        return;
+    }
+
+    // a string is the address of its copy in the pool
+    if (StringExpr * s = dynamic_cast<StringExpr *>(expr))
+    {
+        add(ByteOp::Address, _poolBase + _strings.value(s->_string));
+        _ops.last().base = ByteOp::Object;
+        _ops.last().size = 1;
+        return;
+    }
+
+    if (AddressExpr * a = dynamic_cast<AddressExpr *>(expr))
+    {
+        ByteOp where;
+        Expr * index;
+        if (!variable(a, where, index)) return;
+
+        // x[i] is an element; @x is the address
+        bool element = dynamic_cast<WrapExpr *>(a->_offset) != NULL;
+        access(element ? ByteOp::Load : ByteOp::Address, where, index);
+        return;
+    }
+
+    if (UnaryExpr * u = dynamic_cast<UnaryExpr *>(expr))
+    {
+        if (u->_val->isFloat())
+        {
+            error(_method->_name, "a float operand can only be negated, and must be constant");
+            return;
+        }
+
+        if (spinUnaryOp(u->_op) < 0 || u->_post)
+        {
+            update(u, true);
+            return;
+        }
+
+        expression(u->_val);
+        add(ByteOp::Math, spinUnaryOp(u->_op));
+        return;
+    }
+
+    if (BinaryExpr * b = dynamic_cast<BinaryExpr *>(expr))
+    {
+        if (isAssignmentOp(b->_op))
+        {
+            assign(b, true);
+            return;
+        }
+
+        // the interpreter has no float math, so floats only fold
+        if (b->hasFloat())
+        {
+            error(_method->_name, "float operands must be constant and used with + - * / or a comparison");
+            return;
+        }
+
+        expression(b->_left);
+        expression(b->_right);
+        add(ByteOp::Math, spinBinaryOp(b->_op));
+        return;
+    }
+
+    if (CallExpr * c = dynamic_cast<CallExpr *>(expr))
+    {
+        if (c->isConversion())
+        {
+            error(c->_name, "\"" + c->_name->_ident + "\" needs a constant it can convert");
+            return;
+        }
+
+        // an intrinsic that did not fold is its one math operator
+        if (c->intrinsic() >= 0)
+        {
+            for (Expr * a : c->_args)
+            {
+                if (a->isFloat())
+                {
+                    error(c->_name, "\"" + c->_name->_ident + "\" takes longs, not floats");
+                    return;
+                }
+                expression(a);
+            }
+            add(ByteOp::Math, c->intrinsic());
+            return;
+        }
+
+        call(c->_name, &c->_args, true);
+        return;
+    }
+
+    error(_method->_name, "expression cannot be used in a method");
+}
+
+void Emitter::assign(BinaryExpr * expr, bool keep)
+{
+    ByteOp where;
+    Expr * index;
+    if (!variable(expr->_left, where, index)) return;
+
+    if (index != NULL && (expr->_op != "=" || keep) && !pure(index))
+    {
+        error(((AddressExpr *) expr->_left)->_ident, "an index used more than once cannot have side effects");
+        return;
+    }
+
+    if (expr->_op == "=")
+    {
+        expression(expr->_right);
+    }
+    else
+    {
+        access(ByteOp::Load, where, index);
+        expression(expr->_right);
+        add(ByteOp::Math, spinBinaryOp(QLatin1String(expr->_op.latin1(), expr->_op.size() - 1)));
+    }
+
+    access(ByteOp::Store, where, index);
+    if (keep)
+        access(ByteOp::Load, where, index);
+}
+
+void Emitter::update(UnaryExpr * expr, bool keep)
+{
+    ByteOp where;
+    Expr * index;
+    if (!variable(expr->_val, where, index)) return;
+
+    if (index != NULL && !pure(index))
+    {
+        error(((AddressExpr *) expr->_val)->_ident, "an index used more than once cannot have side effects");
+        return;
+    }
+
+    if (expr->_op == "++" || expr->_op == "--")
+    {
+        if (keep && expr->_post)
+            access(ByteOp::Load, where, index);
+
+        access(ByteOp::Load, where, index);
+        add(ByteOp::Push, 1);
+        add(ByteOp::Math, expr->_op == "++" ? 0xec : 0xed);
+        access(ByteOp::Store, where, index);
+
+        if (keep && !expr->_post)
+            access(ByteOp::Load, where, index);
+        return;
+    }
+
+    // x~ and x~~ clear or set x, leaving its old value
+    if (expr->_post)
+    {
+        if (keep)
+            access(ByteOp::Load, where, index);
+        add(ByteOp::Push, expr->_op == "~" ? 0 : 0xffffffff);
+        access(ByteOp::Store, where, index);
+        return;
+    }
+
+    // ~x and ~~x sign-extend x from bit 7 or bit 15
+    int shift = expr->_op == "~" ? 24 : 16;
+    access(ByteOp::Load, where, index);
+    add(ByteOp::Push, shift);
+    add(ByteOp::Math, 0xe3);
+    add(ByteOp::Push, shift);
+    add(ByteOp::Math, 0xee);
+    access(ByteOp::Store, where, index);
+
+    if (keep)
+        access(ByteOp::Load, where, index);
+}
+
+void Emitter::call(IdentExpr * name, const ExprList * args, bool keep)
+{
+    MethodExpr * method = _methodsByName.value(name->ident());
+    if (method == NULL)
+    {
+        error(name, "unknown method \"" + name->_ident + "\"");
+        return;
+    }
+
+    int count = args != NULL ? args->size() : 0;
+    if (count != method->_params.size())
+    {
+        error(name, QString("%1 takes %2 arguments").arg(name->_ident).arg(method->_params.size()));
+        return;
+    }
+
+    add(ByteOp::Anchor, keep ? 0x00 : 0x01);
+    if (args != NULL)
+    {
+        for (Expr * a : *args)
+            expression(a);
+    }
+    add(ByteOp::Call, _indices[name->ident()]);
+}
+
+void Emitter::statement(Expr * expr)
+{
+    if (IfExpr * i = dynamic_cast<IfExpr *>(expr))
+    {
+        int otherwise = label();
+        int end = label();
+
+        expression(i->_condition);
+        add(ByteOp::JumpZero, otherwise);
+        statements(i->_then);
+
+        if (!i->_else.isEmpty())
+        {
+            add(ByteOp::Jump, end);
+            add(ByteOp::Label, otherwise);
+            statements(i->_else);
+            add(ByteOp::Label, end);
+        }
+        else
+        {
+            add(ByteOp::Label, otherwise);
+        }
+        return;
+    }
+
+    if (RepeatExpr * r = dynamic_cast<RepeatExpr *>(expr))
+    {
+        int top = label();
+        int end = label();
+
+        if (r->_repeat == RepeatCount)
+        {
+            int counter = 4 * _slots++;
+            expression(r->_condition);
+            add(ByteOp::Store, counter);
+
+            add(ByteOp::Label, top);
+            add(ByteOp::Load, counter);
+            add(ByteOp::JumpZero, end);
+            statements(r->_body);
+            add(ByteOp::Load, counter);
+            add(ByteOp::Push, 1);
+            add(ByteOp::Math, 0xed);
+            add(ByteOp::Store, counter);
+            add(ByteOp::Jump, top);
+            add(ByteOp::Label, end);
+            return;
+        }
+
+        add(ByteOp::Label, top);
+
+        if (r->_repeat == RepeatWhile || r->_repeat == RepeatUntil)
+        {
+            expression(r->_condition);
+            add(r->_repeat == RepeatWhile ? ByteOp::JumpZero : ByteOp::JumpNotZero, end);
+        }
+
+        statements(r->_body);
+        add(ByteOp::Jump, top);
+        add(ByteOp::Label, end);
+        return;
+    }
+
+    if (ReturnExpr * r = dynamic_cast<ReturnExpr *>(expr))
+    {
+        if (r->_value != NULL)
+        {
+            expression(r->_value);
+            add(ByteOp::ReturnValue);
+        }
+        else
+        {
+            add(ByteOp::Return);
+        }
+        return;
+    }
+
+    if (BinaryExpr * b = dynamic_cast<BinaryExpr *>(expr))
+    {
+        if (isAssignmentOp(b->_op))
+        {
+            assign(b, false);
+            return;
+        }
+    }
+
+    if (UnaryExpr * u = dynamic_cast<UnaryExpr *>(expr))
+    {
+        if (spinUnaryOp(u->_op) < 0 || u->_post)
+        {
+            update(u, false);
+            return;
+        }
+    }
+
+    if (CallExpr * c = dynamic_cast<CallExpr *>(expr))
+    {
+        if (c->intrinsic() < 0 && !c->isConversion())
+        {
+            call(c->_name, &c->_args, false);
+            return;
+        }
+    }
+
+    if (IdentExpr * i = dynamic_cast<IdentExpr *>(expr))
+    {
+        if (_indices.contains(i->ident()))
+        {
+            call(i, NULL, false);
+            return;
+        }
+    }
+
+    error(_method->_name, "statement has no effect");
+}
+
+void Emitter::statements(const ExprList & list)
+{
+    for (Expr * s : list)
+        statement(s);
+}
+
+bool Emitter::optimize()
+{
+    bool changed = false;
+
+    // straight-line rewrites, dropping code that follows a jump or return
+    QList<ByteOp> out;
+    foreach (ByteOp op, _ops)
+    {
+        if (!out.isEmpty() && isTerminal(out.last()) && op.kind != ByteOp::Label)
+        {
+            changed = true;
+            continue;
+        }
+
+        out.append(op);
+        while (rewrite(out))
+            changed = true;
+    }
+    _ops = out;
+
+    QHash<quint32, int> targets;
+    for (int i = 0; i < _ops.size(); i++)
+    {
+        if (_ops[i].kind == ByteOp::Label)
+            targets[_ops[i].value] = i;
+    }
+
+    // jumps to jumps go straight to the final target
+    for (int i = 0; i < _ops.size(); i++)
+    {
+        if (!isJump(_ops[i])) continue;
+
+        quint32 target = _ops[i].value;
+        for (int hops = 0; hops < _ops.size(); hops++)
+        {
+            int j = targets[target];
+            while (j < _ops.size() && _ops[j].kind == ByteOp::Label)
+                j++;
+
+            if (j == _ops.size() || _ops[j].kind != ByteOp::Jump || _ops[j].value == target)
+                break;
+            target = _ops[j].value;
+        }
+
+        if (target != _ops[i].value)
+        {
+            _ops[i].value = target;
+            changed = true;
+        }
+    }
+
+    out.clear();
+    QHash<quint32, int> uses;
+
+    for (int i = 0; i < _ops.size(); i++)
+    {
+        ByteOp op = _ops[i];
+
+        // a jump to the next op does nothing
+        if (op.kind == ByteOp::Jump)
+        {
+            int j = i + 1;
+            while (j < _ops.size() && _ops[j].kind == ByteOp::Label && _ops[j].value != op.value)
+                j++;
+
+            if (j < _ops.size() && _ops[j].kind == ByteOp::Label)
+            {
+                changed = true;
+                continue;
+            }
+        }
+
+        // jz a; jmp b; a: is jnz b; a:
+        if ((op.kind == ByteOp::JumpZero || op.kind == ByteOp::JumpNotZero)
+                && i + 2 < _ops.size()
+                && _ops[i+1].kind == ByteOp::Jump
+                && _ops[i+2].kind == ByteOp::Label && _ops[i+2].value == op.value)
+        {
+            op.kind = op.kind == ByteOp::JumpZero ? ByteOp::JumpNotZero : ByteOp::JumpZero;
+            op.value = _ops[i+1].value;
+            i++;
+            changed = true;
+        }
+
+        if (isJump(op))
+            uses[op.value]++;
+        out.append(op);
+    }
+
+    // labels nothing jumps to
+    _ops.clear();
+    foreach (ByteOp op, out)
+    {
+        if (op.kind == ByteOp::Label && uses.value(op.value) == 0)
+        {
+            changed = true;
+            continue;
+        }
+        _ops.append(op);
+    }
+
+    return changed;
+}
+
+QByteArray Emitter::encode()
+{
+    int n = _ops.size();
+    QVector<int> size(n);
+    QVector<int> position(n + 1);
+    QHash<quint32, int> targets;
+
+    for (int i = 0; i < n; i++)
+    {
+        if (_ops[i].kind == ByteOp::Label)
+            targets[_ops[i].value] = i;
+
+        size[i] = isJump(_ops[i]) ? 2 : encodeOp(_ops[i]).size();
+    }
+
+    // every jump starts short and only ever grows, so this settles
+    bool grown = true;
+    while (grown)
+    {
+        grown = false;
+
+        position[0] = 0;
+        for (int i = 0; i < n; i++)
+            position[i + 1] = position[i] + size[i];
+
+        for (int i = 0; i < n; i++)
+        {
+            if (!isJump(_ops[i]) || size[i] == 3) continue;
+
+            int offset = position[targets[_ops[i].value]] - position[i + 1];
+            if (offset < -64 || offset > 63)
+            {
+                size[i] = 3;
+                grown = true;
+            }
+        }
+    }
+
+    QByteArray code;
+    for (int i = 0; i < n; i++)
+    {
+        if (!isJump(_ops[i]))
+        {
+            code.append(encodeOp(_ops[i]));
+            continue;
+        }
+
+        switch (_ops[i].kind)
+        {
+            case ByteOp::JumpZero:      code.append((char) 0x0a); break;
+            case ByteOp::JumpNotZero:   code.append((char) 0x0b); break;
+            default:                    code.append((char) 0x04); break;
+        }
+
+        int offset = position[targets[_ops[i].value]] - position[i + 1];
+        if (size[i] == 2)
+        {
+            code.append((char) (offset & 0x7f));
+        }
+        else
+        {
+            code.append((char) (0x80 | ((offset >> 8) & 0x7f)));
+            code.append((char) offset);
+        }
+    }
+
+    return code;
+}
+
+Emitter::Emitter()
+{
+    _profile = false;
+    _profileBuffer = -1;
+}
+
+/*
+ * Counts the call and keeps CNT in the hidden local at start on entry,
+ * then at every return adds the cycles since to the method's total. The
+ * counters go in after the peephole pass so they do not change what it
+ * does to the method's own code.
+ */
+void Emitter::instrument(int index, int start)
+{
+    ByteOp counter;
+    counter.base = ByteOp::Object;
+    counter.size = 4;
+    counter.indexed = false;
+
+    QList<ByteOp> ops = _ops;
+    _ops.clear();
+
+    counter.kind = ByteOp::Load;
+    counter.value = _profileBuffer + ProfileHeader + ProfileEntry * index;
+    _ops.append(counter);
+    add(ByteOp::Push, 1);
+    add(ByteOp::Math, 0xec);
+    counter.kind = ByteOp::Store;
+    _ops.append(counter);
+
+    add(ByteOp::Register, ProfileClock);
+    add(ByteOp::Store, start);
+
+    counter.value += 4;
+    foreach (ByteOp op, ops)
+    {
+        if (op.kind == ByteOp::Return || op.kind == ByteOp::ReturnValue)
+        {
+            counter.kind = ByteOp::Load;
+            _ops.append(counter);
+            add(ByteOp::Register, ProfileClock);
+            add(ByteOp::Load, start);
+            add(ByteOp::Math, 0xed);
+            add(ByteOp::Math, 0xec);
+            counter.kind = ByteOp::Store;
+            _ops.append(counter);
+        }
+        _ops.append(op);
+    }
+}
+
+bool Emitter::compile(ObjectExpr * object)
+{
+    _filename = object->name;
+    _methodsByName.clear();
+    _indices.clear();
+    _methods.clear();
+    _vars.clear();
+    _dat.clear();
+    _strings.clear();
+    _pool.clear();
+    _profileBuffer = -1;
+    _errors = 0;
+
+    // layout errors are reported already; they only need to fail the build
+    if (!_layout.layout(object))
+        _errors++;
+
+    foreach (VarLineExpr * v, _layout._vars)
+        _vars[v->_ident->ident()] = v;
+
+    // PUB methods are numbered before PRI methods
+    QList<MethodExpr *> methods;
+    foreach (Block kind, QList<Block>() << PubBlock << PriBlock)
+    {
+        for (Expr * b : object->_blocks)
+        {
+            BlockExpr * block = (BlockExpr *) b;
+            if (block->_block != kind) continue;
+
+            for (Expr * l : block->_lines)
+                methods.append((MethodExpr *) l);
+        }
+    }
+
+    DivisionCheck divisions;
+    divisions.walk(object);
+    for (int i = 0; i < divisions._found.size(); i++)
+    {
+        BinaryExpr * b = divisions._found[i].second;
+        error(divisions._found[i].first, b->_right->value() == 0 ? "division by zero in a constant expression"
+                                                                  : "constant division overflows");
+    }
+
+    QSet<QString> written;
+    QList<QString> strings;
+    UsageCollector collector(written, strings);
+    foreach (MethodExpr * method, methods)
+        collector.walk(method);
+
+    _poolBase = 4 * (methods.size() + 1);
+    data(object, written);
+
+    // longest first, so that shorter strings can share their endings
+    std::stable_sort(strings.begin(), strings.end(), longerString);
+    foreach (QString s, strings)
+        _strings[s] = _pool.intern(s);
+
+    if (_profile)
+        _profileBuffer = _poolBase + _pool.add(profileBuffer(methods.size()), 4, false);
+
+    for (int i = 0; i < methods.size(); i++)
+    {
+        QString name = methods[i]->_name->ident();
+        if (_methodsByName.contains(name))
+        {
+            error(methods[i]->_name, "method \"" + methods[i]->_name->_ident + "\" is already defined");
+            continue;
+        }
+        if ((QStringList() << "sqrt" << "abs" << "min" << "max" << "float" << "trunc" << "round").contains(name))
+        {
+            error(methods[i]->_name, "\"" + methods[i]->_name->_ident + "\" is reserved");
+            continue;
+        }
+
+        _methodsByName[name] = methods[i];
+        _indices[name] = i + 1;
+    }
+
+    foreach (MethodExpr * method, methods)
+    {
+        _method = method;
+        _locals.clear();
+        _ops.clear();
+        _labels = 0;
+
+        _locals[method->_result != NULL ? method->_result->ident() : QString("result")] = 0;
+        _slots = 1;
+        for (Expr * p : method->_params)
+            _locals[((IdentExpr *) p)->ident()] = 4 * _slots++;
+        for (Expr * l : method->_locals)
+            _locals[((IdentExpr *) l)->ident()] = 4 * _slots++;
+
+        statements(method->_body);
+        add(ByteOp::Return);
+
+        MethodCode m;
+        m.method = method;
+        m.index = _indices.value(method->_name->ident());
+        m.unoptimized = encode().size();
+
+        while (optimize())
+            ;
+
+        if (_profile)
+            instrument(_methods.size(), 4 * _slots++);
+
+        m.code = encode();
+        m.locals = 4 * (_slots - 1 - method->_params.size());
+        _methods.append(m);
+    }
+
+    return _errors == 0;
+}
+
+QByteArray Emitter::image() const
+{
+    QByteArray table;
+    QByteArray code;
+    QByteArray pool = _pool._data;
+
+    while (pool.size() % 4)
+        pool.append('\0');
+
+    int start = 4 * (_methods.size() + 1) + pool.size();
+
+    foreach (MethodCode m, _methods)
+    {
+        int offset = start + code.size();
+        table.append((char) offset);
+        table.append((char) (offset >> 8));
+        table.append((char) m.locals);
+        table.append((char) (m.locals >> 8));
+        code.append(m.code);
+    }
+
+    while (code.size() % 4)
+        code.append('\0');
+
+    int size = start + code.size();
+
+    QByteArray image;
+    image.append((char) size);
+    image.append((char) (size >> 8));
+    image.append((char) (_methods.size() + 1));
+    image.append('\0');
+    image.append(table);
+    image.append(pool);
+    image.append(code);
+    return image;
+}
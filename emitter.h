@@ -0,0 +1,124 @@
+#pragma once
+
+#include <QSet>
+
+#include "tree.h"
+#include "varlayout.h"
+#include "pool.h"
+
+/*
+ * Spin interpreter bytecode for the PUB and PRI methods of an object.
+ *
+ * Methods are first lowered to symbolic ops, where jumps name labels
+ * and pushes hold full values. A peephole pass then folds constant
+ * operations, drops loads that are stored straight back and threads or
+ * removes jumps. Encoding picks the shortest form of each op: the one
+ * byte constants and mask pushes, the compact forms for the first eight
+ * locals and VAR longs, and one byte jump offsets wherever the target is
+ * close enough.
+ *
+ * String literals and DAT go into a constant pool between the method
+ * table and the code, where they are addressed from pbase. DAT goes in
+ * whole and in declared order, so indexing past a label reaches the lines
+ * after it as it does on the chip, and it is shared with an identical
+ * string only when no method writes to or takes the address of any of
+ * its labels.
+ *
+ * With _profile set, each method also counts its calls and the cycles it
+ * runs for, read from CNT, into a buffer reserved at the end of the pool;
+ * see profile.h for its layout.
+ */
+
+struct ByteOp
+{
+    enum Kind {
+        Label,
+        Push,
+        Load,
+        Store,
+        Address,
+        Math,
+        Jump,
+        JumpZero,
+        JumpNotZero,
+        Anchor,
+        Call,
+        Return,
+        ReturnValue,
+        Register
+    };
+
+    enum Base {
+        Local,
+        Var,
+        Object
+    };
+
+    Kind kind;
+    quint32 value;
+
+    // where Load, Store and Address find their variable
+    Base base;
+    int size;
+    bool indexed;
+};
+
+struct MethodCode
+{
+    MethodExpr * method;
+    int index;
+    int locals;
+    int unoptimized;
+    QByteArray code;
+};
+
+class Emitter
+{
+    QString _filename;
+    QHash<QString, MethodExpr *> _methodsByName;
+    QHash<QString, int> _indices;
+    QHash<QString, int> _locals;
+    QHash<QString, VarLineExpr *> _vars;
+    QHash<QString, ByteOp> _dat;
+    QHash<QString, int> _strings;
+    int _poolBase;
+    MethodExpr * _method;
+    QList<ByteOp> _ops;
+    int _labels;
+    int _slots;
+    int _errors;
+
+    void error(IdentExpr * where, QString message);
+    void warning(IdentExpr * where, QString message);
+    void data(ObjectExpr * object, const QSet<QString> & written);
+
+    void add(ByteOp::Kind kind, quint32 value = 0);
+    int label();
+    bool variable(Expr * expr, ByteOp & where, Expr *& index);
+    void access(ByteOp::Kind kind, ByteOp where, Expr * index);
+    bool pure(Expr * expr);
+
+    void expression(Expr * expr);
+    void assign(BinaryExpr * expr, bool keep);
+    void update(UnaryExpr * expr, bool keep);
+    void call(IdentExpr * name, const ExprList * args, bool keep);
+    void statement(Expr * expr);
+    void statements(const ExprList & list);
+
+    bool optimize();
+    void instrument(int index, int start);
+    QByteArray encode();
+
+public:
+    VarLayout _layout;
+    ConstantPool _pool;
+    QList<MethodCode> _methods;
+
+    bool _profile;
+    int _profileBuffer;
+
+    Emitter();
+
+    bool compile(ObjectExpr * object);
+    QByteArray image() const;
+};
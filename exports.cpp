@@ -0,0 +1,142 @@
+#include "exports.h"
+#include "parse.h"
+#include "folder.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+static QString absolute(QString path)
+{
+    return QDir::cleanPath(QFileInfo(path).absoluteFilePath());
+}
+
+ConstantExports::ConstantExports(ObjectResolver & resolver)
+    : _resolver(&resolver)
+{
+}
+
+ConstantExports::ConstantExports()
+    : _resolver(NULL)
+{
+}
+
+ConstantExports::~ConstantExports()
+{
+    foreach (QString path, _tables.keys())
+        clear(path);
+}
+
+void ConstantExports::clear(QString path)
+{
+    foreach (ConAssignExpr * c, _tables.value(path).values())
+    {
+        delete c->_ident;
+        delete c;
+    }
+    _tables.remove(path);
+}
+
+QHash<QString, ConAssignExpr *> ConstantExports::exported(ObjectExpr * object)
+{
+    QHash<QString, ConAssignExpr *> table;
+
+    for (Expr * b : object->_blocks)
+    {
+        BlockExpr * block = (BlockExpr *) b;
+        if (block->_block != ConBlock) continue;
+
+        for (Expr * l : block->_lines)
+        {
+            ConAssignExpr * c = dynamic_cast<ConAssignExpr *>(l);
+            if (c == NULL || !c->isConstant()) continue;
+
+            // the first definition wins, as in the object's own symbol table
+            QString name = c->_ident->ident();
+            if (table.contains(name)) continue;
+
+            IdentExpr * ident = new IdentExpr(c->_ident->_ident, c->_ident->_line, c->_ident->_column);
+            table[name] = new ConAssignExpr(ident, new NumberExpr(10, c->value(), c->isFloat()));
+        }
+    }
+
+    return table;
+}
+
+// a file that cannot be read or parsed exports nothing; building it
+// reports why
+void ConstantExports::load(QString path)
+{
+    _loading.insert(path);
+    _tables[path];
+
+    QFile file(path);
+    if (file.open(QIODevice::ReadOnly))
+    {
+        QList<Diagnostic> diagnostics;
+        ObjectExpr * object = parse(path, file.readAll(), &diagnostics);
+
+        if (object != NULL)
+        {
+            _resolver->resolve(object);
+            fold(path, object);
+            delete object;
+        }
+    }
+
+    _loading.remove(path);
+}
+
+ConAssignExpr * ConstantExports::lookup(QString path, QString name)
+{
+    path = absolute(path);
+    if (!_folding.isEmpty())
+        _dependents[path].insert(_folding);
+
+    if (_loading.contains(path))
+        return NULL;
+
+    if (!_tables.contains(path))
+    {
+        if (_resolver == NULL)
+            return NULL;
+        load(path);
+    }
+
+    return _tables[path].value(name.toLower());
+}
+
+void ConstantExports::provide(QString path, ObjectExpr * object)
+{
+    path = absolute(path);
+    clear(path);
+    _tables[path] = exported(object);
+}
+
+void ConstantExports::fold(QString path, ObjectExpr * object)
+{
+    path = absolute(path);
+
+    QString outer = _folding;
+    _folding = path;
+    Folder(this).fold(object);
+    _folding = outer;
+
+    clear(path);
+    _tables[path] = exported(object);
+}
+
+void ConstantExports::forget(QString path)
+{
+    QStringList queue;
+    queue.append(absolute(path));
+
+    while (!queue.isEmpty())
+    {
+        path = queue.takeFirst();
+        if (!_tables.contains(path) && !_dependents.contains(path)) continue;
+
+        clear(path);
+        queue.append(_dependents.take(path).toList());
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "tree.h"
+#include "resolver.h"
+
+#include <QSet>
+
+/*
+ * The folded CON tables of child objects, for constants written as
+ * alias#name in the object that includes them.
+ *
+ * A Project folds every child before the objects that include it and
+ * gives each folded tree to provide(), so a table is only ever made from
+ * a tree that is already built. Without a project, as for a single file
+ * or in the language server, a table is built the first time one of its
+ * constants is asked for: the child is parsed, resolved and folded on
+ * its own, itself looking up its children's constants here, and the tree
+ * is then let go. Either way every CON line that folded is kept as a
+ * ConAssignExpr holding just its value, by the child's absolute path,
+ * until forget() is called. An object that is still being read when its
+ * own table is asked for, through a cycle of OBJ lines, gives no table.
+ *
+ * Objects folded here note which tables they read, so forgetting a table
+ * also forgets the tables folded from it, and one set of tables can be
+ * kept for as long as the files are edited.
+ */
+
+class ConstantExports
+{
+    ObjectResolver * _resolver;
+    QHash<QString, QHash<QString, ConAssignExpr *> > _tables;
+    QSet<QString> _loading;
+    QHash<QString, QSet<QString> > _dependents;
+    QString _folding;
+
+    void load(QString path);
+    void clear(QString path);
+
+public:
+    // reads children from disk as their constants are needed
+    ConstantExports(ObjectResolver & resolver);
+
+    // knows only the trees given to provide()
+    ConstantExports();
+
+    ~ConstantExports();
+
+    // the folded constants of an object, by lower-case name
+    static QHash<QString, ConAssignExpr *> exported(ObjectExpr * object);
+
+    ConAssignExpr * lookup(QString path, QString name);
+    void provide(QString path, ObjectExpr * object);
+
+    // folds an object read from path, whose table then holds its constants
+    void fold(QString path, ObjectExpr * object);
+
+    // drops the table of path and of every object that folded with it
+    void forget(QString path);
+};
@@ -0,0 +1,126 @@
+#include "folder.h"
+#include "binder.h"
+#include "symbols.h"
+
+#include <QSet>
+#include <QtConcurrent>
+
+static void foldLine(Expr *& line)
+{
+    line->fold();
+}
+
+void Folder::run(QList<Expr *> & lines)
+{
+    if (QThreadPool::globalInstance()->maxThreadCount() <= 1 || lines.size() < 2)
+    {
+        foreach (Expr * l, lines) { l->fold(); }
+        return;
+    }
+
+    QtConcurrent::blockingMap(lines, foldLine);
+}
+
+Folder::Folder(ConstantExports * exports)
+{
+    _exports = exports;
+    _imports = false;
+}
+
+void Folder::fold(ObjectExpr * object)
+{
+    SymbolTable symbols(object);
+    Binder binder(symbols, _exports);
+    binder.walk(object);
+    _imports = binder._imports;
+
+    QList<ConAssignExpr *> constants;
+    QHash<ConAssignExpr *, int> pending;
+    QHash<ConAssignExpr *, QList<ConAssignExpr *> > users;
+
+    QList<Expr *> level;
+    QList<Expr *> rest;
+
+    for (Expr * b : object->_blocks)
+    {
+        BlockExpr * block = (BlockExpr *) b;
+
+        for (Expr * l : block->_lines)
+        {
+            ConAssignExpr * c = dynamic_cast<ConAssignExpr *>(l);
+
+            if (c != NULL)
+            {
+                QSet<ConAssignExpr *> deps;
+                foreach (IdentExpr * i, binder._uses.value(c))
+                    deps.insert((ConAssignExpr *) i->_binding);
+
+                pending[c] = deps.size();
+                foreach (ConAssignExpr * d, deps)
+                    users[d].append(c);
+
+                constants.append(c);
+            }
+            else if (block->_block == ConBlock)
+            {
+                level.append(l);
+            }
+            else if (block->_block == DatBlock)
+            {
+                DatLineExpr * d = (DatLineExpr *) l;
+                for (Expr * i : d->_items)
+                    rest.append(i);
+            }
+            else
+            {
+                rest.append(l);
+            }
+        }
+    }
+
+    foreach (ConAssignExpr * c, constants)
+    {
+        if (pending[c] == 0)
+            level.append(c);
+    }
+
+    QSet<ConAssignExpr *> done;
+
+    while (!level.isEmpty())
+    {
+        run(level);
+
+        QList<Expr *> next;
+        foreach (Expr * l, level)
+        {
+            ConAssignExpr * c = dynamic_cast<ConAssignExpr *>(l);
+            if (c == NULL) continue;
+
+            done.insert(c);
+            foreach (ConAssignExpr * u, users.value(c))
+            {
+                if (--pending[u] == 0)
+                    next.append(u);
+            }
+        }
+
+        level = next;
+    }
+
+    // whatever is left is part of, or depends on, a cycle
+    foreach (ConAssignExpr * c, constants)
+    {
+        if (done.contains(c)) continue;
+
+        foreach (IdentExpr * i, binder._uses.value(c))
+        {
+            if (!done.contains((ConAssignExpr *) i->_binding))
+                i->_binding = NULL;
+        }
+
+        level.append(c);
+    }
+
+    run(level);
+    run(rest);
+}
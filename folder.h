@@ -0,0 +1,36 @@
+#pragma once
+
+#include "tree.h"
+#include "exports.h"
+
+#include <QThreadPool>
+
+/*
+ * Folds a whole object, binding identifiers to constants first.
+ *
+ * CON lines are folded level by level in dependency order: a line is
+ * only folded once every constant it refers to has been folded. The
+ * lines of one level, and then every line of the remaining blocks, are
+ * independent and are spread over the global thread pool. Constants that
+ * depend on themselves are left unbound and so never fold.
+ *
+ * Each line is folded exactly as the serial fold would, so the result
+ * does not depend on the number of threads.
+ *
+ * With exports, constants of child objects written alias#name fold to
+ * their values too; _imports then tells whether the object used any, as
+ * its folded tree depends on those children.
+ */
+
+class Folder
+{
+    ConstantExports * _exports;
+
+    void run(QList<Expr *> & lines);
+
+public:
+    bool _imports;
+
+    Folder(ConstantExports * exports = NULL);
+    void fold(ObjectExpr * object);
+};
@@ -1,6 +1,8 @@
 #include "func.h"
 #include "math.h"
 
+#include <string.h>
+
 quint32 rotateLeft(quint32 value, int shift)
 {
     if ((shift &= sizeof(value)*8 - 1) == 0)
@@ -27,3 +29,202 @@ quint32 reverse(quint32 value, int bits)
     value &= (2 << bits) - 1;
     return value;
 }
+
+int spinBinaryOp(QLatin1String op)
+{
+    if (op == "->")         return 0xe0;
+    else if (op == "<-")    return 0xe1;
+    else if (op == ">>")    return 0xe2;
+    else if (op == "<<")    return 0xe3;
+    else if (op == "&")     return 0xe8;
+    else if (op == "|")     return 0xea;
+    else if (op == "^")     return 0xeb;
+    else if (op == "+")     return 0xec;
+    else if (op == "-")     return 0xed;
+    else if (op == "~>")    return 0xee;
+    else if (op == "><")    return 0xef;
+    else if (op == "and")   return 0xf0;
+    else if (op == "or")    return 0xf2;
+    else if (op == "*")     return 0xf4;
+    else if (op == "/")     return 0xf6;
+    else if (op == "//")    return 0xf7;
+    else if (op == "<")     return 0xf9;
+    else if (op == ">")     return 0xfa;
+    else if (op == "<>")    return 0xfb;
+    else if (op == "==")    return 0xfc;
+    else if (op == "<=")    return 0xfd;
+    else if (op == ">=")    return 0xfe;
+    else return -1;
+}
+
+int spinUnaryOp(QLatin1String op)
+{
+    if (op == "-")          return 0xe6;
+    else if (op == "!")     return 0xe7;
+    else if (op == "not")   return 0xff;
+    else return -1;
+}
+
+bool isAssignmentOp(QLatin1String op)
+{
+    return op.size() > 0 && op.latin1()[op.size() - 1] == '='
+        && op != "==" && op != "<=" && op != ">=";
+}
+
+bool isUnaryMathOp(QLatin1String op, bool post)
+{
+    return !post && spinUnaryOp(op) >= 0;
+}
+
+// the math bytecodes that take one operand rather than two
+bool spinUnary(quint32 op)
+{
+    return op == 0xe6 || op == 0xe7 || op == 0xe9 || op == 0xf1
+        || op == 0xf3 || op == 0xf8 || op == 0xff;
+}
+
+/*
+ * What the Spin interpreter computes for a math bytecode, so that code
+ * folded at compile time behaves like the same code run on the chip.
+ * Returns false where the interpreter's result is not defined.
+ */
+bool spinMath(quint32 op, quint32 a, quint32 b, quint32 & r)
+{
+    qint32 sa = a;
+    qint32 sb = b;
+
+    switch (op)
+    {
+        case 0xe0: r = rotateRight(a, b); return true;
+        case 0xe1: r = rotateLeft(a, b); return true;
+        case 0xe2: r = a >> (b & 31); return true;
+        case 0xe3: r = a << (b & 31); return true;
+        case 0xe4: r = sa > sb ? a : b; return true;
+        case 0xe5: r = sa < sb ? a : b; return true;
+        case 0xe6: r = -a; return true;
+        case 0xe7: r = ~a; return true;
+        case 0xe8: r = a & b; return true;
+        case 0xe9: r = sa < 0 ? -a : a; return true;
+        case 0xea: r = a | b; return true;
+        case 0xeb: r = a ^ b; return true;
+        case 0xec: r = a + b; return true;
+        case 0xed: r = a - b; return true;
+        case 0xee: r = sa >> (b & 31); return true;
+        case 0xef:
+            // the interpreter negates the count, so 0 reverses all 32 bits
+            r = 0;
+            for (int i = 0; i < 32; i++)
+                r |= ((a >> i) & 1) << (31 - i);
+            r >>= (0u - b) & 31;
+            return true;
+        case 0xf0: r = (a && b) ? SpinTrue : 0; return true;
+        case 0xf1:
+            for (r = 32; r > 0 && !(a >> (r - 1) & 1); r--)
+                ;
+            return true;
+        case 0xf2: r = (a || b) ? SpinTrue : 0; return true;
+        case 0xf3: r = 1u << (a & 31); return true;
+        case 0xf4: r = a * b; return true;
+        case 0xf5: r = (quint64) ((qint64) sa * sb) >> 32; return true;
+        case 0xf6:
+        case 0xf7:
+            if (sb == 0 || (sa == (qint32) 0x80000000 && sb == -1)) return false;
+            r = op == 0xf6 ? sa / sb : sa % sb;
+            return true;
+        case 0xf8:
+            r = 0;
+            for (quint32 bit = 1 << 15; bit != 0; bit >>= 1)
+            {
+                if ((quint64) (r | bit) * (r | bit) <= a)
+                    r |= bit;
+            }
+            return true;
+        case 0xf9: r = sa <  sb ? SpinTrue : 0; return true;
+        case 0xfa: r = sa >  sb ? SpinTrue : 0; return true;
+        case 0xfb: r = sa != sb ? SpinTrue : 0; return true;
+        case 0xfc: r = sa == sb ? SpinTrue : 0; return true;
+        case 0xfd: r = sa <= sb ? SpinTrue : 0; return true;
+        case 0xfe: r = sa >= sb ? SpinTrue : 0; return true;
+        case 0xff: r = a ? 0 : SpinTrue; return true;
+        default:   return false;
+    }
+}
+
+float bitsToFloat(quint32 bits)
+{
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+quint32 floatToBits(float f)
+{
+    quint32 bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return bits;
+}
+
+quint32 intToFloat(qint32 value)
+{
+    return floatToBits((float) value);
+}
+
+/*
+ * TRUNC() and ROUND(): rounding is half away from zero. Returns false
+ * for NaN and for anything that does not fit in a long.
+ */
+bool floatToInt(quint32 bits, bool round, qint32 & value)
+{
+    // every float is exact as a double, and so is adding a half to one
+    // small enough to be a long
+    double d = bitsToFloat(bits);
+
+    if (round)
+        d = d < 0 ? ceil(d - 0.5) : floor(d + 0.5);
+    else
+        d = d < 0 ? ceil(d) : floor(d);
+
+    if (!(d >= -2147483648.0 && d <= 2147483647.0))
+        return false;
+
+    value = (qint32) d;
+    return true;
+}
+
+bool isFloatOp(const char * op)
+{
+    static const char * ops[] = { "+", "-", "*", "/", "==", "<>", "<", ">", "<=", ">=" };
+
+    for (unsigned i = 0; i < sizeof(ops) / sizeof(ops[0]); i++)
+    {
+        if (strcmp(op, ops[i]) == 0)
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Float arithmetic as the Spin compiler folds it: each result is rounded
+ * to single precision, to nearest even, and comparisons give Spin's true
+ * or false. Every result is stored back as a float before it is used, so
+ * a host that computes in wider registers still rounds only once.
+ */
+bool floatMath(const char * op, quint32 a, quint32 b, quint32 & r)
+{
+    float x = bitsToFloat(a);
+    float y = bitsToFloat(b);
+
+    if      (strcmp(op, "+") == 0)  r = floatToBits(x + y);
+    else if (strcmp(op, "-") == 0)  r = floatToBits(x - y);
+    else if (strcmp(op, "*") == 0)  r = floatToBits(x * y);
+    else if (strcmp(op, "/") == 0)  r = floatToBits(x / y);
+    else if (strcmp(op, "==") == 0) r = x == y ? SpinTrue : 0;
+    else if (strcmp(op, "<>") == 0) r = x != y ? SpinTrue : 0;
+    else if (strcmp(op, "<") == 0)  r = x <  y ? SpinTrue : 0;
+    else if (strcmp(op, ">") == 0)  r = x >  y ? SpinTrue : 0;
+    else if (strcmp(op, "<=") == 0) r = x <= y ? SpinTrue : 0;
+    else if (strcmp(op, ">=") == 0) r = x >= y ? SpinTrue : 0;
+    else return false;
+
+    return true;
+}
@@ -1,7 +1,31 @@
 #pragma once
 
 #include <QtGlobal>
+#include <QLatin1String>
 
 quint32 rotateLeft(quint32 value, int shift);
 quint32 rotateRight(quint32 value, int shift);
 quint32 reverse(quint32 value, int bits);
+
+// the math bytecode for an operator as written, or -1 if there is none
+int spinBinaryOp(QLatin1String op);
+int spinUnaryOp(QLatin1String op);
+bool isAssignmentOp(QLatin1String op);
+
+// a unary operator that only computes a value, rather than updating its
+// operand in place
+bool isUnaryMathOp(QLatin1String op, bool post);
+
+// Spin's TRUE, which every comparison gives, on longs and floats alike
+const quint32 SpinTrue = 0xffffffff;
+
+bool spinUnary(quint32 op);
+bool spinMath(quint32 op, quint32 a, quint32 b, quint32 & result);
+
+// single-precision floats are passed around as their IEEE-754 bits
+quint32 floatToBits(float f);
+float bitsToFloat(quint32 bits);
+quint32 intToFloat(qint32 value);
+bool floatToInt(quint32 bits, bool round, qint32 & value);
+bool isFloatOp(const char * op);
+bool floatMath(const char * op, quint32 a, quint32 b, quint32 & result);
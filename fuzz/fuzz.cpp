@@ -0,0 +1,451 @@
+#include "tree.h"
+#include "parse.h"
+#include "resolver.h"
+#include "folder.h"
+#include "assembler.h"
+#include "emitter.h"
+#include "simulator.h"
+#include "generator.h"
+
+#include <QDir>
+#include <QFile>
+#include <QMap>
+#include <math.h>
+#include <signal.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+/*
+ * Runs Spin sources through the same passes as a build, to find inputs
+ * that crash them or that cost more than they should.
+ *
+ * Built with CONFIG+=libfuzzer this is a libFuzzer target and nothing
+ * else. Otherwise it is a driver of its own: for each shape and seed it
+ * generates a series of sources, doubling the size each time, and runs
+ * every one in a child process so that a crash or a hang is caught and
+ * the child's CPU time and peak memory can be read back. When the cost of
+ * the last doubling grows by more than Superlinear, the largest source is
+ * saved to the output directory; crashes and timeouts are saved too.
+ * --replay runs such a directory again and fails if any of them still
+ * crashes or runs past -timeout, to check that they stay fixed, along
+ * with a few cases that are generated rather than saved because of their
+ * size, such as a chain of a million operators.
+ *
+ * --operators checks constant folding against the simulated interpreter:
+ * every math operator is folded and also run on variables holding the
+ * same operands, and the two results must agree. Float comparisons must
+ * fold to the same TRUE and FALSE as comparisons of the same whole
+ * numbers as longs, and a float operand must not build with any unary
+ * operator but negation.
+ */
+
+static bool build(const QByteArray & text)
+{
+    QList<Diagnostic> errors;
+    ObjectExpr * root = parse("fuzz.spin", text, &errors);
+    if (root == NULL)
+        return false;
+
+    ObjectResolver resolver;
+    bool ok = resolver.resolve(root);
+    if (ok)
+    {
+        Folder().fold(root);
+        ok = Assembler().assemble(root) && Emitter().compile(root);
+    }
+
+    delete root;
+    return ok;
+}
+
+#ifdef FUZZ_LIBFUZZER
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t * data, size_t size)
+{
+    build(QByteArray((const char *) data, size));
+    return 0;
+}
+
+#else
+
+// the exponent of the last doubling above which a series is reported
+static const double Superlinear = 1.5;
+
+// below these a series is too fast or too small to measure
+static const double TimeFloor = 20;        // ms
+static const double MemoryFloor = 4096;    // KiB
+
+struct Cost
+{
+    int status;     // 0, or the signal that ended the run
+    double time;    // CPU ms
+    double memory;  // peak resident KiB
+};
+
+static int timeout = 10;
+
+static Cost run(const QByteArray & text)
+{
+    Cost cost;
+    cost.status = 0;
+    cost.time = cost.memory = 0;
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        // the passes report errors as they go, which is only noise here
+        freopen("/dev/null", "w", stdout);
+        freopen("/dev/null", "w", stderr);
+        alarm(timeout);
+        build(text);
+        _exit(0);
+    }
+
+    int status = 0;
+    struct rusage usage;
+    if (pid < 0 || wait4(pid, &status, 0, &usage) < 0)
+    {
+        cost.status = -1;
+        return cost;
+    }
+
+    if (WIFSIGNALED(status))
+        cost.status = WTERMSIG(status);
+
+    cost.time = usage.ru_utime.tv_sec * 1e3 + usage.ru_utime.tv_usec / 1e3
+              + usage.ru_stime.tv_sec * 1e3 + usage.ru_stime.tv_usec / 1e3;
+    cost.memory = usage.ru_maxrss;
+    return cost;
+}
+
+static const char * describe(int status)
+{
+    switch (status)
+    {
+        case 0:         return "ok";
+        case SIGALRM:   return "timed out";
+        case -1:        return "could not run";
+        default:        return "crashed";
+    }
+}
+
+static void save(QString dir, QString name, const QByteArray & text)
+{
+    QDir().mkpath(dir);
+
+    QFile file(dir + "/" + name + ".spin");
+    if (file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+        file.write(text);
+    printf("    saved %s\n", qPrintable(file.fileName()));
+}
+
+// how many doublings the cost took for one doubling of the input
+static double exponent(double before, double after, double grown)
+{
+    if (before <= 0 || after <= 0 || grown <= 1)
+        return 0;
+    return log(after / before) / log(grown);
+}
+
+static bool series(Generator::Shape shape, quint32 seed, int steps, QString dir, double baseline)
+{
+    Generator generator(seed);
+    QString name = QString("%1-%2").arg(Generator::name(shape)).arg(seed);
+    int size = Generator::base(shape);
+
+    Cost previous;
+    previous.status = -1;
+    int previousSize = 0;
+    int previousBytes = 0;
+
+    for (int i = 0; i < steps; i++, size *= 2)
+    {
+        QByteArray text = generator.generate(shape, size);
+        Cost cost = run(text);
+        double memory = qMax(cost.memory - baseline, 0.0);
+
+        printf("  %-16s %8i %10i bytes %10.1f ms %10.0f KiB  %s\n", qPrintable(name), size,
+               text.size(), cost.time, memory, describe(cost.status));
+
+        if (cost.status != 0)
+        {
+            save(dir, QString("%1-%2").arg(name).arg(size), text);
+            return false;
+        }
+
+        if (previous.status == 0)
+        {
+            // the input is bigger by whichever of the two grew more
+            double grown = qMax((double) size / previousSize, (double) text.size() / previousBytes);
+            double previousMemory = qMax(previous.memory - baseline, 0.0);
+
+            double t = cost.time >= TimeFloor ? exponent(previous.time, cost.time, grown) : 0;
+            double m = memory >= MemoryFloor ? exponent(previousMemory, memory, grown) : 0;
+
+            if (t > Superlinear || m > Superlinear)
+            {
+                printf("    superlinear: time grows as size^%.2f, memory as size^%.2f\n", t, m);
+                save(dir, name, text);
+                return false;
+            }
+        }
+
+        previous = cost;
+        previousSize = size;
+        previousBytes = text.size();
+    }
+
+    return true;
+}
+
+// cases too big to keep under cases/, written out here instead
+static QMap<QString, QByteArray> regressions()
+{
+    QMap<QString, QByteArray> cases;
+
+    // folding and freeing a tree once took a call per level
+    QByteArray chain = "CON\n    deep = 1";
+    for (int i = 0; i < 1000000; i++)
+        chain += i % 2 ? " + 3" : " - 2";
+    cases["deep-chain"] = chain + "\n";
+
+    return cases;
+}
+
+static int replay(QString dir)
+{
+    int failed = 0;
+    QDir cases(dir);
+    double baseline = run(QByteArray()).memory;
+
+    QMap<QString, QByteArray> texts = regressions();
+    foreach (QString file, cases.entryList(QStringList() << "*.spin", QDir::Files))
+    {
+        QFile f(cases.filePath(file));
+        if (f.open(QIODevice::ReadOnly))
+            texts[file] = f.readAll();
+    }
+
+    foreach (QString name, texts.keys())
+    {
+        QByteArray text = texts[name];
+        Cost cost = run(text);
+        printf("  %-30s %10i bytes %10.1f ms %10.0f KiB  %s\n", qPrintable(name),
+               text.size(), cost.time, qMax(cost.memory - baseline, 0.0), describe(cost.status));
+
+        if (cost.status != 0)
+            failed++;
+    }
+
+    printf("%i failed\n", failed);
+    return failed > 0 ? 1 : 0;
+}
+
+template <class T, int N>
+static int count(T (&)[N])
+{
+    return N;
+}
+
+// builds the source and runs its first method in the simulator
+static bool evaluate(const QByteArray & text, quint32 & result)
+{
+    QList<Diagnostic> errors;
+    ObjectExpr * root = parse("operators.spin", text, &errors);
+    if (root == NULL)
+        return false;
+
+    Folder().fold(root);
+
+    Emitter emitter;
+    Simulator simulator;
+    bool ok = emitter.compile(root)
+           && simulator.spin(emitter, emitter._methods.first().index, 1000000)
+           && simulator._finished;
+
+    result = simulator._result;
+    delete root;
+    return ok;
+}
+
+static int operators()
+{
+    static const char * binary[] = {
+        "+", "-", "*", "/", "//", "<<", ">>", "~>", "<-", "->", "><",
+        "&", "|", "^", "==", "<>", "<", ">", "<=", ">=", "and", "or"
+    };
+    static const char * unary[] = { "-", "!", "not " };
+    static const quint32 values[] = {
+        0, 1, 2, 7, 31, 32, 33, 0x12345678, 0x7fffffff, 0x80000000, 0xfffffff9, 0xffffffff
+    };
+
+    // the divisions by zero are reported as they should be, which is only noise here
+    freopen("/dev/null", "w", stderr);
+
+    int failed = 0;
+    int checked = 0;
+    for (int o = 0; o < count(binary) + count(unary); o++)
+    {
+        bool isUnary = o >= count(binary);
+        QByteArray op = isUnary ? unary[o - count(binary)] : binary[o];
+
+        for (int i = 0; i < count(values); i++)
+        {
+            for (int j = 0; j < (isUnary ? 1 : count(values)); j++)
+            {
+                QByteArray a = "$" + QByteArray::number(values[i], 16);
+                QByteArray b = "$" + QByteArray::number(values[j], 16);
+                QByteArray expr = isUnary ? op + a : a + " " + op + " " + b;
+                QByteArray run = isUnary ? op + "a" : "a " + op + " b";
+
+                quint32 folded = 0, simulated = 0;
+                bool foldedOk = evaluate("PUB main\n  return " + expr + "\n", folded);
+                bool simulatedOk = evaluate("VAR\n    long a\n    long b\nPUB main\n  a := " + a
+                                            + "\n  b := " + b + "\n  return " + run + "\n", simulated);
+
+                // a division the interpreter has no value for must not build
+                quint32 r;
+                QByteArray name = op.trimmed();
+                int code = isUnary ? spinUnaryOp(QLatin1String(name.constData()))
+                                   : spinBinaryOp(QLatin1String(name.constData()));
+                bool defined = spinMath(code, values[i], values[j], r);
+
+                checked++;
+                if (foldedOk == defined && (!defined || (simulatedOk && folded == simulated)))
+                    continue;
+
+                printf("  %-28s folded %s, simulated %s\n", expr.constData(),
+                       foldedOk ? qPrintable(QString::number(folded, 16)) : "no value",
+                       simulatedOk ? qPrintable(QString::number(simulated, 16)) : "no value");
+                failed++;
+            }
+        }
+    }
+
+    // comparing floats gives the same TRUE and FALSE as comparing longs
+    static const int whole[] = { -3, -1, 0, 1, 2, 7 };
+    for (int o = 14; o < 20; o++)
+    {
+        for (int i = 0; i < count(whole); i++)
+        {
+            for (int j = 0; j < count(whole); j++)
+            {
+                QByteArray a = QByteArray::number(whole[i]);
+                QByteArray b = QByteArray::number(whole[j]);
+                QByteArray expr = a + ".0 " + binary[o] + " " + b + ".0";
+
+                quint32 asFloats = 0, asLongs = 0;
+                bool floatsOk = evaluate("PUB main\n  return " + expr + "\n", asFloats);
+                bool longsOk = evaluate("PUB main\n  return " + a + " " + binary[o] + " " + b + "\n", asLongs);
+
+                checked++;
+                if (floatsOk && longsOk && asFloats == asLongs)
+                    continue;
+
+                printf("  %-28s folded %s, as longs %s\n", expr.constData(),
+                       floatsOk ? qPrintable(QString::number(asFloats, 16)) : "no value",
+                       longsOk ? qPrintable(QString::number(asLongs, 16)) : "no value");
+                failed++;
+            }
+        }
+    }
+
+    // a float can only be negated
+    for (int o = 0; o < count(unary); o++)
+    {
+        QByteArray expr = QByteArray(unary[o]) + "1.5";
+        bool negation = QByteArray(unary[o]) == "-";
+
+        quint32 folded = 0;
+        bool built = evaluate("PUB main\n  return " + expr + "\n", folded);
+
+        checked++;
+        if (built == negation && (!built || folded == floatToBits(-1.5)))
+            continue;
+
+        printf("  %-28s %s\n", expr.constData(), built ? "built" : "did not build");
+        failed++;
+    }
+
+    printf("%i of %i operator checks failed\n", failed, checked);
+    return failed > 0 ? 1 : 0;
+}
+
+static int corpus(QString dir, int seeds)
+{
+    for (quint32 seed = 1; seed <= (quint32) seeds; seed++)
+    {
+        Generator generator(seed);
+        for (int s = 0; s < Generator::Shapes; s++)
+        {
+            Generator::Shape shape = (Generator::Shape) s;
+            save(dir, QString("%1-%2").arg(Generator::name(shape)).arg(seed),
+                 generator.generate(shape, Generator::base(shape)));
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char ** argv)
+{
+    QString dir = "cases";
+    int seeds = 4;
+    int steps = 6;
+    QString shapeName;
+
+    ++argv, --argc;  /* skip over program name */
+    while ( argc > 0 && argv[0][0] == '-' )
+    {
+        QString option = argv[0];
+
+        if ( option == "-o" && argc > 1 )
+            dir = argv[1];
+        else if ( option == "-seeds" && argc > 1 )
+            seeds = QString(argv[1]).toInt();
+        else if ( option == "-steps" && argc > 1 )
+            steps = QString(argv[1]).toInt();
+        else if ( option == "-timeout" && argc > 1 )
+            timeout = QString(argv[1]).toInt();
+        else if ( option == "-shape" && argc > 1 )
+            shapeName = argv[1];
+        else if ( option == "--replay" && argc > 1 )
+            return replay(argv[1]);
+        else if ( option == "--corpus" && argc > 1 )
+            return corpus(argv[1], seeds);
+        else if ( option == "--operators" )
+            return operators();
+        else
+        {
+            fprintf(stderr, "usage: fuzz [-o dir] [-seeds n] [-steps n] [-timeout s] [-shape name]"
+                            " [--replay dir | --corpus dir | --operators]\n");
+            return -1;
+        }
+
+        argv += 2, argc -= 2;
+    }
+
+    // what a child costs before it does anything
+    double baseline = run(QByteArray()).memory;
+
+    int flagged = 0;
+    for (int s = 0; s < Generator::Shapes; s++)
+    {
+        Generator::Shape shape = (Generator::Shape) s;
+        if (!shapeName.isEmpty() && shapeName != Generator::name(shape))
+            continue;
+
+        for (quint32 seed = 1; seed <= (quint32) seeds; seed++)
+        {
+            if (!series(shape, seed, steps, dir, baseline))
+                flagged++;
+        }
+    }
+
+    printf("%i series flagged\n", flagged);
+    return flagged > 0 ? 1 : 0;
+}
+
+#endif
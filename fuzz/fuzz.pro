@@ -0,0 +1,41 @@
+include(../bison.pri)
+include(../flex.pri)
+
+LIBS += -lfl -ly
+
+QT += concurrent
+
+TEMPLATE = app
+TARGET = fuzz
+INCLUDEPATH += . ..
+CONFIG += c++11
+
+# qmake CONFIG+=libfuzzer builds a libFuzzer target instead of the driver
+libfuzzer {
+    DEFINES += FUZZ_LIBFUZZER
+    QMAKE_CXXFLAGS += -fsanitize=fuzzer,address
+    QMAKE_LFLAGS += -fsanitize=fuzzer,address
+}
+
+SOURCES += \
+    ../tree.cpp \
+    ../func.cpp \
+    ../resolver.cpp \
+    ../folder.cpp \
+    ../exports.cpp \
+    ../pasm.cpp \
+    ../assembler.cpp \
+    ../emitter.cpp \
+    ../simulator.cpp \
+    ../varlayout.cpp \
+    ../pool.cpp \
+    ../parse.cpp \
+    ../profile.cpp \
+    generator.cpp \
+    fuzz.cpp \
+
+HEADERS += \
+    generator.h \
+
+FLEXSOURCES += ../lexer.l
+BISONSOURCES += ../parser.y
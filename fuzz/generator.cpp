@@ -0,0 +1,299 @@
+#include "generator.h"
+
+// the operators of the expr rule in parser.y, assignments aside
+static const char * binaryOps[] = {
+    "+", "-", "*", "/", "//",
+    "<<", ">>", "~>", "<-", "->", "><",
+    "&", "|", "^",
+    "==", "<>", "<", ">", "<=", ">=",
+    "and", "or"
+};
+
+static const char * unaryOps[] = { "-", "!", "not " };
+
+static const char * assignOps[] = { "=", "+=", "-=", "*=", "&=", "|=", "^=", "<<=", ">>=" };
+
+static const char * updateOps[] = { "++", "--", "~", "~~" };
+
+static const char * asmOps[] = { "add", "sub", "and", "or", "xor", "shl", "shr", "mov" };
+
+template <class T, int N>
+static int count(T (&)[N])
+{
+    return N;
+}
+
+Generator::Generator(quint32 seed)
+    : _seed(seed)
+{
+}
+
+// xorshift32, which is plenty for picking productions
+quint32 Generator::next()
+{
+    _state ^= _state << 13;
+    _state ^= _state >> 17;
+    _state ^= _state << 5;
+    return _state;
+}
+
+int Generator::below(int n)
+{
+    return n > 0 ? next() % n : 0;
+}
+
+bool Generator::chance(int percent)
+{
+    return below(100) < percent;
+}
+
+const char * Generator::name(Shape shape)
+{
+    switch (shape)
+    {
+        case Mixed:     return "mixed";
+        case Parens:    return "parens";
+        case Chain:     return "chain";
+        case Constants: return "constants";
+        case Nesting:   return "nesting";
+        case Counts:    return "counts";
+    }
+    return "";
+}
+
+int Generator::base(Shape shape)
+{
+    switch (shape)
+    {
+        case Mixed:     return 64;
+        case Parens:    return 128;
+        case Chain:     return 256;
+        case Constants: return 128;
+        case Nesting:   return 16;
+        case Counts:    return 4096;
+    }
+    return 64;
+}
+
+QByteArray Generator::number()
+{
+    quint32 v = below(4) == 0 ? next() : below(1000);
+
+    switch (below(5))
+    {
+        case 0:     return "$" + QByteArray::number(v, 16);
+        case 1:     return "%" + QByteArray::number(v & 0xff, 2);
+        case 2:     return "%%" + QByteArray::number(v & 0xff, 4);
+        default:    return QByteArray::number(v);
+    }
+}
+
+// a number, or a name that is in scope
+QByteArray Generator::operand()
+{
+    int pick = below(4);
+    if (pick == 1 && !_constants.isEmpty())
+        return _constants[below(_constants.size())].toUtf8();
+    if (pick == 2 && !_vars.isEmpty())
+        return _vars[below(_vars.size())].toUtf8();
+    return number();
+}
+
+QByteArray Generator::expression(int depth)
+{
+    if (depth <= 0 || chance(30))
+        return operand();
+
+    switch (below(8))
+    {
+        case 0:
+            return unaryOps[below(count(unaryOps))] + expression(depth - 1);
+        case 1:
+            return "(" + expression(depth - 1) + ")";
+        case 2:
+        {
+            static const char * intrinsics[] = { "abs", "sqrt" };
+            if (chance(50))
+                return QByteArray(intrinsics[below(2)]) + "(" + expression(depth - 1) + ")";
+            return QByteArray(chance(50) ? "min" : "max") + "(" + expression(depth - 1)
+                   + ", " + expression(depth - 1) + ")";
+        }
+        default:
+            return expression(depth - 1) + " " + binaryOps[below(count(binaryOps))]
+                   + " " + expression(depth - 1);
+    }
+}
+
+void Generator::statements(int count, int indent, int depth)
+{
+    QByteArray pad(indent, ' ');
+
+    for (int i = 0; i < count; i++)
+    {
+        int pick = below(10);
+
+        if (pick < 4 && !_vars.isEmpty())
+        {
+            _out += pad + _vars[below(_vars.size())].toUtf8() + " "
+                  + assignOps[below(::count(assignOps))] + " " + expression(3) + "\n";
+        }
+        else if (pick == 4 && !_vars.isEmpty())
+        {
+            _out += pad + _vars[below(_vars.size())].toUtf8() + updateOps[below(::count(updateOps))] + "\n";
+        }
+        else if (pick == 5 && depth > 0)
+        {
+            _out += pad + "if " + expression(2) + "\n";
+            statements(1 + below(3), indent + 2, depth - 1);
+            if (chance(40))
+            {
+                _out += pad + "else\n";
+                statements(1 + below(2), indent + 2, depth - 1);
+            }
+        }
+        else if (pick == 6 && depth > 0)
+        {
+            switch (below(3))
+            {
+                case 0:     _out += pad + "repeat " + QByteArray::number(below(8)) + "\n"; break;
+                case 1:     _out += pad + "repeat while " + expression(2) + "\n"; break;
+                default:    _out += pad + "repeat until " + expression(2) + "\n"; break;
+            }
+            statements(1 + below(3), indent + 2, depth - 1);
+        }
+        else if (pick == 7 && !_methods.isEmpty())
+        {
+            _out += pad + _methods[below(_methods.size())].toUtf8() + "(" + expression(2) + ")\n";
+        }
+        else
+        {
+            _out += pad + "return " + expression(3) + "\n";
+        }
+    }
+}
+
+void Generator::mixed(int size)
+{
+    int lines = size / 8 + 1;
+
+    _out += "CON\n";
+    for (int i = 0; i < lines; i++)
+    {
+        QString name = QString("c%1").arg(i);
+        _out += "    " + name.toUtf8() + " = " + expression(3) + "\n";
+        _constants.append(name);
+    }
+
+    // the names first, so that statements can use all of them
+    for (int i = 0; i < lines; i++)
+        _vars.append(QString("v%1").arg(i));
+    for (int i = 0; i < size / 16 + 1; i++)
+        _methods.append(QString("m%1").arg(i));
+
+    static const char * types[] = { "byte", "word", "long" };
+
+    _out += "VAR\n";
+    foreach (QString v, _vars)
+    {
+        _out += QByteArray("    ") + types[below(3)] + " " + v.toUtf8();
+        if (chance(20))
+            _out += "[" + QByteArray::number(1 + below(16)) + "]";
+        _out += "\n";
+    }
+
+    _out += "DAT\n";
+    for (int i = 0; i < lines; i++)
+    {
+        _out += "t" + QByteArray::number(i) + " " + types[below(3)] + " " + number();
+        for (int j = below(4); j > 0; j--)
+            _out += ", " + QByteArray(chance(30) ? types[below(3)] : "") + " " + number();
+        _out += "\n";
+    }
+
+    _out += "PUB main\n";
+    statements(4, 2, 3);
+
+    foreach (QString m, _methods)
+    {
+        _out += "PRI " + m.toUtf8() + "(x) | y\n";
+        statements(size / _methods.size() / 2 + 1, 2, 3);
+    }
+
+    if (chance(50))
+    {
+        _out += "ASM\n";
+        for (int i = 0; i < lines; i++)
+        {
+            _out += "a" + QByteArray::number(i) + "      " + asmOps[below(count(asmOps))]
+                  + " r, #" + QByteArray::number(below(512)) + "\n";
+        }
+        _out += "r       long 0\n";
+    }
+}
+
+void Generator::parens(int size)
+{
+    _out += "CON\n    deep = " + QByteArray(size, '(') + "1" + QByteArray(size, ')') + "\n";
+    _out += "VAR\n    long x\n";
+    _out += "PUB main\n  return " + QByteArray(size, '(') + "x" + QByteArray(size, ')') + "\n";
+}
+
+void Generator::chain(int size)
+{
+    _out += "CON\n    folded = 1";
+    for (int i = 0; i < size; i++)
+        _out += QByteArray(" ") + binaryOps[below(5)] + " " + QByteArray::number(1 + below(9));
+
+    // with a variable in front nothing folds, and every level asks again
+    _out += "\nVAR\n    long x\nPUB main\n  return x";
+    for (int i = 0; i < size; i++)
+        _out += QByteArray(" ") + binaryOps[below(3)] + " " + QByteArray::number(1 + below(9));
+    _out += "\n";
+}
+
+void Generator::constants(int size)
+{
+    // each constant needs the one after it, so they fold in reverse
+    _out += "CON\n";
+    for (int i = 0; i < size; i++)
+        _out += "    k" + QByteArray::number(i) + " = k" + QByteArray::number(i + 1) + " + 1\n";
+    _out += "    k" + QByteArray::number(size) + " = 1\n";
+    _out += "PUB main\n  return k0\n";
+}
+
+void Generator::nesting(int size)
+{
+    _out += "VAR\n    long x\nPUB main\n";
+    for (int i = 0; i < size; i++)
+        _out += QByteArray(2 * (i + 1), ' ') + (i % 2 ? "repeat while x\n" : "if x\n");
+    _out += QByteArray(2 * (size + 1), ' ') + "x++\n";
+    _out += "  return x\n";
+}
+
+void Generator::counts(int size)
+{
+    _out += "VAR\n    long table[" + QByteArray::number(size) + "]\n";
+    _out += "DAT\nfill long 7[" + QByteArray::number(size) + "]\n";
+    _out += "PUB main\n  repeat " + QByteArray::number(size) + "\n    table[3] += fill\n  return table[3]\n";
+}
+
+QByteArray Generator::generate(Shape shape, int size)
+{
+    _state = (_seed * 2654435761u) | 1;
+    _out.clear();
+    _constants.clear();
+    _vars.clear();
+    _methods.clear();
+
+    switch (shape)
+    {
+        case Mixed:     mixed(size); break;
+        case Parens:    parens(size); break;
+        case Chain:     chain(size); break;
+        case Constants: constants(size); break;
+        case Nesting:   nesting(size); break;
+        case Counts:    counts(size); break;
+    }
+
+    return _out;
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <QByteArray>
+#include <QStringList>
+
+/*
+ * Writes Spin sources for the fuzzer, following the productions of
+ * parser.y so that most of what it writes gets past the parser and
+ * exercises the passes behind it.
+ *
+ * Mixed is a random object of every kind of block. The other shapes each
+ * stretch one construct that has been slow before, with size setting how
+ * far: nested parentheses, long operator chains, constants that depend on
+ * one another, nested statement blocks, and large repeat counts in VAR
+ * and DAT. Everything comes from the seed, so a seed and a size always
+ * give the same source.
+ */
+
+class Generator
+{
+    quint32 _seed;
+    quint32 _state;
+    QByteArray _out;
+    QStringList _constants;
+    QStringList _vars;
+    QStringList _methods;
+
+    quint32 next();
+    int below(int n);
+    bool chance(int percent);
+
+    QByteArray number();
+    QByteArray operand();
+    QByteArray expression(int depth);
+    void statements(int count, int indent, int depth);
+
+    void mixed(int size);
+    void parens(int size);
+    void chain(int size);
+    void constants(int size);
+    void nesting(int size);
+    void counts(int size);
+
+public:
+    enum Shape {
+        Mixed,
+        Parens,
+        Chain,
+        Constants,
+        Nesting,
+        Counts
+    };
+
+    static const int Shapes = Counts + 1;
+    static const char * name(Shape shape);
+
+    // the size to start a series at, chosen so that it runs in well under a millisecond
+    static int base(Shape shape);
+
+    Generator(quint32 seed);
+    QByteArray generate(Shape shape, int size);
+};
@@ -0,0 +1,532 @@
+#include "inliner.h"
+#include "walker.h"
+
+#include <QVector>
+
+static QSet<QString> localsOf(MethodExpr * method)
+{
+    QSet<QString> locals;
+    locals.insert(method->_result != NULL ? method->_result->ident() : QString("result"));
+    for (Expr * p : method->_params)
+        locals.insert(((IdentExpr *) p)->ident());
+    for (Expr * l : method->_locals)
+        locals.insert(((IdentExpr *) l)->ident());
+    return locals;
+}
+
+/*
+ * Checks that an expression only computes a value: no assignments,
+ * updates or method calls, and no names but the given locals and the
+ * object's variables. In a candidate's body the locals are the ones it
+ * may not read, and its parameters are counted instead.
+ */
+class ReadCheck : public Walker<ReadCheck>
+{
+    const QSet<QString> & _variables;
+    const QSet<QString> & _locals;
+    bool _localsAllowed;
+    const QHash<QString, int> * _params;
+    IdentExpr * _callName;
+
+public:
+    bool _ok;
+    int _size;
+    QList<int> _uses;
+    QSet<QString> _reads;
+
+    ReadCheck(const QSet<QString> & variables, const QSet<QString> & locals,
+              bool localsAllowed, const QHash<QString, int> * params = NULL)
+        : _variables(variables)
+        , _locals(locals)
+        , _localsAllowed(localsAllowed)
+        , _params(params)
+    {
+        _callName = NULL;
+        _ok = true;
+        _size = 0;
+        if (_params != NULL)
+        {
+            for (int i = 0; i < _params->size(); i++)
+                _uses.append(0);
+        }
+    }
+
+    void visit(NumberExpr &)    { _size++; }
+    void visit(StringExpr &)    { _size++; }
+    void visit(WrapExpr &)      { _size++; }
+
+    void visit(IdentExpr & expr)
+    {
+        _size++;
+        if (&expr == _callName) return;
+
+        QString name = expr.ident();
+        if (!expr._object.isEmpty())
+            _ok = false;
+        else if (_params != NULL && _params->contains(name))
+            _uses[_params->value(name)]++;
+        else if (_locals.contains(name))
+            _ok = _ok && _localsAllowed;
+        else if (_variables.contains(name))
+            _reads.insert(name);
+        else
+            _ok = false;
+    }
+
+    // the variable itself is never replaced, so it cannot be a parameter
+    void visit(AddressExpr & expr)
+    {
+        _size++;
+        if (_params != NULL && _params->contains(expr._ident->ident()))
+            _ok = false;
+    }
+
+    void visit(UnaryExpr & expr)
+    {
+        _size++;
+        if (!isUnaryMathOp(expr._op, expr._post))
+            _ok = false;
+    }
+
+    void visit(BinaryExpr & expr)
+    {
+        _size++;
+        if (isAssignmentOp(expr._op))
+            _ok = false;
+    }
+
+    void visit(CallExpr & expr)
+    {
+        _size++;
+        if (expr.intrinsic() < 0 && !expr.isConversion())
+            _ok = false;
+        _callName = expr._name;
+    }
+
+    // statements, and anything else that does not belong in a method
+    template <class T>
+    void visit(T &)
+    {
+        _ok = false;
+    }
+};
+
+// the value a call returns, if its body is nothing but that
+static Expr * valueOf(MethodExpr * method)
+{
+    if (method->_body.size() != 1)
+        return NULL;
+
+    Expr * s = method->_body[0];
+
+    if (ReturnExpr * r = dynamic_cast<ReturnExpr *>(s))
+        return r->_value;
+
+    if (BinaryExpr * b = dynamic_cast<BinaryExpr *>(s))
+    {
+        IdentExpr * target = dynamic_cast<IdentExpr *>(b->_left);
+        QString result = method->_result != NULL ? method->_result->ident() : QString("result");
+
+        if (b->_op == "=" && target != NULL && target->_object.isEmpty() && target->ident() == result)
+            return b->_right;
+    }
+
+    return NULL;
+}
+
+/*
+ * A copy of a candidate's expression for one call. Each parameter becomes
+ * its argument: the first use takes the argument itself, later ones a
+ * copy, and taken is set for the arguments the call must let go of.
+ */
+static Expr * copy(Expr * expr, const QHash<QString, int> & params, ExprList & args, QVector<bool> & taken)
+{
+    switch (expr->_kind)
+    {
+        case NumberKind:
+        {
+            NumberExpr * e = (NumberExpr *) expr;
+            return new NumberExpr(e->_base, e->num, e->_float);
+        }
+
+        case StringKind:
+            return new StringExpr(((StringExpr *) expr)->_string);
+
+        case IdentKind:
+        {
+            IdentExpr * e = (IdentExpr *) expr;
+            if (params.contains(e->ident()))
+            {
+                int p = params.value(e->ident());
+                if (!taken[p])
+                {
+                    taken[p] = true;
+                    return args[p];
+                }
+                return copy(args[p], QHash<QString, int>(), args, taken);
+            }
+
+            IdentExpr * ident = new IdentExpr(e->_ident, e->_line, e->_column);
+            ident->_binding = e->_binding;
+            ident->_object = e->_object;
+            return ident;
+        }
+
+        case AddressKind:
+        {
+            AddressExpr * e = (AddressExpr *) expr;
+            IdentExpr * ident = new IdentExpr(e->_ident->_ident, e->_ident->_line, e->_ident->_column);
+            return new AddressExpr(ident, copy(e->_offset, params, args, taken));
+        }
+
+        case WrapKind:
+        {
+            WrapExpr * e = (WrapExpr *) expr;
+            return new WrapExpr(e->_left.latin1(), copy(e->_val, params, args, taken), e->_right.latin1());
+        }
+
+        case UnaryKind:
+        {
+            UnaryExpr * e = (UnaryExpr *) expr;
+            return new UnaryExpr(e->_op.latin1(), copy(e->_val, params, args, taken));
+        }
+
+        case BinaryKind:
+        {
+            BinaryExpr * e = (BinaryExpr *) expr;
+            Expr * left = copy(e->_left, params, args, taken);
+            return new BinaryExpr(left, e->_op.latin1(), copy(e->_right, params, args, taken));
+        }
+
+        case CallKind:
+        {
+            CallExpr * e = (CallExpr *) expr;
+            ExprList * list = new ExprList();
+            for (Expr * a : e->_args)
+                list->append(copy(a, params, args, taken));
+            return new CallExpr(copy(e->_name, QHash<QString, int>(), args, taken), list);
+        }
+
+        default:
+            return NULL;
+    }
+}
+
+// the names that calls in a method body use: called methods, and
+// methods named on their own
+class CallCollector : public Walker<CallCollector>
+{
+public:
+    using Walker<CallCollector>::visit;
+
+    QSet<QString> _names;
+
+    void visit(IdentExpr & expr)
+    {
+        if (expr._object.isEmpty())
+            _names.insert(expr.ident());
+    }
+};
+
+Inliner::Inliner(int budget)
+{
+    _budget = budget;
+}
+
+bool Inliner::candidate(MethodExpr * method, Candidate & c)
+{
+    if (method->_block != PriBlock || _methods.value(method->_name->ident()) != method)
+        return false;
+
+    c.method = method;
+    c.body = valueOf(method);
+    if (c.body == NULL)
+        return false;
+
+    c.params.clear();
+    for (int i = 0; i < method->_params.size(); i++)
+        c.params[((IdentExpr *) method->_params[i])->ident()] = i;
+
+    // the body may not read the result or a local, which it never set
+    QSet<QString> locals = localsOf(method);
+    ReadCheck check(_variables, locals, false, &c.params);
+    check.walk(c.body);
+
+    c.uses = check._uses;
+    c.reads = check._reads;
+    c.size = check._size;
+    return check._ok && c.size <= _budget;
+}
+
+bool Inliner::pure(Expr * expr, const QSet<QString> & locals, int & size)
+{
+    ReadCheck check(_variables, locals, true);
+    check.walk(expr);
+    size = check._size;
+    return check._ok;
+}
+
+// the expression that replaces a call with these arguments, or NULL
+Expr * Inliner::substitute(const Candidate & c, ExprList & args, const QSet<QString> & locals)
+{
+    if (args.size() != c.params.size())
+        return NULL;
+
+    // a local of the caller would hide the variable the callee reads
+    foreach (QString name, c.reads)
+    {
+        if (locals.contains(name))
+            return NULL;
+    }
+
+    int size = c.size;
+    for (int i = 0; i < args.size(); i++)
+    {
+        int argSize = 0;
+        if (!pure(args[i], locals, argSize))
+            return NULL;
+        if (c.uses[i] > 1)
+            size += (c.uses[i] - 1) * argSize;
+    }
+
+    if (size > _budget)
+        return NULL;
+
+    QVector<bool> taken(args.size(), false);
+    Expr * result = copy(c.body, c.params, args, taken);
+
+    for (int i = 0; i < args.size(); i++)
+    {
+        if (taken[i])
+            args[i] = NULL;
+    }
+    return result;
+}
+
+// where an expression stands: a statement and the target of an
+// assignment are never replaced, only the values in between
+enum Role { Statement, Target, Value };
+
+struct Slot
+{
+    Expr ** at;
+    Role role;
+};
+
+/*
+ * Inlines the calls in one method, walking its statements with a stack
+ * of the slots that hold each expression, so that a call can be replaced
+ * where it stands.
+ */
+bool Inliner::expand(MethodExpr * method)
+{
+    QSet<QString> locals = localsOf(method);
+    QVarLengthArray<Slot, 64> stack;
+    bool changed = false;
+
+    auto push = [&](Expr *& at, Role role)
+    {
+        if (at == NULL) return;
+        Slot s = { &at, role };
+        stack.append(s);
+    };
+
+    for (int i = method->_body.size() - 1; i >= 0; i--)
+        push(method->_body[i], Statement);
+
+    while (!stack.isEmpty())
+    {
+        Slot slot = stack.last();
+        stack.removeLast();
+        Expr * expr = *slot.at;
+
+        if (slot.role == Value)
+        {
+            Expr * replaced = NULL;
+            IdentExpr * name = NULL;
+
+            if (CallExpr * call = dynamic_cast<CallExpr *>(expr))
+            {
+                name = call->_name;
+                if (call->intrinsic() < 0 && !call->isConversion() && _candidates.contains(name->ident()))
+                    replaced = substitute(_candidates[name->ident()], call->_args, locals);
+            }
+            else if (IdentExpr * ident = dynamic_cast<IdentExpr *>(expr))
+            {
+                // a method named on its own is a call without arguments
+                name = ident;
+                if (ident->_object.isEmpty() && !locals.contains(ident->ident())
+                        && !_variables.contains(ident->ident()) && _candidates.contains(ident->ident()))
+                {
+                    ExprList none;
+                    replaced = substitute(_candidates[ident->ident()], none, locals);
+                }
+            }
+
+            if (replaced != NULL)
+            {
+                Inlining inlining;
+                inlining.caller = method->_name->_ident;
+                inlining.callee = _candidates[name->ident()].method->_name->_ident;
+                inlining.line = name->_line;
+                _results.append(inlining);
+                _inlined.insert(_candidates[name->ident()].method);
+
+                delete expr;
+                *slot.at = replaced;
+                changed = true;
+
+                // an argument that was a call may now be inlined too
+                stack.append(slot);
+                continue;
+            }
+        }
+
+        switch (expr->_kind)
+        {
+            case AddressKind:
+                push(((AddressExpr *) expr)->_offset, Value);
+                break;
+
+            case WrapKind:
+                push(((WrapExpr *) expr)->_val, Value);
+                break;
+
+            case UnaryKind:
+            {
+                UnaryExpr * e = (UnaryExpr *) expr;
+                push(e->_val, isUnaryMathOp(e->_op, e->_post) ? Value : Target);
+                break;
+            }
+
+            case BinaryKind:
+            {
+                BinaryExpr * e = (BinaryExpr *) expr;
+                push(e->_right, Value);
+                push(e->_left, isAssignmentOp(e->_op) ? Target : Value);
+                break;
+            }
+
+            case CallKind:
+            {
+                CallExpr * e = (CallExpr *) expr;
+                for (int i = e->_args.size() - 1; i >= 0; i--)
+                    push(e->_args[i], Value);
+                break;
+            }
+
+            case IfKind:
+            {
+                IfExpr * e = (IfExpr *) expr;
+                for (int i = e->_else.size() - 1; i >= 0; i--)
+                    push(e->_else[i], Statement);
+                for (int i = e->_then.size() - 1; i >= 0; i--)
+                    push(e->_then[i], Statement);
+                push(e->_condition, Value);
+                break;
+            }
+
+            case RepeatKind:
+            {
+                RepeatExpr * e = (RepeatExpr *) expr;
+                for (int i = e->_body.size() - 1; i >= 0; i--)
+                    push(e->_body[i], Statement);
+                push(e->_condition, Value);
+                break;
+            }
+
+            case ReturnKind:
+                push(((ReturnExpr *) expr)->_value, Value);
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    return changed;
+}
+
+int Inliner::expand(ObjectExpr * object)
+{
+    _methods.clear();
+    _variables.clear();
+    _inlined.clear();
+    _results.clear();
+    _removed.clear();
+
+    QList<MethodExpr *> methods;
+    for (Expr * b : object->_blocks)
+    {
+        BlockExpr * block = (BlockExpr *) b;
+
+        for (Expr * l : block->_lines)
+        {
+            if (block->_block == VarBlock)
+                _variables.insert(((VarLineExpr *) l)->_ident->ident());
+            else if (block->_block == DatBlock && ((DatLineExpr *) l)->_symbol != NULL)
+                _variables.insert(((DatLineExpr *) l)->_symbol->ident());
+            else if (block->_block == PubBlock || block->_block == PriBlock)
+            {
+                MethodExpr * method = (MethodExpr *) l;
+                methods.append(method);
+
+                // as in the emitter, the first method of a name is the one called
+                if (!_methods.contains(method->_name->ident()))
+                    _methods[method->_name->ident()] = method;
+            }
+        }
+    }
+
+    // inlining into a method can make it a candidate, so go until nothing changes
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+
+        _candidates.clear();
+        foreach (MethodExpr * method, methods)
+        {
+            Candidate c;
+            if (candidate(method, c))
+                _candidates[method->_name->ident()] = c;
+        }
+
+        foreach (MethodExpr * method, methods)
+        {
+            if (expand(method))
+            {
+                method->fold();
+                changed = true;
+            }
+        }
+    }
+
+    CallCollector calls;
+    foreach (MethodExpr * method, methods)
+    {
+        for (Expr * s : method->_body)
+            calls.walk(s);
+    }
+
+    for (Expr * b : object->_blocks)
+    {
+        BlockExpr * block = (BlockExpr *) b;
+        if (block->_block != PriBlock) continue;
+
+        QStringList removed;
+        for (int i = block->_lines.size() - 1; i >= 0; i--)
+        {
+            MethodExpr * method = (MethodExpr *) block->_lines[i];
+            if (!_inlined.contains(method) || calls._names.contains(method->_name->ident()))
+                continue;
+
+            removed.prepend(method->_name->_ident);
+            block->_lines.remove(i);
+            delete method;
+        }
+        _removed += removed;
+    }
+
+    return _results.size();
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <QSet>
+
+#include "tree.h"
+
+/*
+ * Replaces calls to small PRI methods with the expressions they compute,
+ * saving the interpreter a frame, a call and a return for each one.
+ *
+ * A PRI method can be inlined when its body is one "return x" or
+ * "result = x" whose expression only reads its parameters and the
+ * object's VAR and DAT names, and has no more than budget nodes. Such a
+ * method calls nothing, so it cannot be recursive. Each call is replaced
+ * by a copy of the expression with every parameter replaced by its
+ * argument. The arguments must have no side effects, since they are no
+ * longer evaluated exactly once and in order; one used more than once is
+ * copied, and the copies count towards the budget. A call is left alone
+ * where the caller has a local of the same name as a VAR or DAT name the
+ * expression reads, or where it is a statement of its own.
+ *
+ * Methods whose bodies lose their last call become candidates in turn,
+ * so chains of helpers flatten. A method that calls were inlined into is
+ * folded again, and a PRI method left with no calls is removed.
+ */
+
+struct Inlining
+{
+    QString caller;
+    QString callee;
+    int line;
+};
+
+class Inliner
+{
+    struct Candidate
+    {
+        MethodExpr * method;
+        Expr * body;
+        QHash<QString, int> params;
+        QList<int> uses;
+        QSet<QString> reads;
+        int size;
+    };
+
+    int _budget;
+    QHash<QString, MethodExpr *> _methods;
+    QSet<QString> _variables;
+    QHash<QString, Candidate> _candidates;
+    QSet<MethodExpr *> _inlined;
+
+    bool candidate(MethodExpr * method, Candidate & c);
+    bool pure(Expr * expr, const QSet<QString> & locals, int & size);
+    Expr * substitute(const Candidate & c, ExprList & args, const QSet<QString> & locals);
+    bool expand(MethodExpr * method);
+
+public:
+    QList<Inlining> _results;
+    QStringList _removed;
+
+    Inliner(int budget);
+    int expand(ObjectExpr * object);
+};
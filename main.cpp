@@ -1,37 +1,570 @@
 #include "tree.h"
+#include "parse.h"
 #include "printer.h"
 #include "treeprinter.h"
-#include "navigator.h"
+#include "resolver.h"
+#include "server.h"
+#include "project.h"
+#include "watcher.h"
+#include "folder.h"
+#include "assembler.h"
+#include "emitter.h"
+#include "simulator.h"
+#include "varlayout.h"
+#include "ranges.h"
+#include "inliner.h"
+#include "profile.h"
+#include "astwriter.h"
 #include <QDebug>
+#include <QFile>
+#include <QFileInfo>
 
-extern FILE *yyin;
-extern FILE *yyout;
+// one second at the usual 80 MHz
+static const quint64 SimulationLimit = 80000000;
 
-extern int yyparse();
-extern ObjectExpr * rootExpr;
-extern QString filename;
+static void printProfile(const Simulator & simulator, const char * cycles, const char * unit)
+{
+    printf("  %-20s %8s %12s %12s %10s\n", "", "calls", cycles, "self", unit);
+    foreach (SimProfile p, simulator._profile)
+    {
+        printf("  %-20s %8llu %12llu %12llu %10llu\n", qPrintable(p.name),
+               (unsigned long long) p.calls, (unsigned long long) p.cycles,
+               (unsigned long long) p.self, (unsigned long long) p.steps);
+    }
+}
+
+static bool printTargetProfile(const Emitter & emitter, const QByteArray & dump)
+{
+    QList<TargetProfile> profile;
+    QString error;
+    if (!decodeProfile(emitter, dump, profile, error))
+    {
+        fprintf(stderr, "profile: %s\n", qPrintable(error));
+        return false;
+    }
+
+    printf("  %-20s %10s %12s %10s\n", "", "calls", "cycles", "average");
+    foreach (TargetProfile p, profile)
+    {
+        printf("  %-20s %10u %12u %10u\n", qPrintable(p.name), p.calls, p.cycles,
+               p.calls > 0 ? p.cycles / p.calls : 0);
+    }
+    return true;
+}
+
+// every instance of an object gets its own copy of its VAR block
+static void countInstances(Project & project, QString path, quint64 count,
+                           QHash<QString, quint64> & instances, QStringList & stack)
+{
+    ObjectExpr * object = project._objects.value(path);
+    if (object == NULL || stack.contains(path)) return;
+
+    instances[path] += count;
+    stack.append(path);
+
+    for (Expr * b : object->_blocks)
+    {
+        BlockExpr * block = (BlockExpr *) b;
+        if (block->_block != ObjBlock) continue;
+
+        for (Expr * l : block->_lines)
+        {
+            ObjLineExpr * line = (ObjLineExpr *) l;
+            countInstances(project, line->_path, count * qMax(line->value(), (quint32) 1), instances, stack);
+        }
+    }
+
+    stack.removeLast();
+}
+
+static bool printVarReport(Project & project)
+{
+    QHash<QString, quint64> instances;
+    QStringList stack;
+    countInstances(project, project._root, 1, instances, stack);
+
+    bool ok = true;
+    quint64 total = 0;
+    quint64 declared = 0;
+
+    printf("%-30s %8s %8s %10s %10s\n", "object", "VAR", "declared", "instances", "total");
+    QStringList paths = project._objects.keys();
+    paths.sort();
+
+    foreach (QString path, paths)
+    {
+        VarLayout layout;
+        if (!layout.layout(project._objects[path]))
+            ok = false;
+
+        quint64 n = instances.value(path);
+        printf("%-30s %8i %8i %10llu %10llu\n", qPrintable(QFileInfo(path).fileName()),
+               layout._size, layout._declared, (unsigned long long) n,
+               (unsigned long long) (n * layout._size));
+
+        total += n * layout._size;
+        declared += n * layout._declared;
+    }
+
+    printf("VAR total: %llu bytes of hub RAM, %llu in declaration order\n",
+           (unsigned long long) total, (unsigned long long) declared);
+    return ok;
+}
+
+static const char * sizeName(int size)
+{
+    return size == 1 ? "byte" : size == 2 ? "word" : "long";
+}
+
+static void printNarrowing(RangeAnalysis & ranges, int saved)
+{
+    foreach (Narrowing n, ranges._results)
+    {
+        if (n.needed >= n.size) continue;
+
+        printf("  %-3s %-20s %s -> %s, %i elements, %i bytes saved\n",
+               n.dat ? "DAT" : "VAR", qPrintable(n.name->_ident),
+               sizeName(n.size), sizeName(n.needed), n.elements,
+               n.elements * (n.size - n.needed));
+    }
+    printf("narrowed: %i bytes saved\n", saved);
+}
+
+static const char * astKind(const AstNode * n)
+{
+    static const char * kinds[] = {
+        "Number", "Ident", "Address", "Literal", "DataType", "Block", "DatLine",
+        "DatItem", "Unary", "Binary", "ConAssign", "String", "ObjLine", "VarLine",
+        "AsmLine", "Method", "Call", "If", "Repeat", "Return", "Wrap", "Object"
+    };
+
+    if (n->kind == AstList) return "List";
+    if (n->kind < sizeof(kinds) / sizeof(kinds[0])) return kinds[n->kind];
+    return "?";
+}
+
+static QString astNode(const AstReader & reader, const AstNode * n)
+{
+    QString text = astKind(n);
+
+    if (reader.text(n) != NULL)
+        text += QString(" \"%1\"").arg(QString::fromUtf8(reader.text(n)));
+    if (n->line > 0)
+        text += QString(" %1:%2").arg(n->line).arg(n->column);
+
+    if (n->flags & AstFloat)
+        text += QString(" = %1").arg(bitsToFloat(n->value));
+    else if (n->flags & AstConstant)
+        text += QString(" = %1").arg((qint32) n->value);
+
+    const AstNode * b = reader.binding(n);
+    if (b != NULL)
+        text += QString(" -> %1 %2:%3").arg(astKind(b)).arg(b->line).arg(b->column);
+    else if (n->kind != AstIdent && n->extra != 0)
+        text += QString(" extra %1").arg(n->extra);
+
+    return text;
+}
+
+// lists a file written by --ast as the reader sees it: every node with
+// its children indented below it, then the symbol table
+static bool printAst(const QByteArray & data)
+{
+    AstReader reader(data.constData(), data.size());
+    if (!reader.valid() || reader.root() == NULL)
+    {
+        fprintf(stderr, "not a valid AST file\n");
+        return false;
+    }
+
+    printf("ast version %i.%i, %u bytes\n", reader.header()->major, reader.header()->minor,
+           reader.header()->size);
+
+    // the tree can be as deep as the source nests, so no recursion
+    QList<QPair<const AstNode *, int> > stack;
+    stack.append(qMakePair(reader.root(), 0));
+
+    while (!stack.isEmpty())
+    {
+        QPair<const AstNode *, int> top = stack.takeLast();
+        QString indent(2 * top.second, ' ');
+
+        if (top.first == NULL)
+        {
+            printf("%s-\n", qPrintable(indent));
+            continue;
+        }
+
+        printf("%s%s\n", qPrintable(indent), qPrintable(astNode(reader, top.first)));
+
+        for (int i = top.first->slots - 1; i >= 0; i--)
+            stack.append(qMakePair(reader.child(top.first, i), top.second + 1));
+    }
+
+    printf("symbols: %i\n", reader.symbolCount());
+    for (int i = 0; i < reader.symbolCount(); i++)
+    {
+        const AstSymbol * symbol = reader.symbol(i);
+        const AstNode * definition = reader.node(symbol->definition);
+
+        const char * name = reader.string(symbol->name);
+        printf("  %-20s %s\n", name != NULL ? name : "?",
+               definition != NULL ? qPrintable(astNode(reader, definition)) : "-");
+    }
+    return true;
+}
+
+static void printInlining(Inliner & inliner)
+{
+    foreach (Inlining i, inliner._results)
+        printf("  %s into %s, line %i\n", qPrintable(i.callee), qPrintable(i.caller), i.line);
+
+    foreach (QString name, inliner._removed)
+        printf("  PRI %s removed\n", qPrintable(name));
+
+    printf("inlined: %i calls, %i methods removed\n", inliner._results.size(), inliner._removed.size());
+}
 
 int main( int argc, char **argv )
 {
+    ObjectResolver resolver;
+    bool lsp = false;
+    bool watch = false;
+    bool simulate = false;
+    bool vars = false;
+    bool narrow = false;
+    int inlineBudget = 0;
+    bool profile = false;
+    QString decode;
+    QString ast;
+    QString readAst;
+    QString costs;
+
     ++argv, --argc;  /* skip over program name */
+    while ( argc > 0 && argv[0][0] == '-' )
+    {
+        QString option = argv[0];
+
+        if ( option == "-L" && argc > 1 )
+        {
+            resolver.addPath(argv[1]);
+            ++argv, --argc;
+        }
+        else if ( option == "-j" && argc > 1 )
+        {
+            QThreadPool::globalInstance()->setMaxThreadCount(QString(argv[1]).toInt());
+            ++argv, --argc;
+        }
+        else if ( option == "--chunks" && argc > 1 )
+        {
+            setChunkSize(QString(argv[1]).toInt());
+            ++argv, --argc;
+        }
+        else if ( option == "--lsp" )
+        {
+            lsp = true;
+        }
+        else if ( option == "--watch" )
+        {
+            watch = true;
+        }
+        else if ( option == "--simulate" )
+        {
+            simulate = true;
+        }
+        else if ( option == "--costs" && argc > 1 )
+        {
+            simulate = true;
+            costs = argv[1];
+            ++argv, --argc;
+        }
+        else if ( option == "--vars" )
+        {
+            vars = true;
+        }
+        else if ( option == "--narrow" )
+        {
+            narrow = true;
+        }
+        else if ( option == "--inline" && argc > 1 )
+        {
+            inlineBudget = QString(argv[1]).toInt();
+            ++argv, --argc;
+        }
+        else if ( option == "--ast" && argc > 1 )
+        {
+            ast = argv[1];
+            ++argv, --argc;
+        }
+        else if ( option == "--read-ast" && argc > 1 )
+        {
+            readAst = argv[1];
+            ++argv, --argc;
+        }
+        else if ( option == "--profile" )
+        {
+            profile = true;
+        }
+        else if ( option == "--decode" && argc > 1 )
+        {
+            profile = true;
+            decode = argv[1];
+            ++argv, --argc;
+        }
+        else
+        {
+            fprintf(stderr, "usage: spindrake [-L dir]... [-j threads] [--chunks size] [--narrow] [--inline size] [--ast out | --read-ast file] [--profile | --decode dump] [--lsp | --watch | --simulate [--costs file] | --vars] [file]\n");
+            return -1;
+        }
+
+        ++argv, --argc;
+    }
+
+    if ( !readAst.isEmpty() )
+    {
+        QFile in(readAst);
+        if (!in.open(QIODevice::ReadOnly))
+        {
+            fprintf(stderr, "cannot open %s\n", qPrintable(readAst));
+            return -1;
+        }
+
+        return printAst(in.readAll()) ? 0 : -1;
+    }
+
+    if ( lsp )
+    {
+        LanguageServer server(resolver);
+        return server.run();
+    }
+
+    if ( watch )
+    {
+        if ( argc == 0 )
+        {
+            fprintf(stderr, "--watch needs a file\n");
+            return -1;
+        }
+
+        Printer printer;
+        Project project(resolver);
+
+        project.load(argv[0]);
+        if (project.root() != NULL)
+            printer.print(project.root());
+
+        Watcher watcher(project);
+        return watcher.run([&](QStringList changed)
+        {
+            foreach (QString f, changed)
+                fprintf(stderr, "changed: %s\n", qPrintable(f));
+            fprintf(stderr, "parsed %i of %i objects\n", project._parses, project._objects.size());
+
+            if (project.root() != NULL)
+                printer.print(project.root());
+        });
+    }
+
+    if ( vars )
+    {
+        if ( argc == 0 )
+        {
+            fprintf(stderr, "--vars needs a file\n");
+            return -1;
+        }
+
+        Project project(resolver);
+        if (!project.load(argv[0]))
+            return -1;
+
+        return printVarReport(project) ? 0 : -1;
+    }
+
+    FILE * file = stdin;
     if ( argc > 0 )
-        yyin = fopen( argv[0], "r" );
-    else
-        yyin = stdin;
+        file = fopen( argv[0], "r" );
 
-    filename = argv[0];
+    if ( file == NULL )
+    {
+        fprintf(stderr, "cannot open %s\n", argv[0]);
+        return -1;
+    }
 
-    yyparse();
+    ObjectExpr * rootExpr = parse(argc > 0 ? argv[0] : "", file);
+
+    if (!resolver.resolve(rootExpr))
+        exit(-1);
 
     Printer printer;
     TreePrinter treeprinter;
 
-    Navigator navigator;
-
-    navigator.walk(rootExpr, treeprinter);
+    treeprinter.walk(rootExpr);
     printer.print(rootExpr);
-    rootExpr->fold();
+    ConstantExports exports(resolver);
+    Folder(&exports).fold(rootExpr);
+
+    if ( inlineBudget > 0 )
+    {
+        Inliner inliner(inlineBudget);
+        inliner.expand(rootExpr);
+        printInlining(inliner);
+    }
+
+    if ( narrow )
+    {
+        RangeAnalysis ranges;
+        ranges.analyze(rootExpr);
+        printNarrowing(ranges, ranges.narrow());
+    }
+
+    Assembler assembler;
+    if (!assembler.assemble(rootExpr))
+        exit(-1);
+
     printer.print(rootExpr);
 
+    foreach (AsmWord w, assembler._code)
+        printf("%03x  %08x\n", w.address, w.code);
+
+    Emitter emitter;
+    emitter._profile = profile;
+    if (!emitter.compile(rootExpr))
+        exit(-1);
+
+    // after the assembler and the emitter, so cog addresses and VAR offsets are known
+    if ( !ast.isEmpty() )
+    {
+        QFile out(ast);
+        if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate)
+                || out.write(AstWriter().write(rootExpr)) < 0)
+        {
+            fprintf(stderr, "cannot write %s\n", qPrintable(ast));
+            exit(-1);
+        }
+    }
+
+    foreach (MethodCode m, emitter._methods)
+    {
+        printf("%s %s: %i bytes (%i before peephole)\n",
+               m.method->_block == PubBlock ? "PUB" : "PRI",
+               qPrintable(m.method->_name->_ident), m.code.size(), m.unoptimized);
+
+        for (int i = 0; i < m.code.size(); i++)
+            printf("%02x%s", (quint8) m.code[i], (i % 16 == 15 || i == m.code.size() - 1) ? "\n" : " ");
+    }
+
+    if (!emitter._pool._data.isEmpty())
+    {
+        printf("pool: %i bytes (%i before sharing)\n",
+               emitter._pool._data.size(), emitter._pool._requested);
+    }
+
+    if (!emitter._layout._vars.isEmpty())
+    {
+        printf("VAR: %i bytes (%i in longs, %i in words, %i in bytes), %i in declaration order\n",
+               emitter._layout._size, emitter._layout._longs, emitter._layout._words,
+               emitter._layout._bytes, emitter._layout._declared);
+
+        foreach (VarLineExpr * v, emitter._layout._vars)
+            printf("  +%-5i %-5s %s\n", v->_offset, qPrintable(v->_type->ident()), qPrintable(v->_ident->_ident));
+    }
+
+    if ( profile )
+    {
+        printf("profile buffer: +%i, %i bytes\n", emitter._profileBuffer,
+               ProfileHeader + ProfileEntry * emitter._methods.size());
+    }
+
+    if ( !decode.isEmpty() )
+    {
+        QFile dump(decode);
+        if (!dump.open(QIODevice::ReadOnly))
+        {
+            fprintf(stderr, "cannot open %s\n", qPrintable(decode));
+            exit(-1);
+        }
+
+        printf("profile %s:\n", qPrintable(decode));
+        if (!printTargetProfile(emitter, dump.readAll()))
+            exit(-1);
+    }
+
+    if ( simulate )
+    {
+        Simulator simulator;
+        int status = 0;
+
+        // without measured costs the interpreter's timing is an estimate
+        bool estimated = costs.isEmpty();
+        if (!estimated)
+        {
+            QFile file(costs);
+            QString error;
+            if (!file.open(QIODevice::ReadOnly))
+            {
+                fprintf(stderr, "cannot open %s\n", qPrintable(costs));
+                exit(-1);
+            }
+            if (!simulator._costs.load(file.readAll(), error))
+            {
+                fprintf(stderr, "%s: %s\n", qPrintable(costs), qPrintable(error));
+                exit(-1);
+            }
+        }
+
+        // like the chip, run the first PUB method
+        if (!emitter._methods.isEmpty())
+        {
+            MethodCode first = emitter._methods.first();
+            bool ok = simulator.spin(emitter, first.index, SimulationLimit);
+
+            printf("simulate PUB %s: ", qPrintable(first.method->_name->_ident));
+            if (!ok)
+                printf("error: %s\n", qPrintable(simulator._error));
+            else if (simulator._finished)
+                printf("returned %i\n", (qint32) simulator._result);
+            else
+                printf("still running\n");
+
+            printf("  %llu %s, %llu waiting for hub, %llu bytecodes\n",
+                   (unsigned long long) simulator._clock,
+                   estimated ? "cycles (estimated)" : "cycles",
+                   (unsigned long long) simulator._hubWait,
+                   (unsigned long long) simulator._steps);
+            printProfile(simulator, estimated ? "est. cycles" : "cycles", "bytecodes");
+            if (!ok) status = -1;
+
+            // what the instrumented code counted for itself
+            if (ok && profile)
+            {
+                int size = ProfileHeader + ProfileEntry * emitter._methods.size();
+                printf("  counted by the code:\n");
+                if (!printTargetProfile(emitter, simulator.dump(emitter._profileBuffer, size)))
+                    status = -1;
+            }
+        }
+
+        if (!assembler._code.isEmpty())
+        {
+            bool ok = simulator.cog(assembler, SimulationLimit);
+
+            printf("simulate ASM: ");
+            if (!ok)
+                printf("error: %s\n", qPrintable(simulator._error));
+            else
+                printf("%s\n", simulator._finished ? "halted" : "still running");
+
+            printf("  %llu cycles, %llu waiting for hub, %llu instructions\n",
+                   (unsigned long long) simulator._clock,
+                   (unsigned long long) simulator._hubWait,
+                   (unsigned long long) simulator._steps);
+            printProfile(simulator, "cycles", "instrs");
+            if (!ok) status = -1;
+        }
+
+        if (status != 0)
+            exit(status);
+    }
+
     delete rootExpr;
 }
@@ -0,0 +1,227 @@
+#include "parse.h"
+#include "parser.hpp"
+
+#include <ctype.h>
+
+#include <QThreadPool>
+#include <QtConcurrent>
+
+extern void * lexerScan(const char * text, int size, int line, ParseState * parse);
+extern void lexerClose(void * scanner);
+
+// smaller pieces are not worth a thread of their own
+static const int ChunkSize = 64 * 1024;
+
+// the size given to setChunkSize(), or -1 to go by the thread pool
+static int chunkSize = -1;
+
+struct Chunk
+{
+    QString name;
+    const char * text;
+    int size;
+    int line;
+
+    ObjectExpr * object;
+    QList<Diagnostic> diagnostics;
+};
+
+static void parseChunk(Chunk & chunk)
+{
+    ParseState state;
+    state.filename = chunk.name;
+    state.diagnostics = &chunk.diagnostics;
+    state.root = NULL;
+
+    void * scanner = lexerScan(chunk.text, chunk.size, chunk.line, &state);
+    yyparse(&state, scanner);
+    lexerClose(scanner);
+
+    chunk.object = state.root;
+}
+
+// a block keyword on its own, not the start of a longer name
+static bool isBlockKeyword(const QByteArray & text, int at)
+{
+    static const char * keywords[] = { "con", "var", "obj", "pub", "pri", "dat", "asm" };
+
+    if (at + 3 < text.size())
+    {
+        char next = text[at + 3];
+        if (isalnum((unsigned char) next) || next == '_')
+            return false;
+    }
+
+    for (unsigned k = 0; k < sizeof(keywords) / sizeof(keywords[0]); k++)
+    {
+        if (at + 3 <= text.size() && qstrnicmp(text.constData() + at, keywords[k], 3) == 0)
+            return true;
+    }
+    return false;
+}
+
+/*
+ * Cuts the text where the lexer would be between blocks: at a block
+ * keyword in column one that is not inside a comment or string. The
+ * pieces are at least size bytes long, and each knows its first line.
+ */
+static QList<Chunk> split(QString name, const QByteArray & text, int size)
+{
+    enum { Code, String, LineComment, DocComment, DocBlockComment } state = Code;
+
+    QList<int> starts;
+    QList<int> lines;
+    starts.append(0);
+    lines.append(1);
+
+    int line = 1;
+    for (int i = 0; i < text.size(); i++)
+    {
+        char c = text[i];
+        bool doubled = i + 1 < text.size() && text[i + 1] == c;
+
+        if (c == '\n')
+        {
+            line++;
+            if (state == LineComment)
+                state = Code;
+            continue;
+        }
+
+        switch (state)
+        {
+            case Code:
+                if (c == '\'')
+                    state = LineComment;
+                else if (c == '"')
+                    state = String;
+                else if (c == '{')
+                {
+                    state = doubled ? DocBlockComment : DocComment;
+                    if (doubled) i++;
+                }
+                else if ((i == 0 || text[i - 1] == '\n') && i - starts.last() >= size
+                         && isBlockKeyword(text, i))
+                {
+                    starts.append(i);
+                    lines.append(line);
+                }
+                break;
+
+            case String:
+                if (c == '"') state = Code;
+                break;
+
+            case DocComment:
+                if (c == '}') state = Code;
+                break;
+
+            case DocBlockComment:
+                if (c == '}' && doubled)
+                {
+                    state = Code;
+                    i++;
+                }
+                break;
+
+            case LineComment:
+                break;
+        }
+    }
+
+    QList<Chunk> chunks;
+    for (int n = 0; n < starts.size(); n++)
+    {
+        Chunk chunk;
+        chunk.name = name;
+        chunk.text = text.constData() + starts[n];
+        chunk.size = (n + 1 < starts.size() ? starts[n + 1] : text.size()) - starts[n];
+        chunk.line = lines[n];
+        chunk.object = NULL;
+        chunks.append(chunk);
+    }
+    return chunks;
+}
+
+void setChunkSize(int size)
+{
+    chunkSize = size;
+}
+
+ObjectExpr * parse(QString name, FILE * file)
+{
+    QByteArray text;
+    char buffer[4096];
+    size_t n;
+
+    while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+        text.append(buffer, (int) n);
+
+    QList<Diagnostic> errors;
+    ObjectExpr * object = parse(name, text, &errors);
+
+    if (!errors.isEmpty())
+    {
+        report(name, errors.first());
+        exit(-1);
+    }
+
+    return object;
+}
+
+ObjectExpr * parse(QString name, QByteArray text, QList<Diagnostic> * errors)
+{
+    QList<Chunk> chunks;
+
+    int size = chunkSize;
+    if (size < 0)
+        size = QThreadPool::globalInstance()->maxThreadCount() > 1 ? ChunkSize : 0;
+
+    if (size > 0 && text.size() >= 2 * size)
+        chunks = split(name, text, size);
+
+    if (chunks.size() < 2)
+    {
+        Chunk whole;
+        whole.name = name;
+        whole.text = text.constData();
+        whole.size = text.size();
+        whole.line = 1;
+        parseChunk(whole);
+
+        foreach (Diagnostic d, whole.diagnostics)
+            errors->append(d);
+        return whole.object;
+    }
+
+    QtConcurrent::blockingMap(chunks, parseChunk);
+
+    ExprList * blocks = new ExprList();
+    bool ok = true;
+
+    foreach (Chunk chunk, chunks)
+    {
+        foreach (Diagnostic d, chunk.diagnostics)
+            errors->append(d);
+
+        if (chunk.object == NULL)
+        {
+            ok = false;
+            continue;
+        }
+
+        for (Expr * b : chunk.object->_blocks)
+            blocks->append(b);
+        chunk.object->_blocks.clear();
+        delete chunk.object;
+    }
+
+    if (!ok)
+    {
+        for (Expr * b : *blocks) { delete b; }
+        delete blocks;
+        return NULL;
+    }
+
+    return new ObjectExpr(name, blocks);
+}
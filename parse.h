@@ -0,0 +1,47 @@
+#pragma once
+
+#include "tree.h"
+
+struct Diagnostic
+{
+    int line;
+    int first_column;
+    int last_column;
+    QString message;
+    QString text;
+};
+
+// what one run of the parser works with, so that runs can overlap
+struct ParseState
+{
+    QString filename;
+    QList<Diagnostic> * diagnostics;
+    ObjectExpr * root;
+
+    // the text of names and strings read so far, so that every use of
+    // a name shares one string
+    QHash<QByteArray, QString> strings;
+};
+
+/*
+ * Parses a whole object. The FILE overload reports errors to stderr and
+ * exits; the buffer overload collects them into the given list instead,
+ * returning NULL when no tree could be built.
+ *
+ * A large buffer is cut before block keywords in column one and the
+ * pieces are parsed on the global thread pool, each starting at its own
+ * line so that locations stay right. Their blocks are joined back in
+ * source order.
+ */
+
+// cuts buffers of at least two pieces into pieces of at least size
+// bytes, whatever the thread pool's size; 0 parses every buffer whole.
+// Until this is called, pieces are 64 KB when the pool has more than one
+// thread.
+void setChunkSize(int size);
+
+ObjectExpr * parse(QString name, FILE * file);
+ObjectExpr * parse(QString name, QByteArray text, QList<Diagnostic> * errors);
+
+void report(QString name, Diagnostic d);
+void warn(QString name, Diagnostic d);
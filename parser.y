@@ -3,29 +3,70 @@
 #include "types.h"
 #include "parser.hpp"
 #include "tree.h"
-
-ObjectExpr * rootExpr = NULL;
+#include "parse.h"
+#include "pasm.h"
 %}
 
+%code requires {
+struct ParseState;
+}
+
 %union {
     quint32         num;
     float           fl;
     const char      *str;
     Expr            *exp;
-    QList<Expr *>   *list;
+    ExprList        *list;
 }
 
 %{
-int yylex (YYSTYPE*, YYLTYPE*);
-int yyerror (YYLTYPE *locp, char const *msg);
-void print(const char * s);
+int yylex (YYSTYPE*, YYLTYPE*, void *);
+int yyerror (YYLTYPE *locp, ParseState * state, void * scanner, char const *msg);
+
+// a list is only made once it has an entry; the nodes take over the
+// lists, so an empty one never costs an allocation
+static ExprList * append(ExprList * list, Expr * expr)
+{
+    if (list == NULL)
+        list = new ExprList();
+
+    list->append(expr);
+    return list;
+}
+
+// the string for a name or string token, shared with every earlier use
+// of the same text in this run
+static QString intern(ParseState * state, const char * text)
+{
+    QByteArray key = QByteArray::fromRawData(text, strlen(text));
+    QHash<QByteArray, QString>::iterator i = state->strings.find(key);
 
-extern const char * yytext;
-extern int yylineno;
-extern FILE *yyin;
-extern FILE *yyout;
+    if (i == state->strings.end())
+        i = state->strings.insert(QByteArray(text), QString::fromUtf8(text));
+    return i.value();
+}
+
+// every PUB and PRI is a block of its own holding a single method
+static Expr * methodBlock(Block block, Expr * method)
+{
+    ((MethodExpr *) method)->_block = block;
+
+    return new BlockExpr(block, append(NULL, method));
+}
 
-QString filename;
+// alias#name names a constant of a child object; it keeps the alias's place
+static Expr * qualify(Expr * alias, Expr * name)
+{
+    IdentExpr * a = (IdentExpr *) alias;
+    IdentExpr * n = (IdentExpr *) name;
+
+    n->_object = a->_ident;
+    n->_line = a->_line;
+    n->_column = a->_column;
+
+    delete alias;
+    return name;
+}
 
 %}
 
@@ -34,9 +75,14 @@ QString filename;
 %define api.pure full
 %define parse.lac full
 %define parse.error verbose
+%parse-param {ParseState * state} {void * scanner}
+%lex-param {void * scanner}
 
 %start program
 
+%destructor { delete $$; } <exp>
+%destructor { if ($$ != NULL) { for (Expr * e : *$$) delete e; } delete $$; } <list>
+
 
 // numbers
 
@@ -49,24 +95,14 @@ QString filename;
 %token <num>    HEXADECIMAL     "hexadecimal number"
 %token <num>    DECIMAL         "decimal number"
 %token <fl>     FLOAT
+%token <num>    MNEMONIC        "instruction"
+%token <num>    CONDITION       "condition"
+%token <num>    EFFECT          "effect"
 
-%type <exp>     expr primary_expr 
-
-%type <exp>     assign_expr
-%type <exp>     bool_or_expr
-%type <exp>     bool_and_expr
-%type <exp>     bool_not_expr
-%type <exp>     relation_expr
-%type <exp>     add_expr
-%type <exp>     mult_expr
-%type <exp>     bw_or_expr
-%type <exp>     bw_and_expr
-%type <exp>     shift_expr
-%type <exp>     unary_expr
-%type <exp>     unary2_expr
-%type <exp>     literal address factor
+%type <exp>     expr
+%type <exp>     literal address
 %type <exp>     array_index
-%type <exp>     ident bin quat dec hex number
+%type <exp>     ident number
 %type <exp>     data_type
 
 %type <list>    blocklist
@@ -76,6 +112,14 @@ QString filename;
 %type <list>    con_lines
 %type <exp>     con_line
 
+%type <exp>     var
+%type <list>    var_lines
+%type <exp>     var_line
+
+%type <exp>     obj
+%type <list>    obj_lines
+%type <exp>     obj_line obj_file
+
 %type <exp>     dat 
 %type <list>    dat_lines
 %type <exp>     dat_line
@@ -83,6 +127,17 @@ QString filename;
 %type <exp>     dat_item
 %type <exp>     dat_symbol dat_align dat_size
 
+%type <exp>     asm
+%type <list>    asm_lines
+%type <exp>     asm_line asm_label asm_operand
+%type <list>    asm_operands asm_operand_list
+%type <num>     asm_cond asm_effects asm_effect_list
+
+%type <exp>     pub pri method method_result
+%type <list>    method_params method_locals ident_list expr_list
+%type <list>    statements statement_block else_part
+%type <exp>     statement
+
 
 // operators
 
@@ -141,6 +196,17 @@ QString filename;
 %token  DAT         "DAT block"
 %token  ASM         "ASM block"
 
+%token  INDENT      "indent"
+%token  DEDENT      "dedent"
+
+%token  IF          "if"
+%token  ELSEIF      "elseif"
+%token  ELSE        "else"
+%token  REPEAT      "repeat"
+%token  WHILE       "while"
+%token  UNTIL       "until"
+%token  RETURN      "return"
+
 %token  BYTE        "byte"
 %token  WORD        "word"
 %token  LONG        "long"
@@ -163,18 +229,41 @@ QString filename;
 %token END 0        "end of file"
 
 
+// operator precedence, from lowest to highest (see README)
+
+%left       ASSIGN ADD_ASSIGN SUB_ASSIGN MUL_ASSIGN MOD_ASSIGN DIV_ASSIGN
+            SHL_ASSIGN SHR_ASSIGN SAR_ASSIGN ROL_ASSIGN ROR_ASSIGN REV_ASSIGN
+            AND_ASSIGN OR_ASSIGN XOR_ASSIGN
+%left       BOOL_OR
+%left       BOOL_AND
+%precedence BOOL_NOT
+%left       EQ NEQ LESS GREATER LESSEQ GREATEREQ
+%left       PLUS MINUS
+%left       MUL DIV MOD
+%left       BW_OR BW_XOR
+%left       BW_AND
+%left       SHL SHR SAR ROL ROR REV
+%precedence NEG BW_NOT
+%right      DEC INC SET CLEAR ADDR
+
+
 
 %%
 
-program         : blocklist                                     { rootExpr = new ObjectExpr(filename, $1); }
+program         : blocklist                                     { state->root = new ObjectExpr(state->filename, $1); }
                 ;
 
-blocklist       : blocklist block                               { $$ = $1; $1->append($2); }
-                |                                               { $$ = new QList<Expr *>(); }
+blocklist       : blocklist block                               { $$ = append($1, $2); }
+                |                                               { $$ = NULL; }
                 ;
 
 block           : con
+                | var
+                | obj
+                | pub
+                | pri
                 | dat 
+                | asm
                 ;
 
 // con blocks
@@ -183,8 +272,8 @@ block           : con
 con             : CON NL con_lines                              { $$ = new BlockExpr(ConBlock, $3); }
                 ;
 
-con_lines       : con_lines con_line                            { $$ = $1; $1->append($2); }
-                |                                               { $$ = new QList<Expr *>(); }
+con_lines       : con_lines con_line                            { $$ = append($1, $2); }
+                |                                               { $$ = NULL; }
                 ;
 
 con_line        : ident ASSIGN expr NL                          { $$ = new ConAssignExpr($1, $3); }
@@ -195,54 +284,92 @@ con_array       : con_array_item
                 | con_array COMMA con_array_item
                 ;
 
-con_array_item  : ident
-                | ident array_index
+// enumerated names are not given values yet, so they are let go here
+con_array_item  : ident                                         { delete $1; }
+                | ident array_index                             { delete $1; delete $2; }
                 ;
 
 // var blocks
 // -----------------------------------------------------
 
-var             : VAR NL var_lines
+var             : VAR NL var_lines                              { $$ = new BlockExpr(VarBlock, $3); }
                 ;
 
-var_lines       : var_line
-                | var_lines var_line
+var_lines       : var_lines var_line                            { $$ = append($1, $2); }
+                |                                               { $$ = NULL; }
                 ;
 
-var_line        : data_type IDENT NL
-                | data_type IDENT array_index NL
+var_line        : data_type ident NL                            { $$ = new VarLineExpr($1, $2, new NumberExpr(10, 0)); }
+                | data_type ident array_index NL                { $$ = new VarLineExpr($1, $2, $3); }
                 ;
 
 // obj blocks
 // -----------------------------------------------------
 
-obj             : OBJ NL obj_lines
+obj             : OBJ NL obj_lines                              { $$ = new BlockExpr(ObjBlock, $3); }
                 ;
 
-obj_lines       : obj_line
-                | obj_lines obj_line
+obj_lines       : obj_lines obj_line                            { $$ = append($1, $2); }
+                |                                               { $$ = NULL; }
                 ;
 
-obj_line        : obj_alias OBJSTRING NL
+obj_line        : ident ALIAS obj_file NL                       { $$ = new ObjLineExpr($1, new NumberExpr(10, 0), $3); }
+                | ident array_index ALIAS obj_file NL           { $$ = new ObjLineExpr($1, $2, $4); }
                 ;
 
-obj_alias       : ident ALIAS
-                | ident array_index ALIAS
+obj_file        : OBJSTRING                                     { $$ = new StringExpr(intern(state, $1)); }
                 ;
 
 // pub/pri blocks
 // -----------------------------------------------------
 
-pub             : PUB NL    { printf("PUB\n"); }
+pub             : PUB method                                    { $$ = methodBlock(PubBlock, $2); }
+                ;
+
+pri             : PRI method                                    { $$ = methodBlock(PriBlock, $2); }
+                ;
+
+method          : ident method_params method_result method_locals NL statement_block
+                                                                { $$ = new MethodExpr($1, $2, $3, $4, $6); }
+                ;
+
+method_params   : PAREN_L ident_list PAREN_R                    { $$ = $2; }
+                |                                               { $$ = NULL; }
+                ;
+
+method_result   : ALIAS ident                                   { $$ = $2; }
+                |                                               { $$ = NULL; }
+                ;
+
+method_locals   : BW_OR ident_list                              { $$ = $2; }
+                |                                               { $$ = NULL; }
+                ;
+
+ident_list      : ident                                         { $$ = append(NULL, $1); }
+                | ident_list COMMA ident                        { $$ = append($1, $3); }
                 ;
 
-pri             : PRI NL    { printf("PRI\n"); }
+statement_block : INDENT statements DEDENT                      { $$ = $2; }
+                |                                               { $$ = NULL; }
                 ;
 
-pub_lines       :
+statements      : statements statement                          { $$ = append($1, $2); }
+                |                                               { $$ = NULL; }
                 ;
 
-pri_lines       :
+statement       : expr NL
+                | IF expr NL statement_block else_part          { $$ = new IfExpr($2, $4, $5); }
+                | REPEAT NL statement_block                     { $$ = new RepeatExpr(RepeatForever, NULL, $3); }
+                | REPEAT expr NL statement_block                { $$ = new RepeatExpr(RepeatCount, $2, $4); }
+                | REPEAT WHILE expr NL statement_block          { $$ = new RepeatExpr(RepeatWhile, $3, $5); }
+                | REPEAT UNTIL expr NL statement_block          { $$ = new RepeatExpr(RepeatUntil, $3, $5); }
+                | RETURN NL                                     { $$ = new ReturnExpr(NULL); }
+                | RETURN expr NL                                { $$ = new ReturnExpr($2); }
+                ;
+
+else_part       : ELSE NL statement_block                       { $$ = $3; }
+                | ELSEIF expr NL statement_block else_part      { $$ = append(NULL, new IfExpr($2, $4, $5)); }
+                |                                               { $$ = NULL; }
                 ;
 
 // dat blocks
@@ -250,20 +377,20 @@ pri_lines       :
 
 dat             : DAT NL dat_lines                              { $$ = new BlockExpr(DatBlock, $3); }
                 
-dat_lines       : dat_lines dat_line                            { $$ = $1; $1->append($2); }
-                |                                               { $$ = new QList<Expr *>(); }
+dat_lines       : dat_lines dat_line                            { $$ = append($1, $2); }
+                |                                               { $$ = NULL; }
                 ;
 
-dat_line        : dat_align dat_item dat_items NL               { $3->prepend($2); $$ = new DatLineExpr(new IdentExpr(""), $1, $3); }
-                | ident dat_align dat_item dat_items NL         { $4->prepend($3); $$ = new DatLineExpr($1, $2, $4); }
-                | ident NL dat_align dat_item dat_items NL      { $5->prepend($4); $$ = new DatLineExpr($1, $3, $5); }
+dat_line        : dat_align dat_items NL                        { $$ = new DatLineExpr(new IdentExpr("", @1.first_line, @1.first_column), $1, $2); }
+                | ident dat_align dat_items NL                  { $$ = new DatLineExpr($1, $2, $3); }
+                | ident NL dat_align dat_items NL               { $$ = new DatLineExpr($1, $3, $4); }
                 ;
 
 dat_align       : data_type
                 ;
 
-dat_items       : dat_items COMMA dat_item                      { $$ = $1; $$->append($3); }
-                |                                               { $$ = new QList<Expr *>(); }
+dat_items       : dat_item                                      { $$ = append(NULL, $1); }
+                | dat_items COMMA dat_item                      { $$ = append($1, $3); }
                 ;
 
 dat_item        : data_type expr array_index                    { $$ = new DatItemExpr($1,                 $2, $3); }
@@ -272,109 +399,144 @@ dat_item        : data_type expr array_index                    { $$ = new DatIt
                 | expr                                          { $$ = new DatItemExpr(new DataTypeExpr(), $1, new NumberExpr(10, 0)); }
                 ;
 
-// expression parsing
+// asm blocks
 // -----------------------------------------------------
 
-literal         : LITERAL expr                          { $$ = new LiteralExpr($2); }
-                ;
-
-array_index     : BRAC_L expr BRAC_R                    { $$ = new WrapExpr("[", $2, "]"); }
+asm             : ASM NL asm_lines                              { $$ = new BlockExpr(AsmBlock, $3); }
                 ;
 
-expr            : assign_expr
+asm_lines       : asm_lines asm_line                            { $$ = append($1, $2); }
+                |                                               { $$ = NULL; }
                 ;
 
-assign_expr     : bool_or_expr
-                | assign_expr ASSIGN     bool_or_expr   { $$ = new BinaryExpr($1, "=",   $3); }
-                | assign_expr ADD_ASSIGN bool_or_expr   { $$ = new BinaryExpr($1, "+=",  $3); }
-                | assign_expr SUB_ASSIGN bool_or_expr   { $$ = new BinaryExpr($1, "-=",  $3); }
-                | assign_expr MUL_ASSIGN bool_or_expr   { $$ = new BinaryExpr($1, "*=",  $3); }
-                | assign_expr MOD_ASSIGN bool_or_expr   { $$ = new BinaryExpr($1, "//=", $3); }
-                | assign_expr DIV_ASSIGN bool_or_expr   { $$ = new BinaryExpr($1, "/=",  $3); }
-                | assign_expr SHL_ASSIGN bool_or_expr   { $$ = new BinaryExpr($1, "<<=", $3); }
-                | assign_expr SHR_ASSIGN bool_or_expr   { $$ = new BinaryExpr($1, ">>=", $3); }
-                | assign_expr SAR_ASSIGN bool_or_expr   { $$ = new BinaryExpr($1, "~>=", $3); }
-                | assign_expr ROL_ASSIGN bool_or_expr   { $$ = new BinaryExpr($1, "<-=", $3); }
-                | assign_expr ROR_ASSIGN bool_or_expr   { $$ = new BinaryExpr($1, "->=", $3); }
-                | assign_expr REV_ASSIGN bool_or_expr   { $$ = new BinaryExpr($1, "><=", $3); }
-                | assign_expr AND_ASSIGN bool_or_expr   { $$ = new BinaryExpr($1, "&=",  $3); }
-                | assign_expr OR_ASSIGN  bool_or_expr   { $$ = new BinaryExpr($1, "|=",  $3); }
-                | assign_expr XOR_ASSIGN bool_or_expr   { $$ = new BinaryExpr($1, "^=",  $3); }
-
-
-bool_or_expr    : bool_and_expr
-                | bool_or_expr BOOL_OR bool_and_expr    { $$ = new BinaryExpr($1, "or", $3); }
+asm_line        : ident NL
+                    {
+                        AsmLineExpr * a = new AsmLineExpr($1, -1, -1, NULL, 0);
+                        a->locate(@1, @1);
+                        $$ = a;
+                    }
+                | asm_label asm_cond MNEMONIC asm_operands asm_effects NL
+                    {
+                        AsmLineExpr * a = new AsmLineExpr($1, $2, $3, $4, $5);
+                        a->locate(@3, @5);
+                        $$ = a;
+                    }
+                | asm_label dat_align dat_items NL
+                    {
+                        AsmLineExpr * a = new AsmLineExpr($1, new DatLineExpr(new IdentExpr(""), $2, $3));
+                        a->locate(@2, @3);
+                        $$ = a;
+                    }
                 ;
 
-bool_and_expr   : bool_not_expr
-                | bool_and_expr BOOL_AND bool_not_expr  { $$ = new BinaryExpr($1, "and", $3); }
+asm_label       : ident
+                |                                               { $$ = new IdentExpr(""); }
                 ;
 
-bool_not_expr   : relation_expr
-                | BOOL_NOT relation_expr                { $$ = new UnaryExpr("not", $2); }
+asm_cond        : CONDITION
+                |                                               { $$ = -1; }
                 ;
 
-relation_expr   : add_expr
-                | relation_expr EQ        add_expr  { $$ = new BinaryExpr($1, "==", $3); }
-                | relation_expr NEQ       add_expr  { $$ = new BinaryExpr($1, "<>", $3); }
-                | relation_expr LESS      add_expr  { $$ = new BinaryExpr($1, "<",  $3); }
-                | relation_expr GREATER   add_expr  { $$ = new BinaryExpr($1, ">",  $3); }
-                | relation_expr LESSEQ    add_expr  { $$ = new BinaryExpr($1, "<=", $3); }
-                | relation_expr GREATEREQ add_expr  { $$ = new BinaryExpr($1, ">=", $3); }
+asm_operands    : asm_operand_list
+                |                                               { $$ = NULL; }
                 ;
 
-add_expr        : mult_expr
-                | add_expr PLUS  mult_expr          { $$ = new BinaryExpr($1, "+", $3); }
-                | add_expr MINUS mult_expr          { $$ = new BinaryExpr($1, "-", $3); }
+asm_operand_list: asm_operand                                   { $$ = append(NULL, $1); }
+                | asm_operand_list COMMA asm_operand            { $$ = append($1, $3); }
                 ;
 
-mult_expr       : bw_or_expr
-                | mult_expr MUL bw_or_expr          { $$ = new BinaryExpr($1, "*",  $3); }
-                | mult_expr MOD bw_or_expr          { $$ = new BinaryExpr($1, "//", $3); }
-                | mult_expr DIV bw_or_expr          { $$ = new BinaryExpr($1, "/",  $3); }
+asm_operand     : expr
+                | literal
                 ;
 
-bw_or_expr      : bw_and_expr
-                | bw_or_expr BW_OR  bw_and_expr     { $$ = new BinaryExpr($1, "|", $3); }
-                | bw_or_expr BW_XOR bw_and_expr     { $$ = new BinaryExpr($1, "^", $3); }
+asm_effects     : asm_effect_list
+                |                                               { $$ = 0; }
                 ;
 
-bw_and_expr     : shift_expr
-                | bw_and_expr BW_AND shift_expr     { $$ = new BinaryExpr($1, "&", $3); }
+asm_effect_list : EFFECT                                        { $$ = pasmEffects[$1].effect; }
+                | asm_effect_list COMMA EFFECT                  { $$ = $1 | pasmEffects[$3].effect; }
                 ;
 
-shift_expr      : unary_expr
-                | shift_expr SHL unary_expr         { $$ = new BinaryExpr($1, "<<", $3); }
-                | shift_expr SHR unary_expr         { $$ = new BinaryExpr($1, ">>", $3); }
-                | shift_expr SAR unary_expr         { $$ = new BinaryExpr($1, "~>", $3); }
-                | shift_expr ROL unary_expr         { $$ = new BinaryExpr($1, "<-", $3); }
-                | shift_expr ROR unary_expr         { $$ = new BinaryExpr($1, "->", $3); }
-                | shift_expr REV unary_expr         { $$ = new BinaryExpr($1, "><", $3); }
-                ;
-
-unary_expr      : unary2_expr
-                | MINUS  unary2_expr    { $$ = new UnaryExpr("-", $2); }
-                | BW_NOT unary2_expr    { $$ = new UnaryExpr("!", $2); }
-                ;
+// expression parsing
+// -----------------------------------------------------
 
-unary2_expr     : factor
-                | DEC   factor          { $$ = new UnaryExpr("--", $2); }
-                | INC   factor          { $$ = new UnaryExpr("++", $2); }
-                | SET   factor          { $$ = new UnaryExpr("~~", $2); }
-                | CLEAR factor          { $$ = new UnaryExpr("~" , $2); }
-                | factor DEC            { $$ = new UnaryExpr($1, "--"); }
-                | factor INC            { $$ = new UnaryExpr($1, "++"); }
-                | factor SET            { $$ = new UnaryExpr($1, "~~"); }
-                | factor CLEAR          { $$ = new UnaryExpr($1, "~" ); }
+literal         : LITERAL expr                          { $$ = new LiteralExpr($2); }
                 ;
 
-factor          : primary_expr
-                | PAREN_L expr PAREN_R  { $$ = new WrapExpr("(", $2, ")"); }
+array_index     : BRAC_L expr BRAC_R                    { $$ = new WrapExpr("[", $2, "]"); }
                 ;
 
-primary_expr    : number
+expr            : expr ASSIGN     expr      { $$ = new BinaryExpr($1, "=",   $3); }
+                | expr ADD_ASSIGN expr      { $$ = new BinaryExpr($1, "+=",  $3); }
+                | expr SUB_ASSIGN expr      { $$ = new BinaryExpr($1, "-=",  $3); }
+                | expr MUL_ASSIGN expr      { $$ = new BinaryExpr($1, "*=",  $3); }
+                | expr MOD_ASSIGN expr      { $$ = new BinaryExpr($1, "//=", $3); }
+                | expr DIV_ASSIGN expr      { $$ = new BinaryExpr($1, "/=",  $3); }
+                | expr SHL_ASSIGN expr      { $$ = new BinaryExpr($1, "<<=", $3); }
+                | expr SHR_ASSIGN expr      { $$ = new BinaryExpr($1, ">>=", $3); }
+                | expr SAR_ASSIGN expr      { $$ = new BinaryExpr($1, "~>=", $3); }
+                | expr ROL_ASSIGN expr      { $$ = new BinaryExpr($1, "<-=", $3); }
+                | expr ROR_ASSIGN expr      { $$ = new BinaryExpr($1, "->=", $3); }
+                | expr REV_ASSIGN expr      { $$ = new BinaryExpr($1, "><=", $3); }
+                | expr AND_ASSIGN expr      { $$ = new BinaryExpr($1, "&=",  $3); }
+                | expr OR_ASSIGN  expr      { $$ = new BinaryExpr($1, "|=",  $3); }
+                | expr XOR_ASSIGN expr      { $$ = new BinaryExpr($1, "^=",  $3); }
+
+                | expr BOOL_OR  expr        { $$ = new BinaryExpr($1, "or",  $3); }
+                | expr BOOL_AND expr        { $$ = new BinaryExpr($1, "and", $3); }
+                | BOOL_NOT expr             { $$ = new UnaryExpr("not", $2); }
+
+                | expr EQ        expr       { $$ = new BinaryExpr($1, "==", $3); }
+                | expr NEQ       expr       { $$ = new BinaryExpr($1, "<>", $3); }
+                | expr LESS      expr       { $$ = new BinaryExpr($1, "<",  $3); }
+                | expr GREATER   expr       { $$ = new BinaryExpr($1, ">",  $3); }
+                | expr LESSEQ    expr       { $$ = new BinaryExpr($1, "<=", $3); }
+                | expr GREATEREQ expr       { $$ = new BinaryExpr($1, ">=", $3); }
+
+                | expr PLUS  expr           { $$ = new BinaryExpr($1, "+", $3); }
+                | expr MINUS expr           { $$ = new BinaryExpr($1, "-", $3); }
+
+                | expr MUL expr             { $$ = new BinaryExpr($1, "*",  $3); }
+                | expr MOD expr             { $$ = new BinaryExpr($1, "//", $3); }
+                | expr DIV expr             { $$ = new BinaryExpr($1, "/",  $3); }
+
+                | expr BW_OR  expr          { $$ = new BinaryExpr($1, "|", $3); }
+                | expr BW_XOR expr          { $$ = new BinaryExpr($1, "^", $3); }
+
+                | expr BW_AND expr          { $$ = new BinaryExpr($1, "&", $3); }
+
+                | expr SHL expr             { $$ = new BinaryExpr($1, "<<", $3); }
+                | expr SHR expr             { $$ = new BinaryExpr($1, ">>", $3); }
+                | expr SAR expr             { $$ = new BinaryExpr($1, "~>", $3); }
+                | expr ROL expr             { $$ = new BinaryExpr($1, "<-", $3); }
+                | expr ROR expr             { $$ = new BinaryExpr($1, "->", $3); }
+                | expr REV expr             { $$ = new BinaryExpr($1, "><", $3); }
+
+                | MINUS  expr %prec NEG     { $$ = new UnaryExpr("-", $2); }
+                | BW_NOT expr               { $$ = new UnaryExpr("!", $2); }
+
+                | DEC   expr                { $$ = new UnaryExpr("--", $2); }
+                | INC   expr                { $$ = new UnaryExpr("++", $2); }
+                | SET   expr                { $$ = new UnaryExpr("~~", $2); }
+                | CLEAR expr                { $$ = new UnaryExpr("~" , $2); }
+                | expr DEC                  { $$ = new UnaryExpr($1, "--"); }
+                | expr INC                  { $$ = new UnaryExpr($1, "++"); }
+                | expr SET                  { $$ = new UnaryExpr($1, "~~"); }
+                | expr CLEAR                { $$ = new UnaryExpr($1, "~" ); }
+
+                | PAREN_L expr PAREN_R      { $$ = new WrapExpr("(", $2, ")"); }
+                | ident PAREN_L expr_list PAREN_R
+                                            { $$ = new CallExpr($1, $3); }
+                | ident PAREN_L PAREN_R     { $$ = new CallExpr($1, NULL); }
+                | ident LITERAL ident       { $$ = qualify($1, $3); }
+                | number
                 | address
                 | ident
+                | STRING                    { $$ = new StringExpr(intern(state, $1)); }
+                ;
+
+expr_list       : expr                  { $$ = append(NULL, $1); }
+                | expr_list COMMA expr  { $$ = append($1, $3); }
                 ;
 
 address         : ADDR ident            { $$ = new AddressExpr($2, new NumberExpr(10, 0)); }
@@ -388,44 +550,50 @@ data_type       : BYTE                  { $$ = new DataTypeExpr(DataByte); }
                 | LONG                  { $$ = new DataTypeExpr(DataLong); }
                 ;
 
-number          : dec
-	            | bin
-	            | quat
-	            | hex
-	            ;
-
-dec             : DECIMAL               { $$ = new NumberExpr(10, $1); }
-                ;
-
-bin             : BINARY                { $$ = new NumberExpr(2, $1); }
+number          : DECIMAL               { $$ = new NumberExpr(10, $1); }
+                | BINARY                { $$ = new NumberExpr(2, $1); }
+                | QUATERNARY            { $$ = new NumberExpr(4, $1); }
+                | HEXADECIMAL           { $$ = new NumberExpr(16, $1); }
+                | FLOAT                 { $$ = new NumberExpr(10, floatToBits($1), true); }
                 ;
 
-quat            : QUATERNARY            { $$ = new NumberExpr(4, $1); }
-                ;
-
-hex             : HEXADECIMAL           { $$ = new NumberExpr(16, $1); }
-                ;
-
-ident           : IDENT                 { $$ = new IdentExpr($1); }
+ident           : IDENT                 { $$ = new IdentExpr(intern(state, $1), @1.first_line, @1.first_column); }
                 ;
 
 %%
 
 
-int yyerror (YYLTYPE *locp, char const *msg)
+int yyerror (YYLTYPE *locp, ParseState * state, void *, char const *msg)
+{
+    Diagnostic d;
+    d.line = locp->first_line;
+    d.first_column = locp->first_column;
+    d.last_column = locp->last_column;
+    d.message = msg;
+    d.text = locp->line;
+
+    state->diagnostics->append(d);
+    return 0;
+}
+
+// kind is the colour escape and the word, like "1;31merror"
+static void printDiagnostic(QString name, Diagnostic d, const char * kind)
 {
     fflush(stdout);
     fflush(stderr);
-	fprintf(stderr, "\n\033[1;37m%s(%i,%i) \033[1;31merror:\033[0m %s\n\n", qPrintable(filename), locp->first_line, locp->first_column, msg);
-    fprintf(stderr, "%s\n", qPrintable(locp->line));
-    fprintf(stderr, "%s", qPrintable(QString(locp->first_column - 1, ' ')));
-    fprintf(stderr, "\033[1;37m%s\033[0m\n", qPrintable(QString(locp->last_column - locp->first_column, '-')));
+	fprintf(stderr, "\n\033[1;37m%s(%i,%i) \033[%s:\033[0m %s\n\n", qPrintable(name), d.line, d.first_column, kind, qPrintable(d.message));
+    fprintf(stderr, "%s\n", qPrintable(d.text));
+    fprintf(stderr, "%s", qPrintable(QString(d.first_column - 1, ' ')));
+    fprintf(stderr, "\033[1;37m%s\033[0m\n", qPrintable(QString(d.last_column - d.first_column, '-')));
     fflush(stderr);
-	exit(-1);
 }
 
-void print(const char * s)
+void report(QString name, Diagnostic d)
 {
-    printf("%s '%s' ", s, yytext);
+    printDiagnostic(name, d, "1;31merror");
 }
 
+void warn(QString name, Diagnostic d)
+{
+    printDiagnostic(name, d, "1;33mwarning");
+}
@@ -0,0 +1,222 @@
+#include "pasm.h"
+
+#include <string.h>
+
+//  name      opcode  zcri  src    form
+
+#define PASM_MNEMONICS(X) \
+    X(wrbyte,   0x00,   0x0,  0x000, PasmDS)   \
+    X(rdbyte,   0x00,   0x2,  0x000, PasmDS)   \
+    X(wrword,   0x01,   0x0,  0x000, PasmDS)   \
+    X(rdword,   0x01,   0x2,  0x000, PasmDS)   \
+    X(wrlong,   0x02,   0x0,  0x000, PasmDS)   \
+    X(rdlong,   0x02,   0x2,  0x000, PasmDS)   \
+    X(clkset,   0x03,   0x1,  0x000, PasmD)    \
+    X(cogid,    0x03,   0x3,  0x001, PasmD)    \
+    X(coginit,  0x03,   0x1,  0x002, PasmD)    \
+    X(cogstop,  0x03,   0x1,  0x003, PasmD)    \
+    X(locknew,  0x03,   0x3,  0x004, PasmD)    \
+    X(lockret,  0x03,   0x1,  0x005, PasmD)    \
+    X(lockset,  0x03,   0x1,  0x006, PasmD)    \
+    X(lockclr,  0x03,   0x1,  0x007, PasmD)    \
+    X(ror,      0x08,   0x2,  0x000, PasmDS)   \
+    X(rol,      0x09,   0x2,  0x000, PasmDS)   \
+    X(shr,      0x0a,   0x2,  0x000, PasmDS)   \
+    X(shl,      0x0b,   0x2,  0x000, PasmDS)   \
+    X(rcr,      0x0c,   0x2,  0x000, PasmDS)   \
+    X(rcl,      0x0d,   0x2,  0x000, PasmDS)   \
+    X(sar,      0x0e,   0x2,  0x000, PasmDS)   \
+    X(rev,      0x0f,   0x2,  0x000, PasmDS)   \
+    X(mins,     0x10,   0x2,  0x000, PasmDS)   \
+    X(maxs,     0x11,   0x2,  0x000, PasmDS)   \
+    X(min,      0x12,   0x2,  0x000, PasmDS)   \
+    X(max,      0x13,   0x2,  0x000, PasmDS)   \
+    X(movs,     0x14,   0x2,  0x000, PasmDS)   \
+    X(movd,     0x15,   0x2,  0x000, PasmDS)   \
+    X(movi,     0x16,   0x2,  0x000, PasmDS)   \
+    X(jmpret,   0x17,   0x2,  0x000, PasmDS)   \
+    X(jmp,      0x17,   0x0,  0x000, PasmS)    \
+    X(call,     0x17,   0x3,  0x000, PasmCall) \
+    X(ret,      0x17,   0x1,  0x000, PasmNone) \
+    X(test,     0x18,   0x0,  0x000, PasmDS)   \
+    X(and,      0x18,   0x2,  0x000, PasmDS)   \
+    X(testn,    0x19,   0x0,  0x000, PasmDS)   \
+    X(andn,     0x19,   0x2,  0x000, PasmDS)   \
+    X(or,       0x1a,   0x2,  0x000, PasmDS)   \
+    X(xor,      0x1b,   0x2,  0x000, PasmDS)   \
+    X(muxc,     0x1c,   0x2,  0x000, PasmDS)   \
+    X(muxnc,    0x1d,   0x2,  0x000, PasmDS)   \
+    X(muxz,     0x1e,   0x2,  0x000, PasmDS)   \
+    X(muxnz,    0x1f,   0x2,  0x000, PasmDS)   \
+    X(add,      0x20,   0x2,  0x000, PasmDS)   \
+    X(sub,      0x21,   0x2,  0x000, PasmDS)   \
+    X(cmp,      0x21,   0x0,  0x000, PasmDS)   \
+    X(addabs,   0x22,   0x2,  0x000, PasmDS)   \
+    X(subabs,   0x23,   0x2,  0x000, PasmDS)   \
+    X(sumc,     0x24,   0x2,  0x000, PasmDS)   \
+    X(sumnc,    0x25,   0x2,  0x000, PasmDS)   \
+    X(sumz,     0x26,   0x2,  0x000, PasmDS)   \
+    X(sumnz,    0x27,   0x2,  0x000, PasmDS)   \
+    X(mov,      0x28,   0x2,  0x000, PasmDS)   \
+    X(neg,      0x29,   0x2,  0x000, PasmDS)   \
+    X(abs,      0x2a,   0x2,  0x000, PasmDS)   \
+    X(absneg,   0x2b,   0x2,  0x000, PasmDS)   \
+    X(negc,     0x2c,   0x2,  0x000, PasmDS)   \
+    X(negnc,    0x2d,   0x2,  0x000, PasmDS)   \
+    X(negz,     0x2e,   0x2,  0x000, PasmDS)   \
+    X(negnz,    0x2f,   0x2,  0x000, PasmDS)   \
+    X(cmps,     0x30,   0x0,  0x000, PasmDS)   \
+    X(cmpsx,    0x31,   0x0,  0x000, PasmDS)   \
+    X(addx,     0x32,   0x2,  0x000, PasmDS)   \
+    X(subx,     0x33,   0x2,  0x000, PasmDS)   \
+    X(cmpx,     0x33,   0x0,  0x000, PasmDS)   \
+    X(adds,     0x34,   0x2,  0x000, PasmDS)   \
+    X(subs,     0x35,   0x2,  0x000, PasmDS)   \
+    X(addsx,    0x36,   0x2,  0x000, PasmDS)   \
+    X(subsx,    0x37,   0x2,  0x000, PasmDS)   \
+    X(cmpsub,   0x38,   0x2,  0x000, PasmDS)   \
+    X(djnz,     0x39,   0x2,  0x000, PasmDS)   \
+    X(tjnz,     0x3a,   0x0,  0x000, PasmDS)   \
+    X(tjz,      0x3b,   0x0,  0x000, PasmDS)   \
+    X(waitpeq,  0x3c,   0x0,  0x000, PasmDS)   \
+    X(waitpne,  0x3d,   0x0,  0x000, PasmDS)   \
+    X(waitcnt,  0x3e,   0x2,  0x000, PasmDS)   \
+    X(waitvid,  0x3f,   0x0,  0x000, PasmDS)   \
+    X(nop,      0x00,   0x0,  0x000, PasmNone) \
+    X(org,      0x00,   0x0,  0x000, PasmOrg)  \
+    X(res,      0x00,   0x0,  0x000, PasmRes)  \
+    X(fit,      0x00,   0x0,  0x000, PasmFit)
+
+#define PASM_CONDITIONS(X) \
+    X(if_always,    0xf) \
+    X(if_never,     0x0) \
+    X(if_e,         0xa) \
+    X(if_ne,        0x5) \
+    X(if_a,         0x1) \
+    X(if_b,         0xc) \
+    X(if_ae,        0x3) \
+    X(if_be,        0xe) \
+    X(if_c,         0xc) \
+    X(if_nc,        0x3) \
+    X(if_z,         0xa) \
+    X(if_nz,        0x5) \
+    X(if_c_eq_z,    0x9) \
+    X(if_c_ne_z,    0x6) \
+    X(if_c_and_z,   0x8) \
+    X(if_c_and_nz,  0x4) \
+    X(if_nc_and_z,  0x2) \
+    X(if_nc_and_nz, 0x1) \
+    X(if_c_or_z,    0xe) \
+    X(if_c_or_nz,   0xd) \
+    X(if_nc_or_z,   0xb) \
+    X(if_nc_or_nz,  0x7) \
+    X(if_z_eq_c,    0x9) \
+    X(if_z_ne_c,    0x6) \
+    X(if_z_and_c,   0x8) \
+    X(if_z_and_nc,  0x2) \
+    X(if_nz_and_c,  0x4) \
+    X(if_nz_and_nc, 0x1) \
+    X(if_z_or_c,    0xe) \
+    X(if_z_or_nc,   0xb) \
+    X(if_nz_or_c,   0xd) \
+    X(if_nz_or_nc,  0x7)
+
+#define PASM_EFFECTS(X) \
+    X(wz,   EffectZ)    \
+    X(wc,   EffectC)    \
+    X(wr,   EffectR)    \
+    X(nr,   EffectNR)
+
+#define PASM_REGISTERS(X) \
+    X(par,  0x1f0)  \
+    X(cnt,  0x1f1)  \
+    X(ina,  0x1f2)  \
+    X(inb,  0x1f3)  \
+    X(outa, 0x1f4)  \
+    X(outb, 0x1f5)  \
+    X(dira, 0x1f6)  \
+    X(dirb, 0x1f7)  \
+    X(ctra, 0x1f8)  \
+    X(ctrb, 0x1f9)  \
+    X(frqa, 0x1fa)  \
+    X(frqb, 0x1fb)  \
+    X(phsa, 0x1fc)  \
+    X(phsb, 0x1fd)  \
+    X(vcfg, 0x1fe)  \
+    X(vscl, 0x1ff)
+
+#define MNEMONIC_ENTRY(name, op, zcri, src, form) \
+    { #name, ((quint32) (op) << 26) | ((quint32) (zcri) << 22) | (src), form },
+#define CONDITION_ENTRY(name, code) { #name, code },
+#define EFFECT_ENTRY(name, effect)  { #name, effect },
+#define REGISTER_ENTRY(name, address) { #name, address },
+
+const PasmMnemonic pasmMnemonics[] = { PASM_MNEMONICS(MNEMONIC_ENTRY) };
+const PasmCondition pasmConditions[] = { PASM_CONDITIONS(CONDITION_ENTRY) };
+const PasmEffectName pasmEffects[] = { PASM_EFFECTS(EFFECT_ENTRY) };
+const PasmRegister pasmRegisters[] = { PASM_REGISTERS(REGISTER_ENTRY) };
+
+const int pasmMnemonicCount = sizeof(pasmMnemonics) / sizeof(pasmMnemonics[0]);
+const int pasmConditionCount = sizeof(pasmConditions) / sizeof(pasmConditions[0]);
+const int pasmEffectCount = sizeof(pasmEffects) / sizeof(pasmEffects[0]);
+const int pasmRegisterCount = sizeof(pasmRegisters) / sizeof(pasmRegisters[0]);
+
+#define MNEMONIC_INDEX(name, op, zcri, src, form) Mnemonic_##name,
+#define CONDITION_INDEX(name, code) Condition_##name,
+#define EFFECT_INDEX(name, effect)  Effect_##name,
+
+enum { PASM_MNEMONICS(MNEMONIC_INDEX) };
+enum { PASM_CONDITIONS(CONDITION_INDEX) };
+enum { PASM_EFFECTS(EFFECT_INDEX) };
+
+/*
+ * FNV-1a, evaluated at compile time for every case label below. Each
+ * word gets its own case, so a hash collision between any two words is
+ * a duplicate case label and fails the build: the switch is a perfect
+ * hash that the compiler turns into a jump table or a binary search.
+ */
+
+static constexpr quint32 pasmHash(const char * s, quint32 h = 2166136261u)
+{
+    return *s ? pasmHash(s + 1, (h ^ (quint8) *s) * 16777619u) : h;
+}
+
+#define MNEMONIC_CASE(name, op, zcri, src, form) \
+    case pasmHash(#name): \
+        if (strcmp(word, #name) == 0) { w.kind = PasmMnemonicWord; w.index = Mnemonic_##name; } \
+        break;
+#define CONDITION_CASE(name, code) \
+    case pasmHash(#name): \
+        if (strcmp(word, #name) == 0) { w.kind = PasmConditionWord; w.index = Condition_##name; } \
+        break;
+#define EFFECT_CASE(name, effect) \
+    case pasmHash(#name): \
+        if (strcmp(word, #name) == 0) { w.kind = PasmEffectWord; w.index = Effect_##name; } \
+        break;
+
+PasmWord pasmLookup(const char * text)
+{
+    PasmWord w;
+    w.kind = PasmUnknown;
+    w.index = -1;
+
+    char word[16];
+    int i = 0;
+    for (; text[i] != '\0'; i++)
+    {
+        if (i == sizeof(word) - 1)
+            return w;
+
+        word[i] = (text[i] >= 'A' && text[i] <= 'Z') ? text[i] - 'A' + 'a' : text[i];
+    }
+    word[i] = '\0';
+
+    switch (pasmHash(word))
+    {
+        PASM_MNEMONICS(MNEMONIC_CASE)
+        PASM_CONDITIONS(CONDITION_CASE)
+        PASM_EFFECTS(EFFECT_CASE)
+    }
+
+    return w;
+}
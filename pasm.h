@@ -0,0 +1,80 @@
+#pragma once
+
+#include <QtGlobal>
+
+/*
+ * Propeller assembly vocabulary.
+ *
+ * Instructions are stored with their opcode, default ZCRI bits and any
+ * fixed source field already in place; the condition, destination and
+ * source are filled in by the assembler.
+ */
+
+enum PasmForm {
+    PasmNone,       // nop, ret
+    PasmDS,         // mov d, s
+    PasmS,          // jmp s
+    PasmD,          // cogid d
+    PasmCall,       // call #label
+    PasmOrg,
+    PasmRes,
+    PasmFit
+};
+
+enum PasmKind {
+    PasmUnknown,
+    PasmMnemonicWord,
+    PasmConditionWord,
+    PasmEffectWord
+};
+
+enum PasmEffect {
+    EffectZ     = 1,
+    EffectC     = 2,
+    EffectR     = 4,
+    EffectNR    = 8
+};
+
+struct PasmMnemonic
+{
+    const char * name;
+    quint32 bits;
+    PasmForm form;
+};
+
+struct PasmCondition
+{
+    const char * name;
+    quint32 code;
+};
+
+struct PasmEffectName
+{
+    const char * name;
+    int effect;
+};
+
+// the cog registers at the top of its memory, named in any operand
+struct PasmRegister
+{
+    const char * name;
+    quint32 address;
+};
+
+struct PasmWord
+{
+    PasmKind kind;
+    int index;
+};
+
+extern const PasmMnemonic pasmMnemonics[];
+extern const PasmCondition pasmConditions[];
+extern const PasmEffectName pasmEffects[];
+extern const PasmRegister pasmRegisters[];
+
+extern const int pasmMnemonicCount;
+extern const int pasmConditionCount;
+extern const int pasmEffectCount;
+extern const int pasmRegisterCount;
+
+PasmWord pasmLookup(const char * text);
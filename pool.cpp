@@ -0,0 +1,57 @@
+#include "pool.h"
+
+ConstantPool::ConstantPool()
+{
+    clear();
+}
+
+void ConstantPool::clear()
+{
+    _offsets.clear();
+    _strings.clear();
+    _data.clear();
+    _requested = 0;
+}
+
+// a payload that may be written to is never shared, and never reused
+int ConstantPool::add(const QByteArray & payload, int align, bool share)
+{
+    _requested += payload.size();
+
+    if (share && _offsets.contains(payload) && _offsets[payload] % align == 0)
+        return _offsets[payload];
+
+    while (_data.size() % align)
+        _data.append('\0');
+
+    int offset = _data.size();
+    _data.append(payload);
+
+    if (share && !_offsets.contains(payload))
+        _offsets[payload] = offset;
+    return offset;
+}
+
+// strings are stored with a zero byte after them
+int ConstantPool::intern(const QString & string)
+{
+    QByteArray payload = string.toLatin1();
+    payload.append('\0');
+
+    if (!_offsets.contains(payload))
+    {
+        foreach (int s, _strings)
+        {
+            int end = _data.indexOf('\0', s) + 1;
+            if (end - s > payload.size() && _data.mid(s, end - s).endsWith(payload))
+            {
+                _requested += payload.size();
+                return end - payload.size();
+            }
+        }
+
+        _strings.append(_data.size());
+    }
+
+    return add(payload, 1);
+}
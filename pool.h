@@ -0,0 +1,33 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QList>
+#include <QString>
+
+/*
+ * Read-only data of an object image, each distinct payload stored once.
+ *
+ * Payloads are looked up by content, so a table or string that appears
+ * in several places is emitted at the first place and every later use
+ * gets that offset. Strings are also found at the end of longer strings
+ * already in the pool, since "ok" ends with the same bytes as "not ok".
+ *
+ * Offsets are from the start of the pool.
+ */
+
+class ConstantPool
+{
+    QHash<QByteArray, int> _offsets;
+    QList<int> _strings;
+
+public:
+    QByteArray _data;
+    int _requested;
+
+    ConstantPool();
+
+    void clear();
+    int add(const QByteArray & payload, int align, bool share = true);
+    int intern(const QString & string);
+};
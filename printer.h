@@ -1,161 +1,597 @@
 #pragma once
 
-#include "tree.h"
+#include "walker.h"
+#include "pasm.h"
 
-class Printer : public AbstractVisitor
+#include <QVector>
+#include <stdarg.h>
+
+/*
+ * Writes a tree back out as Spin source.
+ *
+ * Each node writes its own text when it is entered and left, and the
+ * text between children, such as an operator or a comma, is written by
+ * the parent as each child is entered and left. The nodes being printed
+ * are kept on a stack of our own, so a tree of any depth can be printed.
+ */
+
+class Printer : public Walker<Printer>
 {
-    void visit(NumberExpr & expr)
+    // a node being printed, and how many of its children are done
+    struct Frame
     {
-        switch (expr._base)
-        {
-            case 2: printf("%%");
-            case 4: printf("%%%%");
-            case 16: printf("$");
-        }
-        if (expr._base == 10)
-            printf("%s", qPrintable(QString::number((qint32) expr.num)));
-        else
-            printf("%s", qPrintable(QString::number(expr.num, expr._base)));
+        Expr * expr;
+        int done;
+    };
+
+    enum MethodPart { MethodName, MethodParam, MethodResult, MethodLocal, MethodStatement };
+
+    QVector<Frame> _frames;
+    int _indent;
+    Expr * _muted;
+
+    void put(const char * format, ...)
+    {
+        if (_muted != NULL)
+            return;
+
+        va_list args;
+        va_start(args, format);
+        vprintf(format, args);
+        va_end(args);
     }
 
-    void visit(IdentExpr & expr)
+    void newline()
     {
-        printf("%s", qPrintable(expr._ident));
+        put("\n%s", qPrintable(QString(_indent * 4, ' ')));
     }
 
-    void visit(AddressExpr & expr)
+    // leaves a child out, along with everything under it
+    void mute(Expr * child)
     {
-        if (expr._offset->value() != 0)
-        {
-            expr._ident->accept(*this);
-            printf("[");
-            expr._offset->accept(*this);
-            printf("]");
-        }
-        else
-        {
-            printf("@");
-            expr._ident->accept(*this);
-        }
+        if (_muted == NULL)
+            _muted = child;
     }
 
-    void visit(LiteralExpr & expr)
+    // each statement of a body goes on a line of its own, one level in
+    void statement(int index)
     {
-        printf("#");
-        expr._val->accept(*this);
+        if (index == 0)
+            _indent++;
+        newline();
     }
 
-    void visit(DataTypeExpr & expr)
+    void statementDone(int index, int count)
     {
-        printf("%s",qPrintable(expr.ident()));
+        if (index == count - 1)
+            _indent--;
     }
 
-    void visit(BlockExpr & expr)
+    static const char * blockName(Block block)
     {
-        QString s;
-        switch (expr._block)
+        switch (block)
         {
-            case NoBlock:  break; ;;
-            case ConBlock: s = "CON"; break; ;;
-            case VarBlock: s = "VAR"; break; ;;
-            case ObjBlock: s = "OBJ"; break; ;;
-            case PubBlock: s = "PUB"; break; ;;
-            case PriBlock: s = "PRI"; break; ;;
-            case DatBlock: s = "DAT"; break; ;;
-            case AsmBlock: s = "ASM"; break; ;;
+            case NoBlock:  return "";
+            case ConBlock: return "CON";
+            case VarBlock: return "VAR";
+            case ObjBlock: return "OBJ";
+            case PubBlock: return "PUB";
+            case PriBlock: return "PRI";
+            case DatBlock: return "DAT";
+            case AsmBlock: return "ASM";
         }
-        printf("%s\n",qPrintable(s));
+        return "";
+    }
 
-        foreach(Expr * l, *expr._lines)
-        {
-            printf("    ");
-            l->accept(*this);
-            printf("\n");
-        }
-        printf("\n");
+    static bool isMethods(BlockExpr * block)
+    {
+        return block->_block == PubBlock || block->_block == PriBlock;
+    }
+
+    // a line with a mnemonic, rather than only a label or data
+    static bool isInstruction(AsmLineExpr * line)
+    {
+        if (line->_data != NULL)
+            return false;
+        return line->_mnemonic >= 0 || line->_label->ident().isEmpty();
+    }
+
+    static bool isElseIf(IfExpr * expr)
+    {
+        return expr->_else.size() == 1 && expr->_else.first()->_kind == IfKind;
     }
 
-    void visit(DatLineExpr & expr)
+    // which part of a method the child at index is, and where in that part
+    static MethodPart methodPart(MethodExpr * method, int index, int & at)
     {
-        if (!(expr._symbol->ident().isEmpty()))
-            printf("%s\n    ", qPrintable(expr._symbol->ident()));
+        at = index;
+        if (at == 0)
+            return MethodName;
 
-        printf("%-8s", qPrintable(expr._align->ident()));
+        at -= 1;
+        if (at < method->_params.size())
+            return MethodParam;
 
-        for (int i = 0; i < expr._items->size(); i++)
+        at -= method->_params.size();
+        if (method->_result != NULL)
         {
-            (*expr._items)[i]->accept(*this);
-            if (i < expr._items->size()-1)
-                printf(", ");
+            if (at == 0)
+                return MethodResult;
+            at -= 1;
         }
+
+        if (at < method->_locals.size())
+            return MethodLocal;
+
+        at -= method->_locals.size();
+        return MethodStatement;
     }
 
-    void visit(DatItemExpr & expr)
+    void open(Expr * expr)
     {
-        if (!(expr._size->ident().isEmpty()))
+        switch (expr->_kind)
         {
-            expr._size->accept(*this);
-            printf(" ");
-        }
+            case NumberKind:
+            {
+                NumberExpr * e = static_cast<NumberExpr *>(expr);
+                if (e->_float)
+                {
+                    QString f = QString::number(bitsToFloat(e->num), 'g', 9);
+                    if (!f.contains('.') && !f.contains('e'))
+                        f += ".0";
+                    put("%s", qPrintable(f));
+                    break;
+                }
 
-        expr._data->accept(*this);
+                switch (e->_base)
+                {
+                    case 2: put("%%");
+                    case 4: put("%%%%");
+                    case 16: put("$");
+                }
+                if (e->_base == 10)
+                    put("%s", qPrintable(QString::number((qint32) e->num)));
+                else
+                    put("%s", qPrintable(QString::number(e->num, e->_base)));
+                break;
+            }
 
-        if (expr._count->value())
-        {
-            printf(" ");
-            expr._count->accept(*this);
+            case IdentKind:
+                put("%s", qPrintable(static_cast<IdentExpr *>(expr)->qualified()));
+                break;
+
+            case AddressKind:
+                if (static_cast<AddressExpr *>(expr)->_offset->value() == 0)
+                    put("@");
+                break;
+
+            case LiteralKind:
+                put("#");
+                break;
+
+            case DataTypeKind:
+                put("%s", qPrintable(static_cast<DataTypeExpr *>(expr)->ident()));
+                break;
+
+            case BlockKind:
+            {
+                BlockExpr * e = static_cast<BlockExpr *>(expr);
+                if (!isMethods(e))
+                    put("%s\n", blockName(e->_block));
+                break;
+            }
+
+            case DatLineKind:
+            {
+                DatLineExpr * e = static_cast<DatLineExpr *>(expr);
+                if (!(e->_symbol->ident().isEmpty()))
+                    put("%s\n    ", qPrintable(e->_symbol->ident()));
+
+                put("%-8s", qPrintable(e->_align->ident()));
+                break;
+            }
+
+            case UnaryKind:
+            {
+                UnaryExpr * e = static_cast<UnaryExpr *>(expr);
+                if (!e->_post)
+                    put("%s", e->_op.latin1());
+                break;
+            }
+
+            case WrapKind:
+                put("%s", static_cast<WrapExpr *>(expr)->_left.latin1());
+                break;
+
+            case StringKind:
+                put("\"%s\"", qPrintable(static_cast<StringExpr *>(expr)->_string));
+                break;
+
+            case VarLineKind:
+                put("%-8s", qPrintable(static_cast<VarLineExpr *>(expr)->_type->ident()));
+                break;
+
+            case IfKind:
+                put("if ");
+                break;
+
+            case RepeatKind:
+                put("repeat");
+
+                switch (static_cast<RepeatExpr *>(expr)->_repeat)
+                {
+                    case RepeatForever: break;
+                    case RepeatCount:   put(" "); break;
+                    case RepeatWhile:   put(" while "); break;
+                    case RepeatUntil:   put(" until "); break;
+                }
+                break;
+
+            case ReturnKind:
+                put("return");
+                break;
+
+            default:
+                break;
         }
     }
 
-    void visit(UnaryExpr & expr)
+    void close(Expr * expr)
     {
-        if (expr._post)
+        switch (expr->_kind)
         {
-            expr._val->accept(*this);
-            printf("%s", qPrintable(expr._op));
+            case BlockKind:
+                if (!isMethods(static_cast<BlockExpr *>(expr)))
+                    put("\n");
+                break;
+
+            case UnaryKind:
+            {
+                UnaryExpr * e = static_cast<UnaryExpr *>(expr);
+                if (e->_post)
+                    put("%s", e->_op.latin1());
+                break;
+            }
+
+            case WrapKind:
+                put("%s", static_cast<WrapExpr *>(expr)->_right.latin1());
+                break;
+
+            case AsmLineKind:
+            {
+                AsmLineExpr * e = static_cast<AsmLineExpr *>(expr);
+                if (!isInstruction(e))
+                    break;
+
+                const char * separator = " ";
+                for (int i = 0; i < pasmEffectCount; i++)
+                {
+                    if (e->_effects & pasmEffects[i].effect)
+                    {
+                        put("%s%s", separator, pasmEffects[i].name);
+                        separator = ", ";
+                    }
+                }
+                break;
+            }
+
+            case CallKind:
+                put(")");
+                break;
+
+            default:
+                break;
         }
-        else
+    }
+
+    // the text a parent writes before the child at index
+    void before(Expr * parent, int index, Expr * child)
+    {
+        switch (parent->_kind)
         {
-            printf("%s", qPrintable(expr._op));
-            expr._val->accept(*this);
+            case AddressKind:
+            {
+                AddressExpr * e = static_cast<AddressExpr *>(parent);
+                if (child != e->_offset)
+                    break;
+
+                if (e->_offset->value() != 0)
+                    put("[");
+                else
+                    mute(child);
+                break;
+            }
+
+            case BlockKind:
+            {
+                BlockExpr * e = static_cast<BlockExpr *>(parent);
+                if (isMethods(e))
+                    put("%s ", blockName(e->_block));
+                else
+                    put("    ");
+                break;
+            }
+
+            case DatLineKind:
+            {
+                DatLineExpr * e = static_cast<DatLineExpr *>(parent);
+                if (child == e->_symbol || child == e->_align)
+                    mute(child);
+                else if (child != e->_items.first())
+                    put(", ");
+                break;
+            }
+
+            case DatItemKind:
+            {
+                DatItemExpr * e = static_cast<DatItemExpr *>(parent);
+                if (child == e->_size && e->_size->ident().isEmpty())
+                    mute(child);
+
+                if (child == e->_count)
+                {
+                    if (e->_count->value())
+                        put(" ");
+                    else
+                        mute(child);
+                }
+                break;
+            }
+
+            case ObjLineKind:
+            {
+                ObjLineExpr * e = static_cast<ObjLineExpr *>(parent);
+                if (child == e->_count && !e->_count->value())
+                    mute(child);
+                else if (child == e->_file)
+                    put(" : ");
+                break;
+            }
+
+            case VarLineKind:
+            {
+                VarLineExpr * e = static_cast<VarLineExpr *>(parent);
+                if (child == e->_type || (child == e->_count && !e->value()))
+                    mute(child);
+                break;
+            }
+
+            case AsmLineKind:
+            {
+                AsmLineExpr * e = static_cast<AsmLineExpr *>(parent);
+                if (child == e->_label)
+                {
+                    if (e->_label->ident().isEmpty())
+                        mute(child);
+                }
+                else if (child != e->_data)
+                {
+                    if (!isInstruction(e))
+                        mute(child);
+                    else if (child != e->_operands.first())
+                        put(", ");
+                }
+                break;
+            }
+
+            case MethodKind:
+            {
+                int at;
+                switch (methodPart(static_cast<MethodExpr *>(parent), index, at))
+                {
+                    case MethodName:      break;
+                    case MethodParam:     put(at == 0 ? "(" : ", "); break;
+                    case MethodResult:    put(" : "); break;
+                    case MethodLocal:     put(at == 0 ? " | " : ", "); break;
+                    case MethodStatement: statement(at); break;
+                }
+                break;
+            }
+
+            case CallKind:
+            {
+                CallExpr * e = static_cast<CallExpr *>(parent);
+                if (child != e->_name && child != e->_args.first())
+                    put(", ");
+                break;
+            }
+
+            case IfKind:
+            {
+                IfExpr * e = static_cast<IfExpr *>(parent);
+                int at = index - 1;
+                if (at < 0)
+                    break;
+
+                if (at < e->_then.size())
+                {
+                    statement(at);
+                    break;
+                }
+
+                at -= e->_then.size();
+                if (at == 0)
+                {
+                    newline();
+                    put("else");
+                }
+
+                if (!isElseIf(e))
+                    statement(at);
+                break;
+            }
+
+            case RepeatKind:
+            {
+                RepeatExpr * e = static_cast<RepeatExpr *>(parent);
+                if (child != e->_condition)
+                    statement(e->_condition != NULL ? index - 1 : index);
+                break;
+            }
+
+            case ReturnKind:
+                put(" ");
+                break;
+
+            default:
+                break;
         }
     }
 
-    void visit(BinaryExpr & expr)
+    // the text a parent writes after the child at index
+    void after(Expr * parent, int index, Expr * child)
     {
-        expr._left->accept(*this);
-        printf(" %s ", qPrintable(expr._op));
-        expr._right->accept(*this);
+        switch (parent->_kind)
+        {
+            case AddressKind:
+            {
+                AddressExpr * e = static_cast<AddressExpr *>(parent);
+                if (child == e->_offset && e->_offset->value() != 0)
+                    put("]");
+                break;
+            }
+
+            case BlockKind:
+                put(isMethods(static_cast<BlockExpr *>(parent)) ? "\n\n" : "\n");
+                break;
+
+            case DatItemKind:
+            {
+                DatItemExpr * e = static_cast<DatItemExpr *>(parent);
+                if (child == e->_size && !e->_size->ident().isEmpty())
+                    put(" ");
+                break;
+            }
+
+            case BinaryKind:
+            {
+                BinaryExpr * e = static_cast<BinaryExpr *>(parent);
+                if (child == e->_left)
+                    put(" %s ", e->_op.latin1());
+                break;
+            }
+
+            case ConAssignKind:
+                if (child == static_cast<ConAssignExpr *>(parent)->_ident)
+                    put(" = ");
+                break;
+
+            case AsmLineKind:
+            {
+                AsmLineExpr * e = static_cast<AsmLineExpr *>(parent);
+                if (child != e->_label)
+                    break;
+
+                bool labeled = !e->_label->ident().isEmpty();
+                if (labeled && e->_mnemonic < 0 && e->_data == NULL)
+                    break;
+
+                if (labeled)
+                    put("\n    ");
+
+                if (e->_data == NULL)
+                {
+                    if (e->_condition >= 0)
+                        put("%s ", pasmConditions[e->_condition].name);
+
+                    put("%-8s", pasmMnemonics[e->_mnemonic].name);
+                }
+                break;
+            }
+
+            case MethodKind:
+            {
+                MethodExpr * e = static_cast<MethodExpr *>(parent);
+                int at;
+                switch (methodPart(e, index, at))
+                {
+                    case MethodParam:
+                        if (at == e->_params.size() - 1)
+                            put(")");
+                        break;
+
+                    case MethodStatement:
+                        statementDone(at, e->_body.size());
+                        break;
+
+                    default:
+                        break;
+                }
+                break;
+            }
+
+            case CallKind:
+                if (child == static_cast<CallExpr *>(parent)->_name)
+                    put("(");
+                break;
+
+            case IfKind:
+            {
+                IfExpr * e = static_cast<IfExpr *>(parent);
+                int at = index - 1;
+                if (at < 0)
+                    break;
+
+                if (at < e->_then.size())
+                    statementDone(at, e->_then.size());
+                else if (!isElseIf(e))
+                    statementDone(at - e->_then.size(), e->_else.size());
+                break;
+            }
+
+            case RepeatKind:
+            {
+                RepeatExpr * e = static_cast<RepeatExpr *>(parent);
+                if (child != e->_condition)
+                    statementDone(e->_condition != NULL ? index - 1 : index, e->_body.size());
+                break;
+            }
+
+            default:
+                break;
+        }
     }
 
-    void visit(WrapExpr & expr)
+public:
+    static const bool leaves = true;
+
+    Printer()
     {
-        printf("%s", qPrintable(expr._left));
-        expr._val->accept(*this);
-        printf("%s", qPrintable(expr._right));
+        _indent = 0;
+        _muted = NULL;
     }
 
-    void visit(ObjectExpr & expr)
+    template <class T>
+    void visit(T & expr)
     {
-        foreach(Expr * b, *expr._blocks)
-        {
-            b->accept(*this);
-        }
+        if (!_frames.isEmpty())
+            before(_frames.last().expr, _frames.last().done, &expr);
+
+        Frame frame = { &expr, 0 };
+        _frames.append(frame);
+        open(&expr);
     }
 
-    void visit(ConAssignExpr & expr)
+    template <class T>
+    void leave(T & expr)
     {
-        expr._ident->accept(*this);
-        printf(" = ");
-        expr.expr->accept(*this);
-    }
+        close(&expr);
+        _frames.removeLast();
 
+        if (_muted == &expr)
+            _muted = NULL;
+
+        if (!_frames.isEmpty())
+        {
+            Frame & parent = _frames.last();
+            after(parent.expr, parent.done++, &expr);
+        }
+    }
 
-public:
     void print(Expr * root)
     {
-        root->accept(*this);
+        _frames.clear();
+        _muted = NULL;
+        walk(root);
     }
 };
-
-
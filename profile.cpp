@@ -0,0 +1,62 @@
+#include "profile.h"
+
+static void appendLong(QByteArray & data, quint32 value)
+{
+    for (int b = 0; b < 4; b++)
+        data.append((char) (value >> (8 * b)));
+}
+
+static quint32 readLong(const QByteArray & data, int at)
+{
+    quint32 value = 0;
+    for (int b = 3; b >= 0; b--)
+        value = value << 8 | (quint8) data[at + b];
+    return value;
+}
+
+QByteArray profileBuffer(int methods)
+{
+    QByteArray data;
+    appendLong(data, ProfileMagic);
+    appendLong(data, methods);
+
+    for (int i = 0; i < ProfileEntry * methods; i++)
+        data.append('\0');
+    return data;
+}
+
+bool decodeProfile(const Emitter & emitter, const QByteArray & dump,
+                   QList<TargetProfile> & profile, QString & error)
+{
+    profile.clear();
+
+    if (dump.size() < ProfileHeader || readLong(dump, 0) != ProfileMagic)
+    {
+        error = "not a profile buffer";
+        return false;
+    }
+
+    if ((int) readLong(dump, 4) != emitter._methods.size())
+    {
+        error = QString("buffer counts %1 methods, but the object has %2")
+                .arg(readLong(dump, 4)).arg(emitter._methods.size());
+        return false;
+    }
+
+    if (dump.size() < ProfileHeader + ProfileEntry * emitter._methods.size())
+    {
+        error = "profile buffer is cut short";
+        return false;
+    }
+
+    for (int i = 0; i < emitter._methods.size(); i++)
+    {
+        TargetProfile p;
+        p.name = emitter._methods[i].method->_name->_ident;
+        p.calls = readLong(dump, ProfileHeader + ProfileEntry * i);
+        p.cycles = readLong(dump, ProfileHeader + ProfileEntry * i + 4);
+        profile.append(p);
+    }
+
+    return true;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "emitter.h"
+
+/*
+ * The buffer that code compiled with --profile counts into.
+ *
+ * It starts with ProfileMagic and the number of methods, then holds two
+ * longs for each method, in the order of Emitter::_methods: how often it
+ * was called, and the CNT cycles spent in it, callees included. Both
+ * wrap around like CNT does.
+ */
+
+static const quint32 ProfileMagic = 0x46525053;   // "SPRF"
+static const int ProfileHeader = 8;
+static const int ProfileEntry = 8;
+static const quint32 ProfileClock = 0x1f1;        // CNT
+
+struct TargetProfile
+{
+    QString name;
+    quint32 calls;
+    quint32 cycles;
+};
+
+QByteArray profileBuffer(int methods);
+
+// reads back a buffer dumped from the chip, using the build that made it
+bool decodeProfile(const Emitter & emitter, const QByteArray & dump,
+                   QList<TargetProfile> & profile, QString & error);
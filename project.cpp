@@ -0,0 +1,323 @@
+#include "project.h"
+#include "parse.h"
+#include "folder.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+static QString absolute(QString path)
+{
+    return QDir::cleanPath(QFileInfo(path).absoluteFilePath());
+}
+
+Project::Project(ObjectResolver & resolver)
+    : _resolver(resolver)
+{
+    _parses = 0;
+}
+
+Project::~Project()
+{
+    foreach (ObjectExpr * o, _users.keys()) { delete o; }
+}
+
+// a tree with the same text can stand in for path if its OBJ lines
+// find the same files from path's directory
+ObjectExpr * Project::share(QString path, QByteArray hash)
+{
+    QString from = QFileInfo(path).absolutePath();
+
+    foreach (ObjectExpr * object, _shared.value(hash))
+    {
+        bool same = true;
+
+        for (Expr * b : object->_blocks)
+        {
+            BlockExpr * block = (BlockExpr *) b;
+            if (block->_block != ObjBlock) continue;
+
+            for (Expr * l : block->_lines)
+            {
+                ObjLineExpr * line = (ObjLineExpr *) l;
+                QString found = _resolver.resolve(line->_file->_string, from);
+
+                if (found.isEmpty() || absolute(found) != line->_path)
+                    same = false;
+            }
+        }
+
+        if (same)
+            return object;
+    }
+
+    return NULL;
+}
+
+void Project::release(ObjectExpr * object)
+{
+    if (object == NULL || --_users[object] > 0)
+        return;
+
+    _users.remove(object);
+    foreach (QByteArray hash, _shared.keys())
+    {
+        _shared[hash].removeAll(object);
+        if (_shared[hash].isEmpty())
+            _shared.remove(hash);
+    }
+
+    delete object;
+}
+
+bool Project::build(QString path)
+{
+    if (_objects.contains(path))
+        return true;
+
+    _failed.insert(path);
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+    {
+        fprintf(stderr, "cannot open %s\n", qPrintable(path));
+        return false;
+    }
+
+    QByteArray text = file.readAll();
+    QByteArray hash = QCryptographicHash::hash(text, QCryptographicHash::Sha1);
+
+    bool ok = true;
+    bool clean = true;
+    bool parsed = false;
+    ObjectExpr * object = share(path, hash);
+
+    if (object == NULL)
+    {
+        QList<Diagnostic> diagnostics;
+        object = parse(path, text, &diagnostics);
+        _parses++;
+
+        foreach (Diagnostic d, diagnostics)
+            report(path, d);
+
+        if (object == NULL)
+            return false;
+
+        ok = clean = _resolver.resolve(object) && diagnostics.isEmpty();
+        parsed = true;
+
+        for (Expr * b : object->_blocks)
+        {
+            BlockExpr * block = (BlockExpr *) b;
+            if (block->_block != ObjBlock) continue;
+
+            for (Expr * l : block->_lines)
+            {
+                ObjLineExpr * line = (ObjLineExpr *) l;
+                if (!line->_path.isEmpty())
+                    line->_path = absolute(line->_path);
+            }
+        }
+    }
+
+    _users[object]++;
+    _objects[path] = object;
+    _children[path] = QStringList();
+    _failed.remove(path);
+
+    for (Expr * b : object->_blocks)
+    {
+        BlockExpr * block = (BlockExpr *) b;
+        if (block->_block != ObjBlock) continue;
+
+        for (Expr * l : block->_lines)
+        {
+            ObjLineExpr * line = (ObjLineExpr *) l;
+            if (line->_path.isEmpty())
+            {
+                _missing.insert(path);
+                continue;
+            }
+
+            if (!_children[path].contains(line->_path))
+                _children[path].append(line->_path);
+        }
+    }
+
+    // children are folded first, so their constants are known here
+    foreach (QString child, _children[path])
+    {
+        if (!build(child))
+            ok = false;
+    }
+
+    if (parsed)
+    {
+        Folder folder(&_exports);
+        folder.fold(object);
+
+        // only a clean tree is offered to other files
+        if (clean && !folder._imports)
+            _shared[hash].append(object);
+    }
+
+    _exports.provide(path, object);
+    return ok;
+}
+
+void Project::prune()
+{
+    QSet<QString> reachable;
+    QStringList queue;
+    queue.append(_root);
+
+    while (!queue.isEmpty())
+    {
+        QString path = queue.takeFirst();
+        if (reachable.contains(path)) continue;
+
+        reachable.insert(path);
+        queue.append(_children.value(path));
+    }
+
+    foreach (QString path, _objects.keys())
+    {
+        if (reachable.contains(path)) continue;
+
+        release(_objects.take(path));
+        _exports.forget(path);
+        _children.remove(path);
+        _missing.remove(path);
+    }
+
+    foreach (QString path, _failed)
+    {
+        if (!reachable.contains(path))
+            _failed.remove(path);
+    }
+}
+
+bool Project::load(QString path)
+{
+    _parses = 0;
+    _root = absolute(path);
+    return build(_root);
+}
+
+bool Project::reload(QStringList changed)
+{
+    QSet<QString> stale;
+    _parses = 0;
+
+    foreach (QString path, changed)
+    {
+        path = absolute(path);
+        if (!_objects.contains(path) && !_failed.contains(path)) continue;
+
+        stale.insert(path);
+        foreach (QString d, dependents(path))
+            stale.insert(d);
+    }
+
+    // a new or renamed file may satisfy an OBJ line that did not resolve
+    foreach (QString path, _missing)
+    {
+        stale.insert(path);
+        foreach (QString d, dependents(path))
+            stale.insert(d);
+    }
+
+    _resolver.clear();
+
+    // a table can hold values folded from the tables of its children
+    foreach (QString path, stale)
+        _exports.forget(path);
+
+    // the old trees are let go only after the rebuild, so a file that
+    // comes back with the same text is not parsed again
+    QList<ObjectExpr *> old;
+    foreach (QString path, stale)
+    {
+        old.append(_objects.take(path));
+        _children.remove(path);
+        _missing.remove(path);
+    }
+
+    // building from the top object first visits the files in the order
+    // load() did, so a cycle of OBJ lines folds the same way again
+    QStringList order = stale.values();
+    if (order.removeAll(_root) > 0)
+        order.prepend(_root);
+
+    bool ok = true;
+    foreach (QString path, order)
+    {
+        if (!build(path))
+            ok = false;
+    }
+
+    foreach (ObjectExpr * object, old)
+        release(object);
+
+    prune();
+    return ok;
+}
+
+bool Project::contains(QString path)
+{
+    path = absolute(path);
+
+    if (_objects.contains(path) || _failed.contains(path))
+        return true;
+
+    return !_missing.isEmpty() && path.toLower().endsWith(".spin");
+}
+
+QStringList Project::files()
+{
+    QStringList files = _objects.keys();
+    foreach (QString path, _failed)
+        files.append(path);
+
+    return files;
+}
+
+// the -L directories, searched for OBJ names after the including file's
+QStringList Project::searchPaths()
+{
+    QStringList paths;
+    foreach (QString path, _resolver.paths())
+        paths.append(absolute(path));
+
+    return paths;
+}
+
+QSet<QString> Project::dependents(QString path)
+{
+    QSet<QString> found;
+    QStringList queue;
+    queue.append(path);
+
+    while (!queue.isEmpty())
+    {
+        QString next = queue.takeFirst();
+
+        foreach (QString parent, _children.keys())
+        {
+            if (!_children[parent].contains(next)) continue;
+            if (found.contains(parent)) continue;
+
+            found.insert(parent);
+            queue.append(parent);
+        }
+    }
+
+    return found;
+}
+
+ObjectExpr * Project::root()
+{
+    return _objects.value(_root);
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "tree.h"
+#include "resolver.h"
+#include "exports.h"
+
+#include <QSet>
+#include <QStringList>
+
+/*
+ * The set of objects reachable from a top object through OBJ lines.
+ *
+ * Every object is parsed, resolved and folded once and kept in memory,
+ * keyed by its absolute path. When files change, only those objects and
+ * the objects that include them, directly or not, are rebuilt.
+ *
+ * Trees are also registered by a hash of their text. A file whose text
+ * matches a tree already built, and whose OBJ lines find the same files,
+ * shares that tree instead of being parsed again: copies of one object in
+ * several directories are parsed once, and so is a file that is saved
+ * without changes. Shared trees must not be changed after they are built.
+ * A tree that folded in constants of its children is not shared, since
+ * the same text can fold differently once a child changes.
+ *
+ * Children are folded before the objects that include them, and each
+ * folded tree gives its constants to the exports, so alias#name constants
+ * never cause a child to be read again.
+ */
+
+class Project
+{
+    ObjectResolver & _resolver;
+    ConstantExports _exports;
+    QHash<QByteArray, QList<ObjectExpr *> > _shared;
+    QHash<ObjectExpr *, int> _users;
+
+    bool build(QString path);
+    ObjectExpr * share(QString path, QByteArray hash);
+    void release(ObjectExpr * object);
+    void prune();
+
+public:
+    QString _root;
+    QHash<QString, ObjectExpr *> _objects;
+    QHash<QString, QStringList> _children;
+    QSet<QString> _missing;
+    QSet<QString> _failed;
+
+    // files parsed by the last load or reload; the rest were shared
+    int _parses;
+
+    Project(ObjectResolver & resolver);
+    ~Project();
+
+    bool load(QString path);
+    bool reload(QStringList changed);
+
+    bool contains(QString path);
+    QStringList files();
+    QStringList searchPaths();
+    QSet<QString> dependents(QString path);
+
+    ObjectExpr * root();
+};
@@ -0,0 +1,479 @@
+#include "ranges.h"
+#include "walker.h"
+
+static const Range Any(-2147483648LL, 2147483647LL);
+
+static int sizeOf(DataType type)
+{
+    return type == DataByte ? 1 : type == DataWord ? 2 : 4;
+}
+
+static DataType typeOf(int size)
+{
+    return size == 1 ? DataByte : size == 2 ? DataWord : DataLong;
+}
+
+// the smallest element size that holds every value in the range
+static int sizeFor(const Range & r)
+{
+    if (r.lo >= 0 && r.hi <= 0xff)      return 1;
+    if (r.lo >= 0 && r.hi <= 0xffff)    return 2;
+    return 4;
+}
+
+// everything an element of this size reads back as
+static Range sizeRange(int size)
+{
+    if (size == 1)  return Range(0, 0xff);
+    if (size == 2)  return Range(0, 0xffff);
+    return Any;
+}
+
+static Range join(const Range & a, const Range & b)
+{
+    return Range(qMin(a.lo, b.lo), qMax(a.hi, b.hi));
+}
+
+// a result that leaves a long wraps around, so it could be anything
+static Range checked(qint64 lo, qint64 hi)
+{
+    if (lo < Any.lo || hi > Any.hi)
+        return Any;
+    return Range(lo, hi);
+}
+
+// all ones up to the highest bit of v
+static qint64 mask(qint64 v)
+{
+    qint64 m = 0;
+    while (m < v)
+        m = m << 1 | 1;
+    return m;
+}
+
+static qint64 isqrt(qint64 v)
+{
+    qint64 r = 0;
+    while ((r + 1) * (r + 1) <= v)
+        r++;
+    return r;
+}
+
+// what each method stores into variables, and which variables it
+// changes in any other way
+class StoreCollector : public Walker<StoreCollector>
+{
+    MethodExpr * _method;
+    const QSet<QString> & _locals;
+    QHash<QString, QList<QPair<MethodExpr *, Expr *> > > & _stores;
+    QSet<QString> & _fixed;
+
+    QString target(Expr * expr)
+    {
+        if (IdentExpr * i = dynamic_cast<IdentExpr *>(expr))
+            return i->ident();
+        if (AddressExpr * a = dynamic_cast<AddressExpr *>(expr))
+            return a->_ident->ident();
+        return QString();
+    }
+
+public:
+    using Walker<StoreCollector>::visit;
+
+    StoreCollector(MethodExpr * method, const QSet<QString> & locals,
+                   QHash<QString, QList<QPair<MethodExpr *, Expr *> > > & stores,
+                   QSet<QString> & fixed)
+        : _method(method)
+        , _locals(locals)
+        , _stores(stores)
+        , _fixed(fixed)
+    {
+    }
+
+    void visit(BinaryExpr & expr)
+    {
+        if (!isAssignmentOp(expr._op)) return;
+
+        QString name = target(expr._left);
+        if (name.isEmpty() || _locals.contains(name)) return;
+
+        if (expr._op == "=")
+            _stores[name].append(qMakePair(_method, expr._right));
+        else
+            _fixed.insert(name);
+    }
+
+    void visit(UnaryExpr & expr)
+    {
+        if (isUnaryMathOp(expr._op, expr._post)) return;
+
+        QString name = target(expr._val);
+        if (!name.isEmpty() && !_locals.contains(name))
+            _fixed.insert(name);
+    }
+
+    void visit(AddressExpr & expr)
+    {
+        if (dynamic_cast<WrapExpr *>(expr._offset) == NULL && !_locals.contains(expr._ident->ident()))
+            _fixed.insert(expr._ident->ident());
+    }
+};
+
+void RangeAnalysis::collect(MethodExpr * method)
+{
+    QSet<QString> & locals = _methodLocals[method];
+
+    locals.insert(method->_result != NULL ? method->_result->ident() : QString("result"));
+    for (Expr * p : method->_params)
+        locals.insert(((IdentExpr *) p)->ident());
+    for (Expr * l : method->_locals)
+        locals.insert(((IdentExpr *) l)->ident());
+
+    StoreCollector collector(method, locals, _stores, _fixed);
+    for (Expr * s : method->_body)
+        collector.walk(s);
+}
+
+Range RangeAnalysis::variable(IdentExpr * ident)
+{
+    QString name = ident->ident();
+
+    if (_locals.contains(name) || !_ranges.contains(name))
+        return Any;
+    return _ranges[name];
+}
+
+Range RangeAnalysis::range(Expr * expr)
+{
+    if (expr->isConstant())
+    {
+        qint32 v = expr->value();
+        return Range(v, v);
+    }
+
+    if (IdentExpr * i = dynamic_cast<IdentExpr *>(expr))
+        return variable(i);
+
+    if (AddressExpr * a = dynamic_cast<AddressExpr *>(expr))
+    {
+        // an element reads like the variable; an address could be anything
+        if (dynamic_cast<WrapExpr *>(a->_offset) != NULL)
+            return variable(a->_ident);
+        return Any;
+    }
+
+    if (WrapExpr * w = dynamic_cast<WrapExpr *>(expr))
+        return range(w->_val);
+
+    if (UnaryExpr * u = dynamic_cast<UnaryExpr *>(expr))
+    {
+        if (u->_post) return Any;
+
+        if (u->_op == "-")
+        {
+            Range r = range(u->_val);
+            return checked(-r.hi, -r.lo);
+        }
+        if (u->_op == "not")
+            return Range(-1, 0);
+        return Any;
+    }
+
+    if (BinaryExpr * b = dynamic_cast<BinaryExpr *>(expr))
+    {
+        QLatin1String op = b->_op;
+
+        if (isAssignmentOp(op))
+            return op == "=" ? range(b->_right) : Any;
+
+        if (op == "==" || op == "<>" || op == "<" || op == ">" || op == "<=" || op == ">="
+            || op == "and" || op == "or")
+            return Range(-1, 0);
+
+        Range l = range(b->_left);
+        Range r = range(b->_right);
+
+        if (op == "+")
+            return checked(l.lo + r.lo, l.hi + r.hi);
+
+        if (op == "-")
+            return checked(l.lo - r.hi, l.hi - r.lo);
+
+        if (op == "*")
+        {
+            qint64 p[4] = { l.lo * r.lo, l.lo * r.hi, l.hi * r.lo, l.hi * r.hi };
+            return checked(qMin(qMin(p[0], p[1]), qMin(p[2], p[3])),
+                           qMax(qMax(p[0], p[1]), qMax(p[2], p[3])));
+        }
+
+        if (op == "&")
+        {
+            if (l.lo >= 0 && r.lo >= 0) return Range(0, qMin(l.hi, r.hi));
+            if (l.lo >= 0)              return Range(0, l.hi);
+            if (r.lo >= 0)              return Range(0, r.hi);
+            return Any;
+        }
+
+        if (op == "|" || op == "^")
+        {
+            if (l.lo >= 0 && r.lo >= 0)
+                return Range(0, mask(qMax(l.hi, r.hi)));
+            return Any;
+        }
+
+        if (op == "/" && l.lo >= 0 && r.lo > 0)
+            return Range(l.lo / r.hi, l.hi / r.lo);
+
+        if (op == "//" && l.lo >= 0 && r.lo > 0)
+            return Range(0, qMin(l.hi, r.hi - 1));
+
+        // shifts by a constant count
+        if (r.lo == r.hi && r.lo >= 0 && r.lo < 32)
+        {
+            if (op == ">>" && l.lo >= 0)
+                return Range(l.lo >> r.lo, l.hi >> r.lo);
+            if (op == ">>" && r.lo > 0)
+                return Range(0, 0xffffffffLL >> r.lo);
+            if (op == "<<" && l.lo >= 0)
+                return checked(l.lo << r.lo, l.hi << r.lo);
+        }
+
+        return Any;
+    }
+
+    if (CallExpr * c = dynamic_cast<CallExpr *>(expr))
+    {
+        int op = c->intrinsic();
+        if (op < 0) return Any;
+
+        Range a = range(c->_args[0]);
+
+        switch (op)
+        {
+            case 0xf8:
+                if (a.lo < 0) return Range(0, 0xffff);
+                return Range(isqrt(a.lo), isqrt(a.hi));
+
+            case 0xe9:
+                if (a.lo >= 0) return a;
+                if (a.hi <= 0) return checked(-a.hi, -a.lo);
+                return checked(0, qMax(-a.lo, a.hi));
+
+            case 0xe4:
+            case 0xe5:
+            {
+                Range b = range(c->_args[1]);
+                if (op == 0xe4)
+                    return Range(qMax(a.lo, b.lo), qMax(a.hi, b.hi));
+                return Range(qMin(a.lo, b.lo), qMin(a.hi, b.hi));
+            }
+        }
+    }
+
+    return Any;
+}
+
+void RangeAnalysis::analyze(ObjectExpr * object)
+{
+    _vars.clear();
+    _dat.clear();
+    _ranges.clear();
+    _fixed.clear();
+    _locals.clear();
+    _methodLocals.clear();
+    _stores.clear();
+    _results.clear();
+
+    QList<QString> order;
+    QString table;
+
+    for (Expr * b : object->_blocks)
+    {
+        BlockExpr * block = (BlockExpr *) b;
+
+        for (Expr * l : block->_lines)
+        {
+            if (block->_block == VarBlock)
+            {
+                VarLineExpr * line = (VarLineExpr *) l;
+                if (_vars.contains(line->_ident->ident())) continue;
+
+                _vars[line->_ident->ident()] = line;
+                order.append(line->_ident->ident());
+            }
+            else if (block->_block == DatBlock)
+            {
+                // a table is a label and the unlabeled lines after it
+                DatLineExpr * line = (DatLineExpr *) l;
+                QString name = line->_symbol->ident();
+
+                if (!name.isEmpty())
+                {
+                    table = _dat.contains(name) ? QString() : name;
+                    if (!table.isEmpty())
+                        order.append(table);
+                }
+
+                if (!table.isEmpty())
+                    _dat[table].append(line);
+            }
+            else if (block->_block == PubBlock || block->_block == PriBlock)
+            {
+                collect((MethodExpr *) l);
+            }
+        }
+    }
+
+    // tables hold what was written in them, cut to the element size
+    foreach (QString name, _dat.keys())
+    {
+        QList<DatLineExpr *> lines = _dat[name];
+        int size = sizeOf(lines.first()->_align->_val);
+        bool exact = !_fixed.contains(name) && !_stores.contains(name);
+        bool first = true;
+        Range r;
+
+        foreach (DatLineExpr * line, lines)
+        {
+            exact = exact && line->_align->_val == lines.first()->_align->_val;
+
+            for (Expr * i : line->_items)
+            {
+                DatItemExpr * item = (DatItemExpr *) i;
+                exact = exact && item->_size->_val == NoDataType;
+
+                QList<quint32> values;
+                StringExpr * s = dynamic_cast<StringExpr *>(item->_data);
+
+                if (s != NULL && !s->isConstant())
+                {
+                    QByteArray text = s->_string.toLatin1();
+                    for (int c = 0; c < text.size(); c++)
+                        values.append((quint8) text[c]);
+                }
+                else if (item->_data->isConstant())
+                    values.append(item->_data->value());
+                else
+                    exact = false;
+
+                foreach (quint32 v, values)
+                {
+                    qint64 x = size == 4 ? (qint64) (qint32) v : (qint64) (v & ((1u << 8 * size) - 1));
+                    r = first ? Range(x, x) : join(r, Range(x, x));
+                    first = false;
+                }
+            }
+        }
+
+        _ranges[name] = exact && !first ? r : sizeRange(size);
+        if (!exact)
+            _fixed.insert(name);
+    }
+
+    // variables start out holding zero and grow with what is stored in
+    // them; rounding to a whole element size means each grows at most
+    // twice before everything settles
+    QList<QString> grown;
+    foreach (QString name, _vars.keys())
+    {
+        if (_dat.contains(name) || _fixed.contains(name))
+        {
+            _fixed.insert(name);
+            if (!_dat.contains(name))
+                _ranges[name] = sizeRange(_vars[name]->elementSize());
+        }
+        else
+        {
+            _ranges[name] = Range(0, 0);
+            grown.append(name);
+        }
+    }
+
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+
+        foreach (QString name, grown)
+        {
+            int size = _vars[name]->elementSize();
+            Range r(0, 0);
+
+            typedef QPair<MethodExpr *, Expr *> Store;
+            foreach (Store s, _stores.value(name))
+            {
+                _locals = _methodLocals.value(s.first);
+                r = join(r, range(s.second));
+            }
+            _locals.clear();
+
+            // a value too big for the variable is cut to fit, so then
+            // the variable could hold anything of its size
+            r = sizeRange(qMin(sizeFor(r), size));
+
+            if (r != _ranges[name])
+            {
+                _ranges[name] = r;
+                changed = true;
+            }
+        }
+    }
+
+    foreach (QString name, order)
+    {
+        Narrowing n;
+        if (_vars.contains(name) && !_dat.contains(name))
+        {
+            VarLineExpr * line = _vars[name];
+            WrapExpr * index = dynamic_cast<WrapExpr *>(line->_count);
+
+            n.name = line->_ident;
+            n.dat = false;
+            n.size = line->elementSize();
+            n.elements = index != NULL && index->_val->isConstant() ? index->value() : 1;
+        }
+        else if (_dat.contains(name) && !_vars.contains(name))
+        {
+            QList<DatLineExpr *> lines = _dat[name];
+            QByteArray bytes;
+            foreach (DatLineExpr * line, lines)
+                encodeData(line, bytes);
+
+            n.name = lines.first()->_symbol;
+            n.dat = true;
+            n.size = sizeOf(lines.first()->_align->_val);
+            n.elements = bytes.size() / n.size;
+        }
+        else
+        {
+            continue;
+        }
+
+        n.needed = _fixed.contains(name) ? n.size : qMin(sizeFor(_ranges[name]), n.size);
+        _results.append(n);
+    }
+}
+
+int RangeAnalysis::narrow()
+{
+    int saved = 0;
+
+    foreach (Narrowing n, _results)
+    {
+        if (n.needed >= n.size) continue;
+
+        if (n.dat)
+        {
+            foreach (DatLineExpr * line, _dat[n.name->ident()])
+                line->_align->_val = typeOf(n.needed);
+        }
+        else
+        {
+            _vars[n.name->ident()]->_type->_val = typeOf(n.needed);
+        }
+
+        saved += n.elements * (n.size - n.needed);
+    }
+
+    return saved;
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <QPair>
+#include <QSet>
+
+#include "tree.h"
+
+/*
+ * Finds the smallest element size that holds every value a VAR or DAT
+ * table can contain, and can narrow the declarations to it.
+ *
+ * A DAT table that no method writes to or takes the address of holds
+ * exactly its folded data. A VAR that is only ever changed by plain
+ * assignment holds zero and whatever those assignments store, worked out
+ * as a range for each expression. Reads of other variables use their own
+ * ranges, so the ranges are grown together until they settle; each one is
+ * rounded up to a whole byte, word or long, which keeps that short.
+ *
+ * Bytes and words are read back without sign extension, so only ranges
+ * that never go below zero narrow. Anything else keeps its size.
+ */
+
+struct Range
+{
+    qint64 lo;
+    qint64 hi;
+
+    Range(qint64 lo = 0, qint64 hi = 0)
+        : lo(lo)
+        , hi(hi)
+    {
+    }
+
+    bool operator==(const Range & other) const
+    {
+        return lo == other.lo && hi == other.hi;
+    }
+
+    bool operator!=(const Range & other) const
+    {
+        return !(*this == other);
+    }
+};
+
+struct Narrowing
+{
+    IdentExpr * name;
+    bool dat;
+    int size;
+    int needed;
+    int elements;
+};
+
+class RangeAnalysis
+{
+    QHash<QString, VarLineExpr *> _vars;
+    QHash<QString, QList<DatLineExpr *> > _dat;
+    QHash<QString, Range> _ranges;
+    QSet<QString> _fixed;
+    QSet<QString> _locals;
+    QHash<MethodExpr *, QSet<QString> > _methodLocals;
+    QHash<QString, QList<QPair<MethodExpr *, Expr *> > > _stores;
+
+    Range range(Expr * expr);
+    Range variable(IdentExpr * ident);
+    void collect(MethodExpr * method);
+
+public:
+    QList<Narrowing> _results;
+
+    void analyze(ObjectExpr * object);
+    int narrow();
+};
@@ -0,0 +1,170 @@
+#include "resolver.h"
+
+#include <QDir>
+#include <QFileInfo>
+
+bool ObjectResolver::isDir(QString path)
+{
+    if (!_stats.contains(path))
+        _stats[path] = QFileInfo(path).isDir();
+
+    return _stats[path];
+}
+
+QStringList ObjectResolver::files(QString dir)
+{
+    if (!_files.contains(dir))
+        _files[dir] = QDir(dir).entryList(QDir::Files, QDir::Name);
+
+    return _files[dir];
+}
+
+QStringList ObjectResolver::dirs(QString dir)
+{
+    if (!_dirs.contains(dir))
+        _dirs[dir] = QDir(dir).entryList(QDir::Dirs | QDir::NoDotAndDotDot, QDir::Name);
+
+    return _dirs[dir];
+}
+
+QString ObjectResolver::match(QStringList entries, QString name)
+{
+    if (entries.contains(name))
+        return name;
+
+    foreach (QString e, entries)
+    {
+        if (e.toLower() == name.toLower())
+            return e;
+    }
+
+    return QString();
+}
+
+QString ObjectResolver::findIn(QString dir, QStringList parts)
+{
+    for (int i = 0; i < parts.size() - 1; i++)
+    {
+        QString d = match(dirs(dir), parts[i]);
+        if (d.isEmpty())
+            return QString();
+
+        dir = QDir(dir).filePath(d);
+    }
+
+    QString f = match(files(dir), parts.last());
+    if (f.isEmpty())
+        return QString();
+
+    return QDir(dir).absoluteFilePath(f);
+}
+
+QString ObjectResolver::findBelow(QString dir, QStringList parts)
+{
+    QStringList queue;
+    foreach (QString d, dirs(dir))
+        queue.append(QDir(dir).filePath(d));
+
+    while (!queue.isEmpty())
+    {
+        QString next = queue.takeFirst();
+
+        QString found = findIn(next, parts);
+        if (!found.isEmpty())
+            return found;
+
+        foreach (QString d, dirs(next))
+            queue.append(QDir(next).filePath(d));
+    }
+
+    return QString();
+}
+
+void ObjectResolver::addPath(QString path)
+{
+    _paths.append(QDir::cleanPath(path));
+}
+
+QStringList ObjectResolver::paths()
+{
+    return _paths;
+}
+
+void ObjectResolver::clear()
+{
+    _stats.clear();
+    _files.clear();
+    _dirs.clear();
+    _resolved.clear();
+}
+
+QString ObjectResolver::resolve(QString name, QString from)
+{
+    QString key = from + "\n" + name;
+    if (_resolved.contains(key))
+        return _resolved[key];
+
+    QString file = name.trimmed();
+    if (!file.toLower().endsWith(".spin"))
+        file += ".spin";
+
+    QStringList parts = file.split('/', QString::SkipEmptyParts);
+
+    QStringList roots;
+    roots.append(from);
+    roots.append(_paths);
+
+    QString found;
+
+    foreach (QString root, roots)
+    {
+        if (!isDir(root)) continue;
+
+        found = findIn(root, parts);
+        if (!found.isEmpty()) break;
+    }
+
+    if (found.isEmpty())
+    {
+        foreach (QString root, roots)
+        {
+            if (!isDir(root)) continue;
+
+            found = findBelow(root, parts);
+            if (!found.isEmpty()) break;
+        }
+    }
+
+    _resolved[key] = found;
+    return found;
+}
+
+bool ObjectResolver::resolve(ObjectExpr * object)
+{
+    QString from = object->name.isEmpty()
+                 ? QDir::currentPath()
+                 : QFileInfo(object->name).absolutePath();
+
+    bool ok = true;
+
+    for (Expr * b : object->_blocks)
+    {
+        BlockExpr * block = (BlockExpr *) b;
+        if (block->_block != ObjBlock) continue;
+
+        for (Expr * l : block->_lines)
+        {
+            ObjLineExpr * line = (ObjLineExpr *) l;
+            line->_path = resolve(line->_file->_string, from);
+
+            if (line->_path.isEmpty())
+            {
+                fprintf(stderr, "\n\033[1;37m%s \033[1;31merror:\033[0m cannot find object \"%s\"\n\n",
+                        qPrintable(object->name), qPrintable(line->_file->_string));
+                ok = false;
+            }
+        }
+    }
+
+    return ok;
+}
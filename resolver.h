@@ -0,0 +1,44 @@
+#pragma once
+
+#include "tree.h"
+
+#include <QStringList>
+
+/*
+ * Maps OBJ names to source files.
+ *
+ * A name may carry subdirectories ("drivers/serial") and is matched
+ * case-insensitively, with ".spin" appended when no suffix is given.
+ * The directory of the including object is searched first, then each
+ * search path in order, then their subdirectories breadth-first.
+ *
+ * Every stat and directory listing is memoized for the lifetime of the
+ * resolver, so one resolver should be kept for the duration of a build
+ * and cleared when the filesystem is expected to have changed.
+ */
+
+class ObjectResolver
+{
+    QStringList _paths;
+
+    QHash<QString, bool> _stats;
+    QHash<QString, QStringList> _files;
+    QHash<QString, QStringList> _dirs;
+    QHash<QString, QString> _resolved;
+
+    bool isDir(QString path);
+    QStringList files(QString dir);
+    QStringList dirs(QString dir);
+
+    QString match(QStringList entries, QString name);
+    QString findIn(QString dir, QStringList parts);
+    QString findBelow(QString dir, QStringList parts);
+
+public:
+    void addPath(QString path);
+    QStringList paths();
+    void clear();
+
+    QString resolve(QString name, QString from);
+    bool resolve(ObjectExpr * object);
+};
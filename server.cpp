@@ -0,0 +1,398 @@
+#include "server.h"
+#include "walker.h"
+#include "folder.h"
+#include "varlayout.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QUrl>
+
+class ReferenceCollector : public Walker<ReferenceCollector>
+{
+    QHash<int, QList<Reference> > & _references;
+
+public:
+    using Walker<ReferenceCollector>::visit;
+
+    ReferenceCollector(QHash<int, QList<Reference> > & references)
+        : _references(references)
+    {
+    }
+
+    void visit(IdentExpr & expr)
+    {
+        if (expr._line == 0) return;
+
+        Reference r;
+        r.line = expr._line;
+        r.column = expr._column;
+        r.name = expr.ident();
+        _references[r.line].append(r);
+    }
+};
+
+static QJsonObject range(int line, int first_column, int last_column)
+{
+    QJsonObject start;
+    start["line"] = line - 1;
+    start["character"] = first_column - 1;
+
+    QJsonObject end;
+    end["line"] = line - 1;
+    end["character"] = last_column - 1;
+
+    QJsonObject r;
+    r["start"] = start;
+    r["end"] = end;
+    return r;
+}
+
+LanguageServer::LanguageServer(ObjectResolver & resolver)
+    : _resolver(resolver), _exports(resolver)
+{
+    _shutdown = false;
+}
+
+LanguageServer::~LanguageServer()
+{
+    foreach (Document * d, _documents) { delete d; }
+}
+
+bool LanguageServer::read(QJsonObject & message)
+{
+    char header[256];
+    int length = -1;
+
+    while (fgets(header, sizeof(header), stdin))
+    {
+        QByteArray line = QByteArray(header).trimmed();
+
+        if (line.startsWith("Content-Length:"))
+        {
+            length = line.mid(15).trimmed().toInt();
+        }
+        else if (line.isEmpty() && length >= 0)
+        {
+            QByteArray body(length, 0);
+            if (fread(body.data(), 1, length, stdin) != (size_t) length)
+                return false;
+
+            message = QJsonDocument::fromJson(body).object();
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void LanguageServer::write(QJsonObject message)
+{
+    message["jsonrpc"] = QString("2.0");
+
+    QByteArray body = QJsonDocument(message).toJson(QJsonDocument::Compact);
+    fprintf(stdout, "Content-Length: %i\r\n\r\n", body.size());
+    fwrite(body.constData(), 1, body.size(), stdout);
+    fflush(stdout);
+}
+
+void LanguageServer::respond(QJsonValue id, QJsonValue result)
+{
+    QJsonObject message;
+    message["id"] = id;
+    message["result"] = result;
+    write(message);
+}
+
+void LanguageServer::fail(QJsonValue id, int code, QString text)
+{
+    QJsonObject error;
+    error["code"] = code;
+    error["message"] = text;
+
+    QJsonObject message;
+    message["id"] = id;
+    message["error"] = error;
+    write(message);
+}
+
+void LanguageServer::notify(QString method, QJsonObject params)
+{
+    QJsonObject message;
+    message["method"] = method;
+    message["params"] = params;
+    write(message);
+}
+
+void LanguageServer::update(QString uri, QString text)
+{
+    Document * document = _documents.value(uri);
+    if (document == NULL)
+    {
+        document = new Document();
+        document->uri = uri;
+        document->path = QUrl(uri).toLocalFile();
+        _documents[uri] = document;
+    }
+
+    QList<Diagnostic> diagnostics;
+    ObjectExpr * root = parse(document->path, text.toUtf8(), &diagnostics);
+
+    if (root != NULL)
+    {
+        QHash<int, QList<Reference> > references;
+        ReferenceCollector collector(references);
+        collector.walk(root);
+
+        QString from = QFileInfo(document->path).absolutePath();
+        bool cleared = false;
+
+        for (Expr * b : root->_blocks)
+        {
+            BlockExpr * block = (BlockExpr *) b;
+            if (block->_block != ObjBlock) continue;
+
+            for (Expr * l : block->_lines)
+            {
+                ObjLineExpr * line = (ObjLineExpr *) l;
+                line->_path = _resolver.resolve(line->_file->_string, from);
+
+                // the resolver remembers what it saw on disk, so a file
+                // made since then is only found once that is let go
+                if (line->_path.isEmpty() && !cleared)
+                {
+                    _resolver.clear();
+                    cleared = true;
+                    line->_path = _resolver.resolve(line->_file->_string, from);
+                }
+
+                if (!line->_path.isEmpty()) continue;
+
+                Diagnostic d;
+                d.line = line->_alias->_line;
+                d.first_column = line->_alias->_column;
+                d.last_column = d.first_column + line->_alias->_ident.size();
+                d.message = "cannot find object \"" + line->_file->_string + "\"";
+                diagnostics.append(d);
+            }
+        }
+
+        // the tables folded from the old text are dropped, and this text
+        // becomes the table other documents see; children that are not
+        // open are read from disk
+        _exports.forget(document->path);
+        _exports.fold(document->path, root);
+        VarLayout().layout(root);
+
+        delete document->symbols;
+        delete document->root;
+        document->root = root;
+        document->symbols = new SymbolTable(root);
+        document->references = references;
+    }
+
+    document->diagnostics = diagnostics;
+    publish(document);
+}
+
+void LanguageServer::publish(Document * document)
+{
+    QJsonArray diagnostics;
+
+    foreach (Diagnostic d, document->diagnostics)
+    {
+        QJsonObject diagnostic;
+        diagnostic["range"] = range(d.line, d.first_column, d.last_column);
+        diagnostic["severity"] = 1;
+        diagnostic["source"] = QString("spindrake");
+        diagnostic["message"] = d.message;
+        diagnostics.append(diagnostic);
+    }
+
+    QJsonObject params;
+    params["uri"] = document->uri;
+    params["diagnostics"] = diagnostics;
+    notify("textDocument/publishDiagnostics", params);
+}
+
+Reference * LanguageServer::find(QJsonObject params, Document ** document)
+{
+    QString uri = params.value("textDocument").toObject().value("uri").toString();
+    QJsonObject position = params.value("position").toObject();
+    int line = position.value("line").toInt() + 1;
+    int column = position.value("character").toInt() + 1;
+
+    *document = _documents.value(uri);
+    if (*document == NULL || (*document)->root == NULL)
+        return NULL;
+
+    if (!(*document)->references.contains(line))
+        return NULL;
+
+    QList<Reference> & references = (*document)->references[line];
+    for (int i = 0; i < references.size(); i++)
+    {
+        Reference & r = references[i];
+        if (column >= r.column && column < r.column + r.name.size())
+            return &r;
+    }
+
+    return NULL;
+}
+
+QJsonValue LanguageServer::hover(QJsonObject params)
+{
+    Document * document;
+    Reference * r = find(params, &document);
+    if (r == NULL || !document->symbols->contains(r->name))
+        return QJsonValue();
+
+    Symbol symbol = document->symbols->lookup(r->name);
+    QString text;
+
+    if (ConAssignExpr * c = dynamic_cast<ConAssignExpr *>(symbol.definition))
+    {
+        if (c->isConstant())
+            text = QString("CON %1 = %2 ($%3)").arg(symbol.ident->_ident)
+                                               .arg((qint32) c->value())
+                                               .arg(c->value(), 0, 16);
+        else
+            text = QString("CON %1").arg(symbol.ident->_ident);
+    }
+    else if (DatLineExpr * d = dynamic_cast<DatLineExpr *>(symbol.definition))
+    {
+        text = QString("DAT %1 %2").arg(d->_align->ident()).arg(symbol.ident->_ident);
+    }
+    else if (VarLineExpr * v = dynamic_cast<VarLineExpr *>(symbol.definition))
+    {
+        text = QString("VAR %1 %2").arg(v->_type->ident()).arg(symbol.ident->_ident);
+        if (v->value())
+            text += QString("[%1]").arg(v->value());
+        if (v->_offset >= 0)
+            text += QString(" (vbase + %1)").arg(v->_offset);
+    }
+    else if (ObjLineExpr * o = dynamic_cast<ObjLineExpr *>(symbol.definition))
+    {
+        text = QString("OBJ %1 : \"%2\"").arg(symbol.ident->_ident).arg(o->_path);
+    }
+    else if (dynamic_cast<AsmLineExpr *>(symbol.definition))
+    {
+        text = QString("ASM %1").arg(symbol.ident->_ident);
+    }
+    else if (MethodExpr * m = dynamic_cast<MethodExpr *>(symbol.definition))
+    {
+        text = QString("%1 %2").arg(m->_block == PubBlock ? "PUB" : "PRI").arg(symbol.ident->_ident);
+    }
+
+    QJsonObject contents;
+    contents["kind"] = QString("markdown");
+    contents["value"] = "```spin\n" + text + "\n```";
+
+    QJsonObject result;
+    result["contents"] = contents;
+    result["range"] = range(r->line, r->column, r->column + r->name.size());
+    return result;
+}
+
+QJsonValue LanguageServer::definition(QJsonObject params)
+{
+    Document * document;
+    Reference * r = find(params, &document);
+    if (r == NULL || !document->symbols->contains(r->name))
+        return QJsonValue();
+
+    Symbol symbol = document->symbols->lookup(r->name);
+    QJsonObject location;
+
+    ObjLineExpr * o = dynamic_cast<ObjLineExpr *>(symbol.definition);
+    if (o != NULL && symbol.ident->_line == r->line && !o->_path.isEmpty())
+    {
+        location["uri"] = QUrl::fromLocalFile(o->_path).toString();
+        location["range"] = range(1, 1, 1);
+        return location;
+    }
+
+    location["uri"] = document->uri;
+    location["range"] = range(symbol.ident->_line, symbol.ident->_column,
+                              symbol.ident->_column + symbol.ident->_ident.size());
+    return location;
+}
+
+int LanguageServer::run()
+{
+    QJsonObject message;
+
+    while (read(message))
+    {
+        QString method = message.value("method").toString();
+        QJsonValue id = message.value("id");
+        QJsonObject params = message.value("params").toObject();
+
+        if (method == "initialize")
+        {
+            QJsonObject capabilities;
+            capabilities["textDocumentSync"] = 1;
+            capabilities["hoverProvider"] = true;
+            capabilities["definitionProvider"] = true;
+
+            QJsonObject result;
+            result["capabilities"] = capabilities;
+            respond(id, result);
+        }
+        else if (method == "shutdown")
+        {
+            _shutdown = true;
+            respond(id, QJsonValue());
+        }
+        else if (method == "exit")
+        {
+            return _shutdown ? 0 : 1;
+        }
+        else if (method == "textDocument/didOpen")
+        {
+            QJsonObject document = params.value("textDocument").toObject();
+            update(document.value("uri").toString(), document.value("text").toString());
+        }
+        else if (method == "textDocument/didChange")
+        {
+            QJsonObject document = params.value("textDocument").toObject();
+            QJsonArray changes = params.value("contentChanges").toArray();
+            if (changes.size() > 0)
+                update(document.value("uri").toString(),
+                       changes.at(changes.size() - 1).toObject().value("text").toString());
+        }
+        else if (method == "textDocument/didClose")
+        {
+            QString uri = params.value("textDocument").toObject().value("uri").toString();
+            Document * document = _documents.take(uri);
+            if (document != NULL)
+            {
+                // the file on disk counts again, not the unsaved text
+                _exports.forget(document->path);
+                document->diagnostics.clear();
+                publish(document);
+                delete document;
+            }
+        }
+        else if (method == "workspace/didChangeWatchedFiles")
+        {
+            foreach (QJsonValue change, params.value("changes").toArray())
+                _exports.forget(QUrl(change.toObject().value("uri").toString()).toLocalFile());
+        }
+        else if (method == "textDocument/hover")
+        {
+            respond(id, hover(params));
+        }
+        else if (method == "textDocument/definition")
+        {
+            respond(id, definition(params));
+        }
+        else if (!id.isUndefined())
+        {
+            fail(id, -32601, "method not found: " + method);
+        }
+    }
+
+    return 1;
+}
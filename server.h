@@ -0,0 +1,82 @@
+#pragma once
+
+#include "tree.h"
+#include "parse.h"
+#include "symbols.h"
+#include "resolver.h"
+#include "exports.h"
+
+#include <QJsonObject>
+
+/*
+ * A language server speaking LSP-style JSON-RPC over stdio.
+ *
+ * Each open document is parsed and folded once per edit. The folded
+ * tree, its symbol table and the positions of every identifier are
+ * kept warm so hover and go-to-definition never reparse. When an edit
+ * fails to parse, the last good tree stays in place and only the
+ * diagnostics are replaced.
+ *
+ * The constant tables of child objects are kept for the whole session.
+ * An edit drops only the table of the edited document and of the objects
+ * folded with it, and an open document's table comes from its unsaved
+ * text. Another open document sees the change on its next edit.
+ */
+
+struct Reference
+{
+    int line;
+    int column;
+    QString name;
+};
+
+class Document
+{
+public:
+    QString uri;
+    QString path;
+    ObjectExpr * root;
+    SymbolTable * symbols;
+    QHash<int, QList<Reference> > references;
+    QList<Diagnostic> diagnostics;
+
+    Document()
+    {
+        root = NULL;
+        symbols = NULL;
+    }
+
+    ~Document()
+    {
+        delete symbols;
+        delete root;
+    }
+};
+
+class LanguageServer
+{
+    ObjectResolver & _resolver;
+    ConstantExports _exports;
+    QHash<QString, Document *> _documents;
+    bool _shutdown;
+
+    bool read(QJsonObject & message);
+    void write(QJsonObject message);
+
+    void respond(QJsonValue id, QJsonValue result);
+    void fail(QJsonValue id, int code, QString message);
+    void notify(QString method, QJsonObject params);
+
+    void update(QString uri, QString text);
+    void publish(Document * document);
+    Reference * find(QJsonObject params, Document ** document);
+
+    QJsonValue hover(QJsonObject params);
+    QJsonValue definition(QJsonObject params);
+
+public:
+    LanguageServer(ObjectResolver & resolver);
+    ~LanguageServer();
+
+    int run();
+};
@@ -0,0 +1,834 @@
+#include "simulator.h"
+#include "func.h"
+
+#include <string.h>
+
+static const int HubSize = 0x8000;
+static const quint32 ObjectBase = 0x0010;
+
+SpinCosts::SpinCosts()
+{
+    dispatch = 6;
+    operand = 2;
+    stack = 1;
+    anchor = 4;
+    call = 8;
+    ret = 6;
+    jump = 3;
+    math = 4;
+    multiply = 2;
+    divide = 3;
+    reg = 3;
+}
+
+bool SpinCosts::load(const QByteArray & text, QString & error)
+{
+    QHash<QByteArray, int *> fields;
+    fields["dispatch"] = &dispatch;
+    fields["operand"] = &operand;
+    fields["stack"] = &stack;
+    fields["anchor"] = &anchor;
+    fields["call"] = &call;
+    fields["return"] = &ret;
+    fields["jump"] = &jump;
+    fields["math"] = &math;
+    fields["multiply"] = &multiply;
+    fields["divide"] = &divide;
+    fields["register"] = &reg;
+
+    QList<QByteArray> lines = text.split('\n');
+    for (int i = 0; i < lines.size(); i++)
+    {
+        QByteArray line = lines[i];
+        int comment = line.indexOf('#');
+        if (comment >= 0)
+            line = line.left(comment);
+        line = line.trimmed();
+        if (line.isEmpty())
+            continue;
+
+        int equals = line.indexOf('=');
+        QByteArray name = line.left(equals).trimmed();
+        bool ok = false;
+        int count = line.mid(equals + 1).trimmed().toInt(&ok);
+
+        if (equals < 0 || !fields.contains(name) || !ok || count < 0)
+        {
+            error = QString("line %1: expected a cost name, = and a count").arg(i + 1);
+            return false;
+        }
+        *fields[name] = count;
+    }
+    return true;
+}
+
+static int mathCost(const SpinCosts & costs, quint8 op)
+{
+    switch (op)
+    {
+        case 0xf4:
+        case 0xf5:  return costs.math + costs.multiply * 32;
+        case 0xf6:
+        case 0xf7:  return costs.math + costs.divide * 32;
+        case 0xf8:  return costs.math + costs.divide * 16;  // one step per result bit
+        default:    return costs.math;
+    }
+}
+
+static bool parity(quint32 v)
+{
+    v ^= v >> 16;
+    v ^= v >> 8;
+    v ^= v >> 4;
+    v ^= v >> 2;
+    v ^= v >> 1;
+    return v & 1;
+}
+
+static bool overflow(quint32 a, quint32 b, quint32 r)
+{
+    return ((a ^ r) & (b ^ r)) >> 31;
+}
+
+Simulator::Simulator()
+    : _hub(HubSize, '\0')
+{
+    reset(0);
+}
+
+void Simulator::reset(int slot)
+{
+    memset(_hub.data(), 0, HubSize);
+    memset(_cogRam, 0, sizeof(_cogRam));
+    _slot = slot;
+    _z = false;
+    _c = false;
+
+    _pbase = _vbase = _dbase = _dcurr = _pcurr = _stack = 0;
+    _frames.clear();
+    _profileIndex.clear();
+    _running = -1;
+
+    _clock = 0;
+    _hubWait = 0;
+    _steps = 0;
+    _result = 0;
+    _finished = false;
+    _error.clear();
+    _profile.clear();
+}
+
+void Simulator::fail(QString message)
+{
+    if (_error.isEmpty())
+        _error = message;
+}
+
+void Simulator::instructions(int count)
+{
+    _clock += 4 * count;
+}
+
+// each cog gets the hub for one clock in sixteen; the access then takes 8
+void Simulator::hubAccess()
+{
+    quint64 wait = (_slot - _clock) & 15;
+    _hubWait += wait;
+    _clock += wait + 8;
+}
+
+quint32 Simulator::read(quint32 address, int size)
+{
+    address &= ~(size - 1);
+    if (address + size > (quint32) HubSize)
+    {
+        fail(QString("read past the end of hub RAM at $%1").arg(address, 0, 16));
+        return 0;
+    }
+
+    quint32 value = 0;
+    for (int i = size - 1; i >= 0; i--)
+        value = value << 8 | (quint8) _hub[address + i];
+    return value;
+}
+
+void Simulator::write(quint32 address, int size, quint32 value)
+{
+    address &= ~(size - 1);
+    if (address + size > (quint32) HubSize)
+    {
+        fail(QString("write past the end of hub RAM at $%1").arg(address, 0, 16));
+        return;
+    }
+
+    for (int i = 0; i < size; i++)
+        _hub[address + i] = (char) (value >> (8 * i));
+}
+
+quint8 Simulator::fetch()
+{
+    hubAccess();
+    return read(_pcurr++, 1);
+}
+
+quint8 Simulator::operand()
+{
+    instructions(_costs.operand);
+    return fetch();
+}
+
+void Simulator::push(quint32 value)
+{
+    instructions(_costs.stack);
+    hubAccess();
+    write(_dcurr, 4, value);
+    _dcurr += 4;
+}
+
+quint32 Simulator::pop()
+{
+    if (_dcurr <= _stack)
+    {
+        fail("stack underflow");
+        return 0;
+    }
+
+    instructions(_costs.stack);
+    hubAccess();
+    _dcurr -= 4;
+    return read(_dcurr, 4);
+}
+
+// the frame starts with the result, which the arguments then follow
+void Simulator::anchor(bool keep)
+{
+    SimFrame frame;
+    frame.method = -1;
+    frame.dbase = _dcurr;
+    frame.pcurr = 0;
+    frame.keep = keep;
+    frame.entered = 0;
+    frame.children = 0;
+    _frames.append(frame);
+
+    instructions(_costs.anchor);
+    for (int i = 0; i < 2; i++)
+        hubAccess();
+    push(0);
+}
+
+void Simulator::call(int index)
+{
+    if (_frames.isEmpty() || _frames.last().method >= 0)
+    {
+        fail("call without an anchor");
+        return;
+    }
+
+    int profile = _profileIndex.value(index, -1);
+    if (profile < 0)
+    {
+        fail(QString("call to unknown method %1").arg(index));
+        return;
+    }
+
+    instructions(_costs.call);
+    hubAccess();
+    quint32 offset = read(_pbase + 4 * index, 2);
+    quint32 locals = read(_pbase + 4 * index + 2, 2);
+
+    SimFrame & frame = _frames.last();
+    frame.method = index;
+    frame.pcurr = _pcurr;
+    frame.entered = _clock;
+
+    _dbase = frame.dbase;
+    _dcurr += locals;
+    _pcurr = _pbase + offset;
+    _running = profile;
+    _profile[profile].calls++;
+
+    if (_dcurr > (quint32) HubSize)
+        fail("stack overflow");
+}
+
+void Simulator::account(const SimFrame & frame)
+{
+    quint64 spent = _clock - frame.entered;
+    SimProfile & p = _profile[_profileIndex[frame.method]];
+    p.cycles += spent;
+    p.self += spent - frame.children;
+
+    for (int i = _frames.size() - 1; i >= 0; i--)
+    {
+        if (_frames[i].method < 0) continue;
+
+        _frames[i].children += spent;
+        _dbase = _frames[i].dbase;
+        _running = _profileIndex[_frames[i].method];
+        break;
+    }
+}
+
+void Simulator::leave()
+{
+    SimFrame frame = _frames.takeLast();
+
+    instructions(_costs.ret);
+    for (int i = 0; i < 2; i++)
+        hubAccess();
+
+    hubAccess();
+    quint32 result = read(frame.dbase, 4);
+
+    _dcurr = frame.dbase;
+    _pcurr = frame.pcurr;
+    account(frame);
+
+    if (_frames.isEmpty())
+    {
+        _result = result;
+        _finished = true;
+    }
+    else if (frame.keep)
+    {
+        push(result);
+    }
+}
+
+/*
+ * %1ssibbaa: size (byte, word, long), indexed, base (an address from
+ * the stack, pbase, vbase or dbase) and action (read, write, assign or
+ * address). The compact forms %01b aaa aa cover the first eight longs
+ * of vbase and dbase.
+ */
+void Simulator::memory(quint8 op)
+{
+    int size = 4;
+    quint32 address;
+
+    if (op < 0x80)
+    {
+        address = ((op & 0x20) ? _dbase : _vbase) + (op & 0x1c);
+    }
+    else
+    {
+        size = 1 << ((op >> 5) & 3);
+        int base = (op >> 2) & 3;
+        bool indexed = op & 0x10;
+
+        if (base == 0)
+        {
+            quint32 index = indexed ? pop() : 0;
+            address = pop() + index * size;
+        }
+        else
+        {
+            quint32 offset = operand();
+            if (offset & 0x80)
+                offset = (offset & 0x7f) << 8 | operand();
+
+            address = (base == 1 ? _pbase : base == 2 ? _vbase : _dbase) + offset;
+            if (indexed)
+                address += pop() * size;
+        }
+    }
+
+    switch (op & 3)
+    {
+        case 0:
+            hubAccess();
+            push(read(address, size));
+            break;
+        case 1:
+        {
+            quint32 value = pop();
+            hubAccess();
+            write(address, size, value);
+            break;
+        }
+        case 2:
+            fail(QString("assignment bytecode $%1 is not simulated").arg(op, 0, 16));
+            break;
+        case 3:
+            push(address);
+            break;
+    }
+}
+
+void Simulator::step()
+{
+    quint32 at = _pcurr;
+    quint8 op = fetch();
+
+    instructions(_costs.dispatch);
+    _steps++;
+    _profile[_running].steps++;
+
+    if (op >= 0xe0)
+    {
+        quint32 b = spinUnary(op) ? 0 : pop();
+        quint32 a = pop();
+        quint32 r;
+
+        instructions(mathCost(_costs, op));
+        if (!spinMath(op, a, b, r))
+        {
+            if (b == 0)
+            {
+                fail(QString("division by zero at $%1").arg(at, 0, 16));
+                return;
+            }
+            r = op == 0xf6 ? 0x80000000 : 0;
+        }
+        push(r);
+        return;
+    }
+
+    if (op >= 0x40)
+    {
+        memory(op);
+        return;
+    }
+
+    switch (op)
+    {
+        case 0x00:
+        case 0x01:
+            anchor(op == 0x00);
+            break;
+
+        case 0x04:
+        case 0x0a:
+        case 0x0b:
+        {
+            qint32 offset = operand();
+            if (offset & 0x80)
+            {
+                offset = (offset & 0x7f) << 8 | operand();
+                if (offset & 0x4000) offset -= 0x8000;
+            }
+            else if (offset & 0x40)
+            {
+                offset -= 0x80;
+            }
+
+            instructions(_costs.jump);
+            bool taken = op == 0x04 || (pop() == 0) == (op == 0x0a);
+            if (taken)
+                _pcurr += offset;
+            break;
+        }
+
+        case 0x05:
+            call(operand());
+            break;
+
+        case 0x32:
+            leave();
+            break;
+
+        case 0x33:
+        {
+            quint32 value = pop();
+            hubAccess();
+            write(_dbase, 4, value);
+            leave();
+            break;
+        }
+
+        case 0x34:  push(0xffffffff); break;
+        case 0x35:  push(0); break;
+        case 0x36:  push(1); break;
+
+        case 0x37:
+        {
+            quint8 b = operand();
+            quint32 value = 2u << (b & 0x1f);
+            if (b & 0x20) value--;
+            if (b & 0x40) value = ~value;
+            push(value);
+            break;
+        }
+
+        case 0x38:
+        case 0x39:
+        case 0x3a:
+        case 0x3b:
+        {
+            quint32 value = 0;
+            for (int i = 0; i <= op - 0x38; i++)
+                value = value << 8 | operand();
+            push(value);
+            break;
+        }
+
+        // only reading a special register, which is all --profile needs
+        case 0x3f:
+        {
+            quint8 b = operand();
+            if ((b & 0xe0) != 0x80)
+            {
+                fail(QString("register bytecode $%1 at $%2 is not simulated").arg(b, 0, 16).arg(at, 0, 16));
+                break;
+            }
+            instructions(_costs.reg);
+            push(source(0x1e0 | (b & 0x1f)));
+            break;
+        }
+
+        default:
+            fail(QString("bytecode $%1 at $%2 is not simulated").arg(op, 0, 16).arg(at, 0, 16));
+            break;
+    }
+}
+
+QByteArray Simulator::dump(quint32 offset, int size) const
+{
+    return _hub.mid(_pbase + offset, size);
+}
+
+bool Simulator::spin(const Emitter & emitter, int method, quint64 limit)
+{
+    reset(0);
+
+    QByteArray image = emitter.image();
+    if (ObjectBase + image.size() + emitter._layout._size > (quint32) HubSize)
+    {
+        fail("object does not fit in hub RAM");
+        return false;
+    }
+
+    memcpy(_hub.data() + ObjectBase, image.constData(), image.size());
+    _pbase = ObjectBase;
+    _vbase = (ObjectBase + image.size() + 3) & ~3;
+    _stack = _dcurr = _vbase + emitter._layout._size;
+
+    MethodExpr * start = NULL;
+    foreach (MethodCode m, emitter._methods)
+    {
+        SimProfile p;
+        p.name = m.method->_name->_ident;
+        p.calls = p.cycles = p.self = p.steps = 0;
+
+        _profileIndex[m.index] = _profile.size();
+        _profile.append(p);
+
+        if (m.index == method)
+            start = m.method;
+    }
+
+    if (start == NULL)
+    {
+        fail(QString("no method %1 to run").arg(method));
+        return false;
+    }
+
+    // the first method is started as if called with zero arguments
+    anchor(false);
+    for (int i = 0; i < start->_params.size(); i++)
+        push(0);
+    call(method);
+
+    while (!_finished && _error.isEmpty() && _clock < limit)
+        step();
+
+    // methods still running when the limit was hit have their time so far
+    while (!_frames.isEmpty())
+    {
+        SimFrame frame = _frames.takeLast();
+        if (frame.method >= 0)
+            account(frame);
+    }
+
+    return _error.isEmpty();
+}
+
+quint32 Simulator::source(quint32 reg)
+{
+    switch (reg)
+    {
+        case 0x1f1: return (quint32) _clock;   // CNT
+        case 0x1f2: return 0;                  // INA
+        case 0x1f3: return 0;                  // INB
+        default:    return _cogRam[reg];
+    }
+}
+
+// bit C:Z of the four bit condition field says whether to execute
+bool Simulator::condition(quint32 code)
+{
+    return (code >> ((_c ? 2 : 0) | (_z ? 1 : 0))) & 1;
+}
+
+/*
+ * Executes the cog instruction at pc and leaves the address of the next
+ * one in next. Returns true if the instruction was a taken call, so the
+ * profile can count how often each routine is entered.
+ */
+bool Simulator::execute(quint32 pc, quint32 & next)
+{
+    quint32 i = _cogRam[pc];
+    next = (pc + 1) & 0x1ff;
+    _steps++;
+
+    quint32 op = i >> 26;
+    bool wz = (i >> 25) & 1;
+    bool wc = (i >> 24) & 1;
+    bool wr = (i >> 23) & 1;
+    bool immediate = (i >> 22) & 1;
+    quint32 d = (i >> 9) & 0x1ff;
+    quint32 s = i & 0x1ff;
+
+    if (!condition((i >> 18) & 0xf))
+    {
+        instructions(1);
+        return false;
+    }
+
+    quint32 dv = source(d);
+    quint32 sv = immediate ? s : source(s);
+    quint32 r = dv;
+    bool c = _c;
+    bool extended = false;
+    bool called = false;
+    quint64 cycles = 4;
+
+    switch (op)
+    {
+        case 0x00:
+        case 0x01:
+        case 0x02:
+            hubAccess();
+            cycles = 0;
+            if (wr)
+                r = read(sv, 1 << op);
+            else
+                write(sv, 1 << op, dv);
+            break;
+
+        case 0x03:
+            hubAccess();
+            cycles = 0;
+            if ((s & 7) == 1)
+                r = 1;
+            else if ((s & 7) == 3 && (dv & 7) == 1)
+                _finished = true;
+            break;
+
+        case 0x04: case 0x05: case 0x06: case 0x07:
+            fail(QString("undefined instruction $%1 at $%2").arg(i, 8, 16).arg(pc, 0, 16));
+            return false;
+
+        case 0x08: r = rotateRight(dv, sv); c = dv & 1; break;
+        case 0x09: r = rotateLeft(dv, sv); c = dv >> 31; break;
+        case 0x0a: r = dv >> (sv & 31); c = dv & 1; break;
+        case 0x0b: r = dv << (sv & 31); c = dv >> 31; break;
+        case 0x0c:
+            r = (sv & 31) ? dv >> (sv & 31) | (_c ? ~(0xffffffff >> (sv & 31)) : 0) : dv;
+            c = dv & 1;
+            break;
+        case 0x0d:
+            r = (sv & 31) ? dv << (sv & 31) | (_c ? (1u << (sv & 31)) - 1 : 0) : dv;
+            c = dv >> 31;
+            break;
+        case 0x0e: r = (qint32) dv >> (sv & 31); c = dv & 1; break;
+        case 0x0f: spinMath(0xef, dv, 0u - sv, r); c = dv & 1; break;
+
+        case 0x10: c = (qint32) dv < (qint32) sv; r = c ? sv : dv; break;
+        case 0x11: c = (qint32) dv < (qint32) sv; r = c ? dv : sv; break;
+        case 0x12: c = dv < sv; r = c ? sv : dv; break;
+        case 0x13: c = dv < sv; r = c ? dv : sv; break;
+
+        case 0x14: r = (dv & ~0x1ff) | (sv & 0x1ff); break;
+        case 0x15: r = (dv & ~(0x1ff << 9)) | (sv & 0x1ff) << 9; break;
+        case 0x16: r = (dv & 0x7fffff) | (sv & 0x1ff) << 23; break;
+
+        case 0x17:
+            r = (dv & ~0x1ff) | next;
+            c = false;
+            called = wr;
+            if (!wr && sv == pc && ((i >> 18) & 0xf) == 0xf)
+                _finished = true;   // jmp #$ never gets anywhere
+            next = sv & 0x1ff;
+            break;
+
+        case 0x18: r = dv & sv; c = parity(r); break;
+        case 0x19: r = dv & ~sv; c = parity(r); break;
+        case 0x1a: r = dv | sv; c = parity(r); break;
+        case 0x1b: r = dv ^ sv; c = parity(r); break;
+        case 0x1c: r = (dv & ~sv) | (_c ? sv : 0); c = parity(r); break;
+        case 0x1d: r = (dv & ~sv) | (!_c ? sv : 0); c = parity(r); break;
+        case 0x1e: r = (dv & ~sv) | (_z ? sv : 0); c = parity(r); break;
+        case 0x1f: r = (dv & ~sv) | (!_z ? sv : 0); c = parity(r); break;
+
+        case 0x20: r = dv + sv; c = r < dv; break;
+        case 0x21: r = dv - sv; c = dv < sv; break;
+        case 0x22:
+        {
+            quint32 a = (qint32) sv < 0 ? -sv : sv;
+            r = dv + a;
+            c = r < dv;
+            break;
+        }
+        case 0x23:
+        {
+            quint32 a = (qint32) sv < 0 ? -sv : sv;
+            r = dv - a;
+            c = dv < a;
+            break;
+        }
+        case 0x24: case 0x25: case 0x26: case 0x27:
+        {
+            bool flag = op < 0x26 ? _c : _z;
+            bool negate = (op & 1) ? !flag : flag;
+            r = negate ? dv - sv : dv + sv;
+            c = negate ? overflow(dv, -sv, r) : overflow(dv, sv, r);
+            break;
+        }
+
+        case 0x28: r = sv; c = sv >> 31; break;
+        case 0x29: r = -sv; c = sv >> 31; break;
+        case 0x2a: r = (qint32) sv < 0 ? -sv : sv; c = sv >> 31; break;
+        case 0x2b: r = (qint32) sv < 0 ? sv : -sv; c = sv >> 31; break;
+        case 0x2c: case 0x2d: case 0x2e: case 0x2f:
+        {
+            bool flag = op < 0x2e ? _c : _z;
+            bool negate = (op & 1) ? !flag : flag;
+            r = negate ? -sv : sv;
+            c = sv >> 31;
+            break;
+        }
+
+        case 0x30: r = dv - sv; c = (qint32) dv < (qint32) sv; break;
+        case 0x31:
+            r = dv - sv - _c;
+            c = (qint64) (qint32) dv < (qint64) (qint32) sv + _c;
+            extended = true;
+            break;
+        case 0x32:
+        {
+            quint64 t = (quint64) dv + sv + _c;
+            r = t;
+            c = t >> 32;
+            extended = true;
+            break;
+        }
+        case 0x33:
+            r = dv - sv - _c;
+            c = (quint64) dv < (quint64) sv + _c;
+            extended = true;
+            break;
+        case 0x34: r = dv + sv; c = overflow(dv, sv, r); break;
+        case 0x35: r = dv - sv; c = overflow(dv, -sv, r); break;
+        case 0x36: r = dv + sv + _c; c = overflow(dv, sv, r); extended = true; break;
+        case 0x37: r = dv - sv - _c; c = overflow(dv, -sv, r); extended = true; break;
+        case 0x38: c = dv >= sv; r = c ? dv - sv : dv; break;
+
+        case 0x39:
+            r = dv - 1;
+            c = dv == 0;
+            if (r != 0) next = sv; else cycles = 8;
+            break;
+        case 0x3a:
+            if (dv != 0) next = sv; else cycles = 8;
+            c = false;
+            break;
+        case 0x3b:
+            if (dv == 0) next = sv; else cycles = 8;
+            c = false;
+            break;
+
+        case 0x3c:
+        case 0x3d:
+            // nothing drives the pins, so a wait the idle INA cannot
+            // satisfy would never end
+            if (((source(0x1f2) & sv) == dv) != (op == 0x3c))
+                _finished = true;
+            cycles = 6;
+            break;
+
+        case 0x3e:
+            cycles = 6 + (quint32) (dv - (quint32) (_clock + 6));
+            r = dv + sv;
+            c = r < dv;
+            break;
+
+        case 0x3f:
+            cycles = 7;
+            break;
+    }
+
+    _clock += cycles;
+
+    if (wz) _z = extended ? (r == 0 && _z) : r == 0;
+    if (wc) _c = c;
+    if (wr) _cogRam[d] = r;
+
+    return called;
+}
+
+bool Simulator::cog(const Assembler & assembler, quint64 limit)
+{
+    reset(1);
+
+    foreach (AsmWord w, assembler._code)
+    {
+        if (w.address < 0x1f0)
+            _cogRam[w.address] = w.code;
+        else
+            fail(QString("code at $%1 overlaps the special registers").arg(w.address, 0, 16));
+    }
+
+    // every address belongs to the last label at or before it
+    QVector<int> routine(512, -1);
+    foreach (AsmLineExpr * line, assembler._lines)
+    {
+        if (line->_label->_ident.isEmpty() || line->_address < 0 || line->_address >= 512)
+            continue;
+        if (routine[line->_address] >= 0)
+            continue;
+
+        SimProfile p;
+        p.name = line->_label->_ident;
+        p.calls = p.cycles = p.self = p.steps = 0;
+        routine[line->_address] = _profile.size();
+        _profile.append(p);
+    }
+
+    if (routine[0] < 0)
+    {
+        SimProfile p;
+        p.name = "(entry)";
+        p.calls = p.cycles = p.self = p.steps = 0;
+        routine[0] = _profile.size();
+        _profile.append(p);
+    }
+
+    for (int a = 1; a < 512; a++)
+    {
+        if (routine[a] < 0)
+            routine[a] = routine[a - 1];
+    }
+
+    _profile[routine[0]].calls++;
+
+    quint32 pc = 0;
+    while (!_finished && _error.isEmpty() && _clock < limit)
+    {
+        quint64 before = _clock;
+        quint32 next;
+        bool called = execute(pc, next);
+
+        SimProfile & p = _profile[routine[pc]];
+        p.steps++;
+        p.cycles += _clock - before;
+        p.self += _clock - before;
+
+        if (called)
+            _profile[routine[next]].calls++;
+        pc = next;
+    }
+
+    return _error.isEmpty();
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "emitter.h"
+#include "assembler.h"
+
+struct SimProfile
+{
+    QString name;
+    quint64 calls;
+    quint64 cycles;
+    quint64 self;
+    quint64 steps;
+};
+
+struct SimFrame
+{
+    int method;
+    quint32 dbase;
+    quint32 pcurr;
+    bool keep;
+    quint64 entered;
+    quint64 children;
+};
+
+/*
+ * How many cog instructions each part of the Spin interpreter takes,
+ * besides its hub accesses, which the simulator times on its own.
+ *
+ * The defaults are rough counts of the work each handler of the ROM
+ * interpreter does, not timings taken on a chip, so the clock counts they
+ * give are estimates. Counts measured on hardware, for instance by timing
+ * a loop of one bytecode with cnt, can be loaded over them from a file of
+ * "name = count" lines, with # starting a comment; the names are those
+ * below, except that ret is "return" and reg is "register".
+ */
+
+struct SpinCosts
+{
+    int dispatch;   // step pcurr, look up the handler and jump to it
+    int operand;    // shift in each further byte of an operand
+    int stack;      // move dcurr for a push or a pop
+    int anchor;     // save pbase, vbase, dbase and dcall
+    int call;       // find the method and build its frame
+    int ret;        // restore the caller's frame
+    int jump;       // sign-extend the offset and add it
+    int math;       // pick the operator and apply it
+    int multiply;   // each of the 32 shift-and-add steps of * and **
+    int divide;     // each of the 32 shift-and-subtract steps of / and //
+    int reg;        // decode a special register and move it
+
+    SpinCosts();
+    bool load(const QByteArray & text, QString & error);
+};
+
+/*
+ * Runs compiled code on the build host and counts system clocks.
+ *
+ * Cog instructions take 4 clocks. Hub accesses take 8, after waiting for
+ * the cog's turn at the hub, which comes round every 16 clocks; the time
+ * spent waiting is kept separately, since it is what code layout changes.
+ *
+ * Spin bytecode is timed as the ROM interpreter would run it: every
+ * bytecode is fetched from hub, the stack and the variables live in hub,
+ * and each handler costs the cog instructions _costs gives it. Unless
+ * those are measured, Spin clock counts are estimates, good for comparing
+ * two versions of the same program rather than for predicting a run.
+ */
+
+class Simulator
+{
+    QByteArray _hub;
+    quint32 _cogRam[512];
+    int _slot;
+    bool _z;
+    bool _c;
+
+    quint32 _pbase;
+    quint32 _vbase;
+    quint32 _dbase;
+    quint32 _dcurr;
+    quint32 _pcurr;
+    quint32 _stack;
+    QList<SimFrame> _frames;
+    QHash<int, int> _profileIndex;
+    int _running;
+
+    void reset(int slot);
+    void fail(QString message);
+
+    void instructions(int count);
+    void hubAccess();
+
+    quint32 read(quint32 address, int size);
+    void write(quint32 address, int size, quint32 value);
+    quint8 fetch();
+    quint8 operand();
+    void push(quint32 value);
+    quint32 pop();
+
+    void anchor(bool keep);
+    void call(int index);
+    void leave();
+    void account(const SimFrame & frame);
+    void memory(quint8 op);
+    void step();
+
+    quint32 source(quint32 reg);
+    bool condition(quint32 code);
+    bool execute(quint32 pc, quint32 & next);
+
+public:
+    quint64 _clock;
+    quint64 _hubWait;
+    quint64 _steps;
+    quint32 _result;
+    bool _finished;
+    QString _error;
+    QList<SimProfile> _profile;
+    SpinCosts _costs;
+
+    Simulator();
+
+    bool spin(const Emitter & emitter, int method, quint64 limit);
+
+    // hub bytes at an offset from the start of the object that last ran
+    QByteArray dump(quint32 offset, int size) const;
+    bool cog(const Assembler & assembler, quint64 limit);
+};
@@ -3,6 +3,8 @@ include(flex.pri)
 
 LIBS += -lfl -ly
 
+QT += concurrent
+
 TEMPLATE = app
 TARGET = spindrake
 INCLUDEPATH += .
@@ -12,6 +14,23 @@ CONFIG += c++11
 SOURCES += \
     tree.cpp \
     func.cpp \
+    resolver.cpp \
+    server.cpp \
+    project.cpp \
+    watcher.cpp \
+    folder.cpp \
+    exports.cpp \
+    inliner.cpp \
+    pasm.cpp \
+    assembler.cpp \
+    emitter.cpp \
+    simulator.cpp \
+    varlayout.cpp \
+    pool.cpp \
+    ranges.cpp \
+    parse.cpp \
+    profile.cpp \
+    astwriter.cpp \
     main.cpp \
 
 HEADERS += \
@@ -20,7 +39,27 @@ HEADERS += \
     printer.h \
     treeprinter.h \
     func.h \
-    navigator.h \
+    walker.h \
+    resolver.h \
+    parse.h \
+    symbols.h \
+    server.h \
+    project.h \
+    watcher.h \
+    binder.h \
+    folder.h \
+    exports.h \
+    inliner.h \
+    pasm.h \
+    assembler.h \
+    emitter.h \
+    simulator.h \
+    varlayout.h \
+    pool.h \
+    ranges.h \
+    profile.h \
+    astreader.h \
+    astwriter.h \
 
 FLEXSOURCES += lexer.l
 BISONSOURCES += parser.y
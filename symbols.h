@@ -0,0 +1,73 @@
+#pragma once
+
+#include "tree.h"
+
+struct Symbol
+{
+    IdentExpr * ident;
+    Expr * definition;
+};
+
+class SymbolTable
+{
+    void add(IdentExpr * ident, Expr * definition)
+    {
+        if (ident->ident().isEmpty()) return;
+        if (_symbols.contains(ident->ident())) return;
+
+        Symbol s;
+        s.ident = ident;
+        s.definition = definition;
+        _symbols[ident->ident()] = s;
+    }
+
+public:
+    QHash<QString, Symbol> _symbols;
+
+    SymbolTable(ObjectExpr * object)
+    {
+        for (Expr * b : object->_blocks)
+        {
+            BlockExpr * block = (BlockExpr *) b;
+
+            for (Expr * l : block->_lines)
+            {
+                switch (block->_block)
+                {
+                    case ConBlock:
+                        if (ConAssignExpr * c = dynamic_cast<ConAssignExpr *>(l))
+                            add(c->_ident, c);
+                        break;
+                    case DatBlock:
+                        add(((DatLineExpr *) l)->_symbol, l);
+                        break;
+                    case VarBlock:
+                        add(((VarLineExpr *) l)->_ident, l);
+                        break;
+                    case ObjBlock:
+                        add(((ObjLineExpr *) l)->_alias, l);
+                        break;
+                    case AsmBlock:
+                        add(((AsmLineExpr *) l)->_label, l);
+                        break;
+                    case PubBlock:
+                    case PriBlock:
+                        add(((MethodExpr *) l)->_name, l);
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+    }
+
+    bool contains(QString name)
+    {
+        return _symbols.contains(name.toLower());
+    }
+
+    Symbol lookup(QString name)
+    {
+        return _symbols.value(name.toLower());
+    }
+};
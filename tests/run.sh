@@ -0,0 +1,86 @@
+#!/bin/sh
+#
+# Runs every case in this directory through spindrake and checks what it
+# prints. A case is a .spin file whose comment lines say how to run it
+# and what to look for:
+#
+#   ' args: --vars          options given before the file
+#   ' expect: text          some line of the output contains text
+#   ' reject: text          no line of the output contains text
+#   ' status: 255           the exit status, 0 unless given
+#   ' same-as: --chunks 0   the output is the same with these options
+#   ' then: --read-ast f    run again with these options, without the
+#                           file, and check both outputs together
+#
+# Cases run from this directory, so OBJ lines find the objects in lib/.
+# Files a case writes go in out/, which is removed afterwards.
+# Usage: tests/run.sh [path to spindrake]
+
+spindrake=${1:-spindrake}
+case "$spindrake" in
+    */*) spindrake=$(cd "$(dirname "$spindrake")" && pwd)/$(basename "$spindrake") ;;
+esac
+
+cd "$(dirname "$0")" || exit 1
+
+failed=0
+total=0
+
+mkdir -p out || exit 1
+
+for case in *.spin
+do
+    total=$((total + 1))
+
+    args=$(sed -n "s/^' args: //p" "$case")
+    status=$(sed -n "s/^' status: //p" "$case")
+    output=$("$spindrake" $args "$case" 2>&1)
+    actual=$?
+
+    then=$(sed -n "s/^' then: //p" "$case")
+    if [ -n "$then" ]; then
+        output="$output
+$("$spindrake" $then 2>&1)"
+    fi
+
+    problems=""
+    if [ "$actual" != "${status:-0}" ]; then
+        problems="$problems
+    exit status $actual, expected ${status:-0}"
+    fi
+
+    same=$(sed -n "s/^' same-as: //p" "$case")
+    if [ -n "$same" ] && [ "$output" != "$("$spindrake" $same "$case" 2>&1)" ]; then
+        problems="$problems
+    output differs from: $same"
+    fi
+
+    while IFS= read -r text
+    do
+        printf '%s\n' "$output" | grep -qF -- "$text" ||
+            problems="$problems
+    missing: $text"
+    done <<EOF
+$(sed -n "s/^' expect: //p" "$case")
+EOF
+
+    while IFS= read -r text
+    do
+        [ -z "$text" ] && continue
+        printf '%s\n' "$output" | grep -qF -- "$text" &&
+            problems="$problems
+    unexpected: $text"
+    done <<EOF
+$(sed -n "s/^' reject: //p" "$case")
+EOF
+
+    if [ -n "$problems" ]; then
+        echo "FAIL $case$problems"
+        failed=$((failed + 1))
+    fi
+done
+
+rm -rf out
+
+echo "$failed of $total cases failed"
+[ "$failed" -eq 0 ]
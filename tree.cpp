@@ -1,11 +1,44 @@
 #include "tree.h"
+#include "walker.h"
 
+#include <QVector>
+
+// folds each node on the way back up, once its children are folded
+class ConstantFolder : public Walker<ConstantFolder>
+{
+public:
+    static const bool leaves = true;
+
+    template <class T>
+    void leave(T & expr)
+    {
+        expr.foldChildren();
+    }
+};
+
+void Expr::fold()
+{
+    ConstantFolder().walk(this);
+}
+
+/*
+ * Replaces a folded expression with its value if it is constant. Its
+ * operands have been folded already, so an operator over one that is not
+ * a number cannot be constant; not asking it again keeps folding a long
+ * chain that does not fold linear.
+ */
 Expr * foldConstants(Expr * exp)
 {
-    exp->fold();
+    if (exp->_kind == UnaryKind && ((UnaryExpr *) exp)->_val->_kind != NumberKind)
+        return exp;
+
+    if (exp->_kind == BinaryKind && (((BinaryExpr *) exp)->_left->_kind != NumberKind
+                                  || ((BinaryExpr *) exp)->_right->_kind != NumberKind))
+        return exp;
+
     if (!exp->isConstant()) return exp;
     quint32 v = exp->value();
-    Expr * newexp = new NumberExpr(10, v);
+    Expr * newexp = new NumberExpr(10, v, exp->isFloat());
 
     if (newexp != NULL)
     {
@@ -18,6 +51,42 @@ Expr * foldConstants(Expr * exp)
     }
 }
 
+void foldStatements(ExprList & statements)
+{
+    for (int i = 0; i < statements.size(); i++)
+    {
+        statements[i] = foldConstants(statements[i]);
+    }
+}
+
+// the nodes waiting to be deleted by the outermost dispose() on this thread
+static thread_local QVector<Expr *> * disposing = NULL;
+
+void dispose(Expr * expr)
+{
+    if (expr == NULL)
+        return;
+
+    if (disposing != NULL)
+    {
+        disposing->append(expr);
+        return;
+    }
+
+    QVector<Expr *> pending;
+    pending.append(expr);
+    disposing = &pending;
+
+    while (!pending.isEmpty())
+    {
+        Expr * next = pending.last();
+        pending.removeLast();
+        delete next;
+    }
+
+    disposing = NULL;
+}
+
 void deleteHash(QHash<QString, Expr *> & hash)
 {
     foreach (QString i, hash.keys())
@@ -26,3 +95,53 @@ void deleteHash(QHash<QString, Expr *> & hash)
     }
 }
 
+
+/*
+ * Appends the bytes of a DAT line to data, aligning each item to its own
+ * size. Strings give one element per character. Returns false if any item
+ * is not constant, in which case zeros stand in for it.
+ */
+bool encodeData(DatLineExpr * line, QByteArray & data)
+{
+    bool ok = true;
+
+    for (Expr * i : line->_items)
+    {
+        DatItemExpr * item = (DatItemExpr *) i;
+        DataType type = item->_size->_val != NoDataType ? item->_size->_val : line->_align->_val;
+        int n = type == DataByte ? 1 : type == DataWord ? 2 : 4;
+
+        QList<quint32> values;
+        StringExpr * s = dynamic_cast<StringExpr *>(item->_data);
+
+        if (s != NULL && !s->isConstant())
+        {
+            QByteArray text = s->_string.toLatin1();
+            for (int c = 0; c < text.size(); c++)
+                values.append((quint8) text[c]);
+        }
+        else if (item->_data->isConstant())
+        {
+            values.append(item->_data->value());
+        }
+        else
+        {
+            values.append(0);
+            ok = false;
+        }
+
+        while (data.size() % n)
+            data.append('\0');
+
+        for (quint32 c = 0; c < qMax(item->_count->value(), (quint32) 1); c++)
+        {
+            foreach (quint32 v, values)
+            {
+                for (int b = 0; b < n; b++)
+                    data.append((char) (v >> (8 * b)));
+            }
+        }
+    }
+
+    return ok;
+}
@@ -4,67 +4,90 @@
 #include "func.h"
 
 
-class AbstractVisitor;
-
 class Expr
 {
 public:
+    // which node this is, so that walkers can dispatch without a virtual call
+    const ExprKind _kind;
     quint32 num;
+
+    Expr(ExprKind kind)
+        : _kind(kind)
+    {
+    }
+
     virtual ~Expr() {}
     virtual bool isConstant() = 0;
     virtual quint32 value() = 0;
-    virtual void fold() = 0;
 
-    virtual void accept(AbstractVisitor & visitor) = 0;
-};
+    // folds every constant expression under this node into a number,
+    // children before their parents, without recursing
+    void fold();
 
-class AbstractVisitor {
-public:
-    virtual void visit(NumberExpr & expr) = 0;
-    virtual void visit(IdentExpr & expr) = 0;
-    virtual void visit(AddressExpr & expr) = 0;
-    virtual void visit(LiteralExpr & expr) = 0;
-    virtual void visit(DataTypeExpr & expr) = 0;
-    virtual void visit(BlockExpr & expr) = 0;
-    virtual void visit(DatLineExpr & expr) = 0;
-    virtual void visit(DatItemExpr & expr) = 0;
-    virtual void visit(UnaryExpr & expr) = 0;
-    virtual void visit(BinaryExpr & expr) = 0;
-    virtual void visit(WrapExpr & expr) = 0;
-    virtual void visit(ObjectExpr & expr) = 0;
-
-    virtual void visit(ConAssignExpr & expr) = 0;
+    // replaces the children that are constant with their values, once the
+    // children themselves have been folded
+    virtual void foldChildren() = 0;
+
+    // whether value() is the bits of a single-precision float
+    virtual bool isFloat() { return false; }
 };
 
+// deletes a node and everything under it, without recursing however deep
+// the tree is; destructors hand their children here
+void dispose(Expr * expr);
+
+
 
 class NumberExpr : public Expr
 {
 public:
     int _base;
+    bool _float;
+
     virtual ~NumberExpr() {}
-    NumberExpr(int base, quint32 value)
+    NumberExpr(int base, quint32 value, bool isFloat = false)
+        : Expr(NumberKind)
     {
         num = value;
         _base = base;
+        _float = isFloat;
     }
 
     bool isConstant()
     {
         return true;
     }
+
+    bool isFloat()
+    {
+        return _float;
+    }
     
     quint32 value()
     {
         return num;
     }
 
-    void fold() {}
-
-    void accept(AbstractVisitor & visitor) override { visitor.visit(*this); }
+    void foldChildren() {}
 };
 
 
 Expr * foldConstants(Expr * exp);
+void foldStatements(ExprList & statements);
+
+// takes over the entries of a list the parser built, and frees the list;
+// the parser gives NULL for a list that stayed empty. Up to four entries
+// are copied into the node's own storage, so only longer lists allocate.
+inline void adopt(ExprList & to, ExprList * from)
+{
+    if (from == NULL)
+        return;
+
+    to = *from;
+    delete from;
+}
+
+bool encodeData(DatLineExpr * line, QByteArray & data);
 
 
 
@@ -72,30 +95,51 @@ class IdentExpr : public Expr
 {
 public:
     QString _ident;
+    int _line;
+    int _column;
+    Expr * _binding;
+
+    // the OBJ alias of a child object's constant, written alias#name
+    QString _object;
+
     virtual ~IdentExpr() {}
-    IdentExpr(QString ident)
+    IdentExpr(const QString & ident, int line = 0, int column = 0)
+        : Expr(IdentKind)
     {
         _ident = ident;
+        _line = line;
+        _column = column;
+        _binding = NULL;
     }
 
     bool isConstant()
     {
-        return false;
+        if (_binding == NULL) return false;
+        return _binding->isConstant();
     }
 
     QString ident()
     {
-        return _ident.toLower();
+        return qualified().toLower();
+    }
+
+    QString qualified()
+    {
+        return _object.isEmpty() ? _ident : _object + "#" + _ident;
     }
 
     quint32 value()
     {
-        return 0;
+        if (!isConstant()) return 0;
+        return _binding->value();
     }
 
-    void fold() {}
+    bool isFloat()
+    {
+        return _binding != NULL && _binding->isFloat();
+    }
 
-    void accept(AbstractVisitor & visitor) override { visitor.visit(*this); }
+    void foldChildren() {}
 };
 
 class AddressExpr : public Expr
@@ -106,11 +150,12 @@ public:
 
     virtual ~AddressExpr()
     {
-        delete _ident;
-        delete _offset;
+        dispose(_ident);
+        dispose(_offset);
     }
 
     AddressExpr(Expr * ident, Expr * offset)
+        : Expr(AddressKind)
     {
         _ident = (IdentExpr *) ident;
         _offset = offset;
@@ -127,12 +172,10 @@ public:
         return _offset->value();
     }
 
-    void fold()
+    void foldChildren()
     {
         _offset = foldConstants(_offset);
     }
-
-    void accept(AbstractVisitor & visitor) override { visitor.visit(*this); }
 };
 
 
@@ -143,10 +186,11 @@ public:
 
     virtual ~LiteralExpr()
     {
-        delete _val;
+        dispose(_val);
     }
 
     LiteralExpr(Expr * val)
+        : Expr(LiteralKind)
     {
         _val = val;
     }
@@ -162,12 +206,10 @@ public:
         return _val->value();
     }
 
-    void fold()
+    void foldChildren()
     {
         _val = foldConstants(_val);
     }
-
-    void accept(AbstractVisitor & visitor) override { visitor.visit(*this); }
 };
 
 
@@ -178,6 +220,7 @@ public:
 
     virtual ~DataTypeExpr() {}
     DataTypeExpr(DataType val = NoDataType)
+        : Expr(DataTypeKind)
     {
         _val = val;
     }
@@ -204,9 +247,7 @@ public:
         return 0;
     }
 
-    void fold() {}
-
-    void accept(AbstractVisitor & visitor) override { visitor.visit(*this); }
+    void foldChildren() {}
 };
 
 
@@ -214,23 +255,23 @@ class BlockExpr : public Expr
 {
 public:
     Block _block;
-    QList<Expr *> * _lines;
+    ExprList _lines;
 
     virtual ~BlockExpr()
     {
-        foreach(Expr * l, *_lines) { delete l; }
-        delete _lines;
+        for (Expr * l : _lines) { dispose(l); }
     }
 
-    BlockExpr(Block block, QList<Expr *> * lines)
+    BlockExpr(Block block, ExprList * lines)
+        : Expr(BlockKind)
     {
         _block = block;
-        _lines = lines;
+        adopt(_lines, lines);
     }
 
     bool isConstant()
     {
-        foreach(Expr * l, *_lines)
+        for (Expr * l : _lines)
         {
             if (!l->isConstant())
                 return false;
@@ -244,15 +285,7 @@ public:
         return 0;
     }
 
-    void fold()
-    {
-        foreach(Expr * l, *_lines)
-        {
-            l->fold();
-        }
-    }
-
-    void accept(AbstractVisitor & visitor) override { visitor.visit(*this); }
+    void foldChildren() {}
 };
 
 
@@ -262,32 +295,32 @@ public:
     IdentExpr * _symbol;
     DataTypeExpr * _align;
 
-    QList<Expr *> * _items;
+    ExprList _items;
 
     virtual ~DatLineExpr()
     {
-        delete _symbol;
-        delete _align;
+        dispose(_symbol);
+        dispose(_align);
 
-        foreach(Expr * i, *_items)
+        for (Expr * i : _items)
         {
-            delete i;
+            dispose(i);
         }
-        delete _items;
     }
 
     DatLineExpr(Expr * symbol, 
                 Expr * align,
-                QList<Expr *> * items)
+                ExprList * items)
+        : Expr(DatLineKind)
     {
         _symbol = (IdentExpr *) symbol;
         _align = (DataTypeExpr *) align;
-        _items = items;
+        adopt(_items, items);
     }
 
     bool isConstant()
     {
-        foreach(Expr * i, *_items)
+        for (Expr * i : _items)
         {
             if (!i->isConstant())
                 return false;
@@ -301,15 +334,7 @@ public:
         return 0;
     }
 
-    void fold()
-    {
-        foreach(Expr * l, *_items)
-        {
-            l->fold();
-        }
-    }
-
-    void accept(AbstractVisitor & visitor) override { visitor.visit(*this); }
+    void foldChildren() {}
 };
 
 
@@ -322,12 +347,13 @@ public:
 
     virtual ~DatItemExpr()
     {
-        delete _size;
-        delete _data;
-        delete _count;
+        dispose(_size);
+        dispose(_data);
+        dispose(_count);
     }
 
     DatItemExpr(Expr * size, Expr * data, Expr * count)
+        : Expr(DatItemKind)
     {
         _size = (DataTypeExpr *) size;
         _data = (Expr *) data;
@@ -348,13 +374,11 @@ public:
         return _data->value();
     }
 
-    void fold()
+    void foldChildren()
     {
         _data = foldConstants(_data);
         _count = foldConstants(_count);
     }
-
-    void accept(AbstractVisitor & visitor) override { visitor.visit(*this); }
 };
 
 
@@ -362,30 +386,36 @@ class UnaryExpr : public Expr
 {
 public:
     Expr * _val;
-    QString _op;
+    QLatin1String _op;
     bool _post;
 
     virtual ~UnaryExpr()
     {
-        delete _val;
+        dispose(_val);
     }
 
-    UnaryExpr(Expr * val, QString op)
+    // operators are string literals, so the node only points at them
+    UnaryExpr(Expr * val, const char * op)
+        : Expr(UnaryKind)
     {
         _val = val;
-        _op = op;
+        _op = QLatin1String(op);
         _post = true;
     }
 
-    UnaryExpr(QString op, Expr * val)
+    UnaryExpr(const char * op, Expr * val)
+        : Expr(UnaryKind)
     {
         _val = val;
-        _op = op;
+        _op = QLatin1String(op);
         _post = false;
     }
 
+    // a float can only be negated, which flips its sign; like a binary
+    // operator on floats, anything else is left for the emitter to report
     bool isConstant()
     {
+        if (_val->isFloat() && (_post || _op != "-")) return false;
         return _val->isConstant();
     }
 
@@ -395,6 +425,10 @@ public:
 
         quint32 v = _val->value();
 
+        // negating a float only flips its sign
+        if (isFloat())
+            return v ^ 0x80000000;
+
         if (_post)
         {
             if (_op == "++")        return v++;
@@ -405,23 +439,29 @@ public:
         }
         else
         {
-            if (_op == "not" )      return !v;
-            else if (_op == "-")    return -v;
-            else if (_op == "!")    return ~v;
-            else if (_op == "++")   return ++v;
+            // the math operators fold exactly as the interpreter runs them
+            quint32 r;
+            int op = spinUnaryOp(_op);
+            if (op >= 0 && spinMath(op, v, 0, r))
+                return r;
+
+            if (_op == "++")        return ++v;
             else if (_op == "--")   return --v;
-            else if (_op == "~~")   { if (v & (1 << 15)) v |= 0xffff0000; return v; }
-            else if (_op == "~")    { if (v & (1 << 7))  v |= 0xffffff00; return v; }
+            else if (_op == "~~")   return (quint32) ((qint32) (v << 16) >> 16);
+            else if (_op == "~")    return (quint32) ((qint32) (v << 24) >> 24);
             else return 0;
         }
     }
 
-    void fold()
+    bool isFloat()
     {
-        _val = foldConstants(_val);
+        return !_post && _op == "-" && _val->isFloat();
     }
 
-    void accept(AbstractVisitor & visitor) override { visitor.visit(*this); }
+    void foldChildren()
+    {
+        _val = foldConstants(_val);
+    }
 };
 
 
@@ -431,26 +471,54 @@ class BinaryExpr : public Expr
 {
 public:
     Expr * _left;
-    QString _op;
+    QLatin1String _op;
     Expr * _right;
 
     virtual ~BinaryExpr()
     {
-        delete _left;
-        delete _right;
+        dispose(_left);
+        dispose(_right);
     }
-    BinaryExpr(Expr * left, QString op, Expr * right)
+    BinaryExpr(Expr * left, const char * op, Expr * right)
+        : Expr(BinaryKind)
     {
         _left = left;
-        _op = op;
+        _op = QLatin1String(op);
         _right = right;
     }
 
+    // an operator with a float on either side, which must then be on both
+    bool hasFloat()
+    {
+        return _left->isFloat() || _right->isFloat();
+    }
+
+    /*
+     * Folds to what the interpreter computes, comparisons giving Spin's
+     * TRUE of -1. An assignment is never constant, and neither is a
+     * division by zero, which the emitter reports.
+     */
     bool isConstant()
     {
         if (!_left->isConstant()) return false;
         if (!_right->isConstant()) return false;
-        return true;
+
+        if (hasFloat())
+            return _left->isFloat() && _right->isFloat() && isFloatOp(_op.latin1());
+
+        int op = spinBinaryOp(_op);
+        if (op == 0xf6 || op == 0xf7)
+        {
+            quint32 r;
+            return spinMath(op, _left->value(), _right->value(), r);
+        }
+        return op >= 0;
+    }
+
+    bool isFloat()
+    {
+        return (_op == "+" || _op == "-" || _op == "*" || _op == "/")
+            && _left->isFloat() && _right->isFloat();
     }
 
     quint32 value()
@@ -460,61 +528,18 @@ public:
         quint32 l = _left->value();
         quint32 r = _right->value();
 
-        if (_op == "=" )        return l = r;
-        else if (_op == "+=")   return l = l + r;
-        else if (_op == "-=")   return l = l - r;
-        else if (_op == "*=")   return l = l * r;
-        else if (_op == "//=")  return l = l % r;
-        else if (_op == "/=")   return l = l / r;
-        else if (_op == "<<=")  return l = l << r;
-        else if (_op == ">>=")  return l = l >> r;
-        else if (_op == "~>=")  return l = (quint32) (((qint32) l) >> r);
-        else if (_op == "<-=")  return l = rotateLeft(l, r);
-        else if (_op == "->=")  return l = rotateLeft(l, r);
-        else if (_op == "><=")  return l = reverse(l, r);
-        else if (_op == "&=")   return l = l & r;
-        else if (_op == "|=")   return l = l | r;
-        else if (_op == "^=")   return l = l ^ r;
-
-        else if (_op == "or")   return l || r;
-        else if (_op == "and")  return l && r;
-
-        else if (_op == "==")   return (l == r);
-        else if (_op == "<>")   return (l != r);
-        else if (_op == "<")    return (l < r);
-        else if (_op == ">")    return (l > r);
-        else if (_op == "<=")   return (l <= r);
-        else if (_op == ">=")   return (l >= r);
-
-        else if (_op == "+")    return l + r;
-        else if (_op == "-")    return l - r;
-
-        else if (_op == "*")    return l * r;
-        else if (_op == "//")   return l % r;
-        else if (_op == "/")    return l / r;
-
-        else if (_op == "|")    return l | r;
-        else if (_op == "^")    return l ^ r;
-
-        else if (_op == "&")    return l & r;
-
-        else if (_op == "<<")   return l << r;
-        else if (_op == ">>")   return l >> r;
-        else if (_op == "~>")   return (quint32) (((qint32) l) >> r);
-        else if (_op == "<-")   return rotateLeft(l, r);
-        else if (_op == "->")   return rotateRight(l, r);
-        else if (_op == "><")   return reverse(l, r);
-
-        else return 0;
+        if (hasFloat())
+            floatMath(_op.latin1(), l, r, r);
+        else
+            spinMath(spinBinaryOp(_op), l, r, r);
+        return r;
     }
 
-    void fold()
+    void foldChildren()
     {
         _left = foldConstants(_left);
         _right = foldConstants(_right);
     }
-
-    void accept(AbstractVisitor & visitor) override { visitor.visit(*this); }
 };
 
 
@@ -527,10 +552,11 @@ public:
 
     virtual ~ConAssignExpr()
     {
-        delete expr;
+        dispose(expr);
     }
 
     ConAssignExpr(Expr * ident, Expr * expr)
+        : Expr(ConAssignKind)
     {
         _ident = (IdentExpr *) ident;
         this->expr = expr;
@@ -549,12 +575,513 @@ public:
         return expr->isConstant();
     }
 
-    void fold()
+    bool isFloat()
+    {
+        return expr->isFloat();
+    }
+
+    void foldChildren()
     {
         expr = foldConstants(expr);
     }
+};
 
-    void accept(AbstractVisitor & visitor) override { visitor.visit(*this); }
+
+
+class StringExpr : public Expr
+{
+public:
+    QString _string;
+
+    virtual ~StringExpr() {}
+    StringExpr(const QString & string)
+        : Expr(StringKind)
+    {
+        _string = string;
+    }
+
+    // as in Spin, a single character is its character code; longer
+    // strings are addresses, known once the image is laid out
+    bool isConstant()
+    {
+        return _string.size() == 1;
+    }
+
+    quint32 value()
+    {
+        if (!isConstant()) return 0;
+        return (quint8) _string.toLatin1()[0];
+    }
+
+    void foldChildren() {}
+};
+
+
+
+class ObjLineExpr : public Expr
+{
+public:
+    IdentExpr * _alias;
+    Expr * _count;
+    StringExpr * _file;
+    QString _path;
+
+    virtual ~ObjLineExpr()
+    {
+        dispose(_alias);
+        dispose(_count);
+        dispose(_file);
+    }
+
+    ObjLineExpr(Expr * alias, Expr * count, Expr * file)
+        : Expr(ObjLineKind)
+    {
+        _alias = (IdentExpr *) alias;
+        _count = count;
+        _file = (StringExpr *) file;
+    }
+
+    bool isConstant()
+    {
+        return false;
+    }
+
+    // the count is a plain number, or an index whose brackets are kept
+    quint32 value()
+    {
+        if (_count->_kind == WrapKind) return _count->value();
+        if (!_count->isConstant()) return 0;
+        return _count->value();
+    }
+
+    void foldChildren()
+    {
+        _count = foldConstants(_count);
+    }
+};
+
+
+
+class VarLineExpr : public Expr
+{
+public:
+    DataTypeExpr * _type;
+    IdentExpr * _ident;
+    Expr * _count;
+
+    int _offset;
+
+    virtual ~VarLineExpr()
+    {
+        dispose(_type);
+        dispose(_ident);
+        dispose(_count);
+    }
+
+    VarLineExpr(Expr * type, Expr * ident, Expr * count)
+        : Expr(VarLineKind)
+    {
+        _type = (DataTypeExpr *) type;
+        _ident = (IdentExpr *) ident;
+        _count = count;
+        _offset = -1;
+    }
+
+    int elementSize()
+    {
+        switch (_type->_val)
+        {
+            case DataByte:  return 1;
+            case DataWord:  return 2;
+            default:        return 4;
+        }
+    }
+
+    bool isConstant()
+    {
+        return false;
+    }
+
+    // the count is a plain number, or an index whose brackets are kept
+    quint32 value()
+    {
+        if (_count->_kind == WrapKind) return _count->value();
+        if (!_count->isConstant()) return 0;
+        return _count->value();
+    }
+
+    void foldChildren()
+    {
+        _count = foldConstants(_count);
+    }
+};
+
+
+
+class AsmLineExpr : public Expr
+{
+public:
+    IdentExpr * _label;
+    int _condition;
+    int _mnemonic;
+    ExprList _operands;
+    int _effects;
+    DatLineExpr * _data;
+
+    int _address;
+
+    int _line;
+    int _first_column;
+    int _last_column;
+    QString _text;
+
+    virtual ~AsmLineExpr()
+    {
+        dispose(_label);
+        dispose(_data);
+
+        for (Expr * o : _operands)
+        {
+            dispose(o);
+        }
+    }
+
+    AsmLineExpr(Expr * label,
+                int condition,
+                int mnemonic,
+                ExprList * operands,
+                int effects)
+        : Expr(AsmLineKind)
+    {
+        _label = (IdentExpr *) label;
+        _condition = condition;
+        _mnemonic = mnemonic;
+        adopt(_operands, operands);
+        _effects = effects;
+        _data = NULL;
+        _address = -1;
+        _line = _first_column = _last_column = 0;
+    }
+
+    AsmLineExpr(Expr * label, Expr * data)
+        : Expr(AsmLineKind)
+    {
+        _label = (IdentExpr *) label;
+        _condition = -1;
+        _mnemonic = -1;
+        _effects = 0;
+        _data = (DatLineExpr *) data;
+        _address = -1;
+        _line = _first_column = _last_column = 0;
+    }
+
+    void locate(const YYLTYPE & at, const YYLTYPE & end)
+    {
+        _line = at.first_line;
+        _first_column = at.first_column;
+        _last_column = at.last_column;
+        _text = end.line;
+    }
+
+    // a line is constant once it has been given a cog address
+    bool isConstant()
+    {
+        return _address >= 0;
+    }
+
+    quint32 value()
+    {
+        if (!isConstant()) return 0;
+        return _address;
+    }
+
+    void foldChildren()
+    {
+        for (int i = 0; i < _operands.size(); i++)
+        {
+            // keep the literal so the immediate flag survives
+            if (_operands[i]->_kind != LiteralKind)
+                _operands[i] = foldConstants(_operands[i]);
+        }
+    }
+};
+
+
+
+class MethodExpr : public Expr
+{
+public:
+    Block _block;
+    IdentExpr * _name;
+    ExprList _params;
+    IdentExpr * _result;
+    ExprList _locals;
+    ExprList _body;
+
+    virtual ~MethodExpr()
+    {
+        dispose(_name);
+        dispose(_result);
+
+        for (Expr * p : _params) { dispose(p); }
+        for (Expr * l : _locals) { dispose(l); }
+        for (Expr * s : _body)   { dispose(s); }
+    }
+
+    MethodExpr(Expr * name,
+               ExprList * params,
+               Expr * result,
+               ExprList * locals,
+               ExprList * body)
+        : Expr(MethodKind)
+    {
+        _block = NoBlock;
+        _name = (IdentExpr *) name;
+        adopt(_params, params);
+        _result = (IdentExpr *) result;
+        adopt(_locals, locals);
+        adopt(_body, body);
+    }
+
+    bool isConstant()
+    {
+        return false;
+    }
+
+    quint32 value()
+    {
+        return 0;
+    }
+
+    void foldChildren()
+    {
+        foldStatements(_body);
+    }
+};
+
+
+
+class CallExpr : public Expr
+{
+public:
+    IdentExpr * _name;
+    ExprList _args;
+
+    virtual ~CallExpr()
+    {
+        dispose(_name);
+
+        for (Expr * a : _args) { dispose(a); }
+    }
+
+    CallExpr(Expr * name, ExprList * args)
+        : Expr(CallKind)
+    {
+        _name = (IdentExpr *) name;
+        adopt(_args, args);
+    }
+
+    /*
+     * FLOAT(), TRUNC() and ROUND() convert a constant between long and
+     * float while folding; there is nothing to call for them at run time.
+     */
+    bool isConversion()
+    {
+        QString name = _name->ident();
+        return _args.size() == 1 && (name == "float" || name == "trunc" || name == "round");
+    }
+
+    /*
+     * SQRT(), ABS(), MIN() and MAX() are interpreter math operators written
+     * as calls. Returns the operator's bytecode, or -1 for any other call.
+     */
+    int intrinsic()
+    {
+        QString name = _name->ident();
+
+        if (_args.size() == 1)
+        {
+            if (name == "sqrt")     return 0xf8;
+            if (name == "abs")      return 0xe9;
+        }
+        else if (_args.size() == 2)
+        {
+            if (name == "max")      return 0xe4;
+            if (name == "min")      return 0xe5;
+        }
+        return -1;
+    }
+
+    bool isConstant()
+    {
+        int op = intrinsic();
+        if (op >= 0)
+        {
+            for (Expr * a : _args)
+            {
+                if (!a->isConstant() || a->isFloat()) return false;
+            }
+            return true;
+        }
+
+        if (!isConversion() || !_args[0]->isConstant()) return false;
+
+        qint32 v;
+        if (_name->ident() == "float")
+            return !_args[0]->isFloat();
+        else
+            return _args[0]->isFloat() && floatToInt(_args[0]->value(), _name->ident() == "round", v);
+    }
+
+    quint32 value()
+    {
+        if (!isConstant()) return 0;
+
+        int op = intrinsic();
+        if (op >= 0)
+        {
+            quint32 r = 0;
+            spinMath(op, _args[0]->value(), _args.size() > 1 ? _args[1]->value() : 0, r);
+            return r;
+        }
+
+        qint32 v = _args[0]->value();
+        if (_name->ident() == "float")
+            return intToFloat(v);
+
+        floatToInt(_args[0]->value(), _name->ident() == "round", v);
+        return v;
+    }
+
+    bool isFloat()
+    {
+        return isConversion() && _name->ident() == "float";
+    }
+
+    void foldChildren()
+    {
+        foldStatements(_args);
+    }
+};
+
+
+
+class IfExpr : public Expr
+{
+public:
+    Expr * _condition;
+    ExprList _then;
+    ExprList _else;
+
+    virtual ~IfExpr()
+    {
+        dispose(_condition);
+
+        for (Expr * s : _then) { dispose(s); }
+        for (Expr * s : _else) { dispose(s); }
+    }
+
+    IfExpr(Expr * condition, ExprList * then, ExprList * otherwise)
+        : Expr(IfKind)
+    {
+        _condition = condition;
+        adopt(_then, then);
+        adopt(_else, otherwise);
+    }
+
+    bool isConstant()
+    {
+        return false;
+    }
+
+    quint32 value()
+    {
+        return 0;
+    }
+
+    void foldChildren()
+    {
+        _condition = foldConstants(_condition);
+        foldStatements(_then);
+        foldStatements(_else);
+    }
+};
+
+
+
+class RepeatExpr : public Expr
+{
+public:
+    Repeat _repeat;
+    Expr * _condition;
+    ExprList _body;
+
+    virtual ~RepeatExpr()
+    {
+        dispose(_condition);
+
+        for (Expr * s : _body) { dispose(s); }
+    }
+
+    RepeatExpr(Repeat repeat, Expr * condition, ExprList * body)
+        : Expr(RepeatKind)
+    {
+        _repeat = repeat;
+        _condition = condition;
+        adopt(_body, body);
+    }
+
+    bool isConstant()
+    {
+        return false;
+    }
+
+    quint32 value()
+    {
+        return 0;
+    }
+
+    void foldChildren()
+    {
+        if (_condition != NULL)
+            _condition = foldConstants(_condition);
+        foldStatements(_body);
+    }
+};
+
+
+
+class ReturnExpr : public Expr
+{
+public:
+    Expr * _value;
+
+    virtual ~ReturnExpr()
+    {
+        dispose(_value);
+    }
+
+    ReturnExpr(Expr * value)
+        : Expr(ReturnKind)
+    {
+        _value = value;
+    }
+
+    bool isConstant()
+    {
+        return false;
+    }
+
+    quint32 value()
+    {
+        return 0;
+    }
+
+    void foldChildren()
+    {
+        if (_value != NULL)
+            _value = foldConstants(_value);
+    }
 };
 
 
@@ -562,19 +1089,20 @@ public:
 class WrapExpr : public Expr
 {
 public:
-    QString _left;
+    QLatin1String _left;
     Expr * _val;
-    QString _right;
+    QLatin1String _right;
 
     virtual ~WrapExpr()
     {
-        delete _val;
+        dispose(_val);
     }
-    WrapExpr(QString left, Expr * val, QString right)
+    WrapExpr(const char * left, Expr * val, const char * right)
+        : Expr(WrapKind)
     {
-        _left = left;
+        _left = QLatin1String(left);
         _val = val;
-        _right = right;
+        _right = QLatin1String(right);
     }
 
     bool isConstant()
@@ -588,12 +1116,15 @@ public:
         return _val->value();
     }
 
-    void fold()
+    bool isFloat()
     {
-        _val = foldConstants(_val);
+        return _val->isFloat();
     }
 
-    void accept(AbstractVisitor & visitor) override { visitor.visit(*this); }
+    void foldChildren()
+    {
+        _val = foldConstants(_val);
+    }
 };
 
 
@@ -601,19 +1132,20 @@ public:
 class ObjectExpr : public Expr
 {
 public:
+    // the path it was parsed from, sharing the caller's string
     QString name;
-    QList<Expr *> * _blocks;
+    ExprList _blocks;
 
     virtual ~ObjectExpr()
     {
-        foreach(Expr * b, *_blocks) { delete b; }
-        delete _blocks;
+        for (Expr * b : _blocks) { dispose(b); }
     }
 
-    ObjectExpr(QString name, QList<Expr *> * blocks)
+    ObjectExpr(const QString & name, ExprList * blocks)
+        : Expr(ObjectKind)
     {
         this->name = name;
-        _blocks = blocks;
+        adopt(_blocks, blocks);
     }
 
     bool isConstant()
@@ -626,12 +1158,7 @@ public:
         return 0;
     }
 
-    void fold()
-    {
-        foreach(Expr * b, *_blocks) { b->fold(); }
-    }
-
-    void accept(AbstractVisitor & visitor) override { visitor.visit(*this); }
+    void foldChildren() {}
 };
 
 
@@ -1,8 +1,8 @@
 #pragma once
 
-#include "tree.h"
+#include "walker.h"
 
-class TreePrinter : public AbstractVisitor
+class TreePrinter : public Walker<TreePrinter>
 {
     void print(QString s, qint32 v)
     {
@@ -74,6 +74,51 @@ public:
     {
         print("ConAssignExpr", expr.value());
     }
+
+    void visit(StringExpr & expr)
+    {
+        print("StringExpr", expr.value());
+    }
+
+    void visit(ObjLineExpr & expr)
+    {
+        print("ObjLineExpr", expr.value());
+    }
+
+    void visit(VarLineExpr & expr)
+    {
+        print("VarLineExpr", expr.value());
+    }
+
+    void visit(AsmLineExpr & expr)
+    {
+        print("AsmLineExpr", expr.value());
+    }
+
+    void visit(MethodExpr & expr)
+    {
+        print("MethodExpr", expr.value());
+    }
+
+    void visit(CallExpr & expr)
+    {
+        print("CallExpr", expr.value());
+    }
+
+    void visit(IfExpr & expr)
+    {
+        print("IfExpr", expr.value());
+    }
+
+    void visit(RepeatExpr & expr)
+    {
+        print("RepeatExpr", expr.value());
+    }
+
+    void visit(ReturnExpr & expr)
+    {
+        print("ReturnExpr", expr.value());
+    }
 };
 
 
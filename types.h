@@ -7,6 +7,7 @@
 #include <QByteArray>
 #include <QDebug>
 #include <QHash>
+#include <QVarLengthArray>
 #include <stdio.h>
 
 class Expr;
@@ -23,6 +24,18 @@ class BinaryExpr;
 class WrapExpr;
 class ObjectExpr;
 class ConAssignExpr;
+class StringExpr;
+class ObjLineExpr;
+class VarLineExpr;
+class AsmLineExpr;
+class MethodExpr;
+class CallExpr;
+class IfExpr;
+class RepeatExpr;
+class ReturnExpr;
+
+// child lists are short, so their first few entries live in the node
+typedef QVarLengthArray<Expr *, 4> ExprList;
 
 enum DataType {
     NoDataType,
@@ -31,6 +44,31 @@ enum DataType {
     DataLong
 };
 
+enum ExprKind {
+    NumberKind,
+    IdentKind,
+    AddressKind,
+    LiteralKind,
+    DataTypeKind,
+    BlockKind,
+    DatLineKind,
+    DatItemKind,
+    UnaryKind,
+    BinaryKind,
+    ConAssignKind,
+    StringKind,
+    ObjLineKind,
+    VarLineKind,
+    AsmLineKind,
+    MethodKind,
+    CallKind,
+    IfKind,
+    RepeatKind,
+    ReturnKind,
+    WrapKind,
+    ObjectKind
+};
+
 enum Block {
     NoBlock,
     ConBlock,
@@ -42,6 +80,13 @@ enum Block {
     AsmBlock
 };
 
+enum Repeat {
+    RepeatForever,
+    RepeatCount,
+    RepeatWhile,
+    RepeatUntil
+};
+
 
 typedef struct newLLType
 {  
@@ -55,3 +100,24 @@ typedef struct newLLType
 #define YYLTYPE newLLType
 #define YYLTYPE_IS_DECLARED 1
 
+// as bison's default, but also carries the source text of the last symbol
+#define YYLLOC_DEFAULT(Current, Rhs, N)                                 \
+    do                                                                  \
+    {                                                                   \
+        if (N)                                                          \
+        {                                                               \
+            (Current).first_line   = YYRHSLOC (Rhs, 1).first_line;      \
+            (Current).first_column = YYRHSLOC (Rhs, 1).first_column;    \
+            (Current).last_line    = YYRHSLOC (Rhs, N).last_line;       \
+            (Current).last_column  = YYRHSLOC (Rhs, N).last_column;     \
+        }                                                               \
+        else                                                            \
+        {                                                               \
+            (Current).first_line   = (Current).last_line   =            \
+                YYRHSLOC (Rhs, 0).last_line;                            \
+            (Current).first_column = (Current).last_column =            \
+                YYRHSLOC (Rhs, 0).last_column;                          \
+        }                                                               \
+        (Current).line = YYRHSLOC (Rhs, N).line;                        \
+    }                                                                   \
+    while (0)
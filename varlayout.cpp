@@ -0,0 +1,83 @@
+#include "varlayout.h"
+#include "parse.h"
+
+void VarLayout::error(IdentExpr * where, QString message)
+{
+    Diagnostic d;
+    d.line = where->_line;
+    d.first_column = where->_column;
+    d.last_column = where->_column + where->_ident.size();
+    d.message = message;
+
+    report(_filename, d);
+    _errors++;
+}
+
+bool VarLayout::layout(ObjectExpr * object)
+{
+    _filename = object->name;
+    _vars.clear();
+    _offsets.clear();
+    _longs = _words = _bytes = 0;
+    _size = _declared = 0;
+    _errors = 0;
+
+    QHash<VarLineExpr *, int> lengths;
+
+    for (Expr * b : object->_blocks)
+    {
+        BlockExpr * block = (BlockExpr *) b;
+        if (block->_block != VarBlock) continue;
+
+        for (Expr * l : block->_lines)
+        {
+            VarLineExpr * line = (VarLineExpr *) l;
+            line->_offset = -1;
+
+            if (_offsets.contains(line->_ident->ident()))
+            {
+                error(line->_ident, "variable \"" + line->_ident->_ident + "\" is already defined");
+                continue;
+            }
+
+            // the count is a plain number until an index is given
+            WrapExpr * index = dynamic_cast<WrapExpr *>(line->_count);
+            if (index != NULL && (!index->_val->isConstant() || index->value() == 0))
+            {
+                error(line->_ident, "array size of \"" + line->_ident->_ident + "\" must be a positive constant");
+                continue;
+            }
+
+            int n = line->elementSize();
+            lengths[line] = n * (index != NULL ? index->value() : 1);
+
+            // what the declaration order would have taken, for the report
+            _declared = (_declared + n - 1) / n * n + lengths[line];
+
+            _offsets[line->_ident->ident()] = 0;
+            _vars.append(line);
+        }
+    }
+
+    int offset = 0;
+    foreach (int n, QList<int>() << 4 << 2 << 1)
+    {
+        foreach (VarLineExpr * line, _vars)
+        {
+            if (line->elementSize() != n) continue;
+
+            line->_offset = offset;
+            _offsets[line->_ident->ident()] = offset;
+            offset += lengths[line];
+
+            if (n == 4)         _longs += lengths[line];
+            else if (n == 2)    _words += lengths[line];
+            else                _bytes += lengths[line];
+        }
+    }
+
+    _size = (offset + 3) & ~3;
+    _declared = (_declared + 3) & ~3;
+
+    return _errors == 0;
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "tree.h"
+
+/*
+ * Gives every VAR variable its offset from vbase.
+ *
+ * Longs come first, then words, then bytes, so every variable is aligned
+ * without any padding between them; only the end is rounded up to a long.
+ * Variables of one size keep their declaration order, so code that walks
+ * from @first through a run of same-sized variables still works.
+ *
+ * The layout can be run again after the object changes and replaces the
+ * previous one.
+ */
+
+class VarLayout
+{
+    QString _filename;
+    int _errors;
+
+    void error(IdentExpr * where, QString message);
+
+public:
+    QList<VarLineExpr *> _vars;
+    QHash<QString, int> _offsets;
+
+    int _longs;
+    int _words;
+    int _bytes;
+    int _size;
+    int _declared;
+
+    bool layout(ObjectExpr * object);
+};
@@ -0,0 +1,405 @@
+#pragma once
+
+#include "tree.h"
+
+/*
+ * Visits every node under a root, parents before their children and
+ * children in source order.
+ *
+ * A pass derives from Walker<Pass> and defines visit() for the nodes it
+ * cares about, with "using Walker<Pass>::visit;" to keep the empty
+ * defaults for the rest. The pass type is known here at compile time, so
+ * each visit is a direct call that can be inlined, and the node type
+ * comes from its kind tag instead of a virtual accept().
+ *
+ * A pass that also declares "static const bool leaves = true;" is given
+ * leave() for each node once everything under it has been visited, so it
+ * can write or compute on the way back up as well as on the way down.
+ *
+ * Nodes still to be visited are kept on a stack of our own rather than
+ * the call stack, so a tree can be as deep as memory allows.
+ */
+
+template <class Pass>
+class Walker
+{
+    // a node to visit, or one whose children are all done
+    struct Entry
+    {
+        Expr * expr;
+        bool leaving;
+    };
+
+    typedef QVarLengthArray<Entry, 64> Stack;
+
+    static void push(Stack & stack, Expr * expr, bool leaving = false)
+    {
+        if (expr != NULL)
+        {
+            Entry entry = { expr, leaving };
+            stack.append(entry);
+        }
+    }
+
+    static void push(Stack & stack, const ExprList & list)
+    {
+        for (int i = list.size() - 1; i >= 0; i--)
+            push(stack, list[i]);
+    }
+
+    // visits one node and queues its children, last child first
+    void step(Pass & pass, Expr * expr, Stack & stack)
+    {
+        switch (expr->_kind)
+        {
+            case NumberKind:
+                pass.visit(*static_cast<NumberExpr *>(expr));
+                break;
+
+            case IdentKind:
+                pass.visit(*static_cast<IdentExpr *>(expr));
+                break;
+
+            case AddressKind:
+            {
+                AddressExpr * e = static_cast<AddressExpr *>(expr);
+                pass.visit(*e);
+                push(stack, e->_offset);
+                push(stack, e->_ident);
+                break;
+            }
+
+            case LiteralKind:
+            {
+                LiteralExpr * e = static_cast<LiteralExpr *>(expr);
+                pass.visit(*e);
+                push(stack, e->_val);
+                break;
+            }
+
+            case DataTypeKind:
+                pass.visit(*static_cast<DataTypeExpr *>(expr));
+                break;
+
+            case BlockKind:
+            {
+                BlockExpr * e = static_cast<BlockExpr *>(expr);
+                pass.visit(*e);
+                push(stack, e->_lines);
+                break;
+            }
+
+            case DatLineKind:
+            {
+                DatLineExpr * e = static_cast<DatLineExpr *>(expr);
+                pass.visit(*e);
+                push(stack, e->_items);
+                push(stack, e->_align);
+                push(stack, e->_symbol);
+                break;
+            }
+
+            case DatItemKind:
+            {
+                DatItemExpr * e = static_cast<DatItemExpr *>(expr);
+                pass.visit(*e);
+                push(stack, e->_count);
+                push(stack, e->_data);
+                push(stack, e->_size);
+                break;
+            }
+
+            case UnaryKind:
+            {
+                UnaryExpr * e = static_cast<UnaryExpr *>(expr);
+                pass.visit(*e);
+                push(stack, e->_val);
+                break;
+            }
+
+            case BinaryKind:
+            {
+                BinaryExpr * e = static_cast<BinaryExpr *>(expr);
+                pass.visit(*e);
+                push(stack, e->_right);
+                push(stack, e->_left);
+                break;
+            }
+
+            case WrapKind:
+            {
+                WrapExpr * e = static_cast<WrapExpr *>(expr);
+                pass.visit(*e);
+                push(stack, e->_val);
+                break;
+            }
+
+            case ObjectKind:
+            {
+                ObjectExpr * e = static_cast<ObjectExpr *>(expr);
+                pass.visit(*e);
+                push(stack, e->_blocks);
+                break;
+            }
+
+            case ConAssignKind:
+            {
+                ConAssignExpr * e = static_cast<ConAssignExpr *>(expr);
+                pass.visit(*e);
+                push(stack, e->expr);
+                push(stack, e->_ident);
+                break;
+            }
+
+            case StringKind:
+                pass.visit(*static_cast<StringExpr *>(expr));
+                break;
+
+            case ObjLineKind:
+            {
+                ObjLineExpr * e = static_cast<ObjLineExpr *>(expr);
+                pass.visit(*e);
+                push(stack, e->_file);
+                push(stack, e->_count);
+                push(stack, e->_alias);
+                break;
+            }
+
+            case VarLineKind:
+            {
+                VarLineExpr * e = static_cast<VarLineExpr *>(expr);
+                pass.visit(*e);
+                push(stack, e->_count);
+                push(stack, e->_ident);
+                push(stack, e->_type);
+                break;
+            }
+
+            case AsmLineKind:
+            {
+                AsmLineExpr * e = static_cast<AsmLineExpr *>(expr);
+                pass.visit(*e);
+                push(stack, e->_data);
+                push(stack, e->_operands);
+                push(stack, e->_label);
+                break;
+            }
+
+            case MethodKind:
+            {
+                MethodExpr * e = static_cast<MethodExpr *>(expr);
+                pass.visit(*e);
+                push(stack, e->_body);
+                push(stack, e->_locals);
+                push(stack, e->_result);
+                push(stack, e->_params);
+                push(stack, e->_name);
+                break;
+            }
+
+            case CallKind:
+            {
+                CallExpr * e = static_cast<CallExpr *>(expr);
+                pass.visit(*e);
+                push(stack, e->_args);
+                push(stack, e->_name);
+                break;
+            }
+
+            case IfKind:
+            {
+                IfExpr * e = static_cast<IfExpr *>(expr);
+                pass.visit(*e);
+                push(stack, e->_else);
+                push(stack, e->_then);
+                push(stack, e->_condition);
+                break;
+            }
+
+            case RepeatKind:
+            {
+                RepeatExpr * e = static_cast<RepeatExpr *>(expr);
+                pass.visit(*e);
+                push(stack, e->_body);
+                push(stack, e->_condition);
+                break;
+            }
+
+            case ReturnKind:
+            {
+                ReturnExpr * e = static_cast<ReturnExpr *>(expr);
+                pass.visit(*e);
+                push(stack, e->_value);
+                break;
+            }
+        }
+    }
+
+    // tells the pass that everything under a node has been visited
+    void finish(Pass & pass, Expr * expr)
+    {
+        switch (expr->_kind)
+        {
+            case NumberKind:
+                pass.leave(*static_cast<NumberExpr *>(expr));
+                break;
+
+            case IdentKind:
+                pass.leave(*static_cast<IdentExpr *>(expr));
+                break;
+
+            case AddressKind:
+                pass.leave(*static_cast<AddressExpr *>(expr));
+                break;
+
+            case LiteralKind:
+                pass.leave(*static_cast<LiteralExpr *>(expr));
+                break;
+
+            case DataTypeKind:
+                pass.leave(*static_cast<DataTypeExpr *>(expr));
+                break;
+
+            case BlockKind:
+                pass.leave(*static_cast<BlockExpr *>(expr));
+                break;
+
+            case DatLineKind:
+                pass.leave(*static_cast<DatLineExpr *>(expr));
+                break;
+
+            case DatItemKind:
+                pass.leave(*static_cast<DatItemExpr *>(expr));
+                break;
+
+            case UnaryKind:
+                pass.leave(*static_cast<UnaryExpr *>(expr));
+                break;
+
+            case BinaryKind:
+                pass.leave(*static_cast<BinaryExpr *>(expr));
+                break;
+
+            case WrapKind:
+                pass.leave(*static_cast<WrapExpr *>(expr));
+                break;
+
+            case ObjectKind:
+                pass.leave(*static_cast<ObjectExpr *>(expr));
+                break;
+
+            case ConAssignKind:
+                pass.leave(*static_cast<ConAssignExpr *>(expr));
+                break;
+
+            case StringKind:
+                pass.leave(*static_cast<StringExpr *>(expr));
+                break;
+
+            case ObjLineKind:
+                pass.leave(*static_cast<ObjLineExpr *>(expr));
+                break;
+
+            case VarLineKind:
+                pass.leave(*static_cast<VarLineExpr *>(expr));
+                break;
+
+            case AsmLineKind:
+                pass.leave(*static_cast<AsmLineExpr *>(expr));
+                break;
+
+            case MethodKind:
+                pass.leave(*static_cast<MethodExpr *>(expr));
+                break;
+
+            case CallKind:
+                pass.leave(*static_cast<CallExpr *>(expr));
+                break;
+
+            case IfKind:
+                pass.leave(*static_cast<IfExpr *>(expr));
+                break;
+
+            case RepeatKind:
+                pass.leave(*static_cast<RepeatExpr *>(expr));
+                break;
+
+            case ReturnKind:
+                pass.leave(*static_cast<ReturnExpr *>(expr));
+                break;
+        }
+    }
+
+public:
+    static const bool leaves = false;
+
+    void visit(NumberExpr &) {}
+    void visit(IdentExpr &) {}
+    void visit(AddressExpr &) {}
+    void visit(LiteralExpr &) {}
+    void visit(DataTypeExpr &) {}
+    void visit(BlockExpr &) {}
+    void visit(DatLineExpr &) {}
+    void visit(DatItemExpr &) {}
+    void visit(UnaryExpr &) {}
+    void visit(BinaryExpr &) {}
+    void visit(WrapExpr &) {}
+    void visit(ObjectExpr &) {}
+    void visit(ConAssignExpr &) {}
+    void visit(StringExpr &) {}
+    void visit(ObjLineExpr &) {}
+    void visit(VarLineExpr &) {}
+    void visit(AsmLineExpr &) {}
+    void visit(MethodExpr &) {}
+    void visit(CallExpr &) {}
+    void visit(IfExpr &) {}
+    void visit(RepeatExpr &) {}
+    void visit(ReturnExpr &) {}
+
+    void leave(NumberExpr &) {}
+    void leave(IdentExpr &) {}
+    void leave(AddressExpr &) {}
+    void leave(LiteralExpr &) {}
+    void leave(DataTypeExpr &) {}
+    void leave(BlockExpr &) {}
+    void leave(DatLineExpr &) {}
+    void leave(DatItemExpr &) {}
+    void leave(UnaryExpr &) {}
+    void leave(BinaryExpr &) {}
+    void leave(WrapExpr &) {}
+    void leave(ObjectExpr &) {}
+    void leave(ConAssignExpr &) {}
+    void leave(StringExpr &) {}
+    void leave(ObjLineExpr &) {}
+    void leave(VarLineExpr &) {}
+    void leave(AsmLineExpr &) {}
+    void leave(MethodExpr &) {}
+    void leave(CallExpr &) {}
+    void leave(IfExpr &) {}
+    void leave(RepeatExpr &) {}
+    void leave(ReturnExpr &) {}
+
+    void walk(Expr * root)
+    {
+        Pass & pass = static_cast<Pass &>(*this);
+        Stack stack;
+
+        push(stack, root);
+        while (!stack.isEmpty())
+        {
+            Entry entry = stack.last();
+            stack.removeLast();
+
+            if (entry.leaving)
+            {
+                finish(pass, entry.expr);
+                continue;
+            }
+
+            // under its children, so it comes off the stack after them
+            if (Pass::leaves)
+                push(stack, entry.expr, true);
+            step(pass, entry.expr, stack);
+        }
+    }
+};
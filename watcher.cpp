@@ -0,0 +1,148 @@
+#include "watcher.h"
+
+#include <QDir>
+#include <QFileInfo>
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+Watcher::Watcher(Project & project, int debounce)
+    : _project(project)
+{
+    _debounce = debounce;
+    _fd = inotify_init1(IN_CLOEXEC);
+}
+
+Watcher::~Watcher()
+{
+    if (_fd >= 0)
+        close(_fd);
+}
+
+void Watcher::below(QString dir, QSet<QString> & dirs)
+{
+    foreach (QString d, QDir(dir).entryList(QDir::Dirs | QDir::NoDotAndDotDot, QDir::Name))
+    {
+        QString path = QDir(dir).absoluteFilePath(d);
+        if (dirs.contains(path)) continue;
+
+        dirs.insert(path);
+        below(path, dirs);
+    }
+}
+
+void Watcher::sync()
+{
+    QSet<QString> files;
+    foreach (QString path, _project.files())
+        files.insert(QFileInfo(path).absolutePath());
+
+    // only new files matter in a directory that holds no project file
+    QSet<QString> searched;
+    foreach (QString dir, _project.searchPaths())
+    {
+        if (QFileInfo(dir).isDir())
+            searched.insert(dir);
+    }
+
+    QSet<QString> all = files;
+    all.unite(searched);
+
+    if (!_project._missing.isEmpty())
+    {
+        foreach (QString dir, all)
+            below(dir, searched);
+        all.unite(searched);
+    }
+
+    foreach (int wd, _watches.keys())
+    {
+        if (all.contains(_watches[wd])) continue;
+
+        inotify_rm_watch(_fd, wd);
+        _watches.remove(wd);
+    }
+
+    // adding a watch again only replaces its mask
+    foreach (QString dir, all)
+    {
+        quint32 mask = IN_MOVED_TO | IN_CREATE;
+        if (files.contains(dir))
+            mask |= IN_CLOSE_WRITE | IN_DELETE;
+
+        int wd = inotify_add_watch(_fd, qPrintable(dir), mask);
+        if (wd < 0)
+        {
+            fprintf(stderr, "cannot watch %s: %s\n", qPrintable(dir), strerror(errno));
+            continue;
+        }
+
+        _watches[wd] = dir;
+    }
+}
+
+int Watcher::run(std::function<void (QStringList)> rebuilt)
+{
+    if (_fd < 0)
+    {
+        fprintf(stderr, "cannot start inotify: %s\n", strerror(errno));
+        return -1;
+    }
+
+    sync();
+
+    QSet<QString> changed;
+    char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+    while (true)
+    {
+        struct pollfd p;
+        p.fd = _fd;
+        p.events = POLLIN;
+
+        int n = poll(&p, 1, changed.isEmpty() ? -1 : _debounce);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+
+        if (n == 0)
+        {
+            QStringList files = changed.toList();
+            changed.clear();
+
+            _project.reload(files);
+            sync();
+            rebuilt(files);
+            continue;
+        }
+
+        ssize_t length = read(_fd, buffer, sizeof(buffer));
+        if (length <= 0)
+        {
+            if (length < 0 && errno == EINTR) continue;
+            return -1;
+        }
+
+        const struct inotify_event * event;
+        for (char * ptr = buffer; ptr < buffer + length;
+             ptr += sizeof(struct inotify_event) + event->len)
+        {
+            event = (const struct inotify_event *) ptr;
+            if (event->len == 0 || !_watches.contains(event->wd)) continue;
+
+            QString path = QDir(_watches[event->wd]).absoluteFilePath(event->name);
+
+            // a new directory may hold a missing object, and is watched
+            // once the project has been rebuilt
+            bool dir = (event->mask & IN_ISDIR) && !_project._missing.isEmpty();
+
+            if (dir || _project.contains(path))
+                changed.insert(QDir::cleanPath(path));
+        }
+    }
+}
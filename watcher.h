@@ -0,0 +1,37 @@
+#pragma once
+
+#include "project.h"
+
+#include <functional>
+
+/*
+ * Rebuilds a project whenever one of its files changes on disk.
+ *
+ * The directories holding project files are watched with inotify, so
+ * editors that save by renaming a temporary file over the original are
+ * still seen. Events are collected until the watched directories have
+ * been quiet for the debounce interval, and then handed to the project
+ * as one batch.
+ *
+ * The -L search directories are watched for new files as well. While an
+ * OBJ line does not resolve, so are the subdirectories of every searched
+ * directory, and a file or directory appearing in any of them rebuilds
+ * the project, which looks the missing names up again.
+ */
+
+class Watcher
+{
+    Project & _project;
+    int _debounce;
+    int _fd;
+    QHash<int, QString> _watches;
+
+    void sync();
+    void below(QString dir, QSet<QString> & dirs);
+
+public:
+    Watcher(Project & project, int debounce = 100);
+    ~Watcher();
+
+    int run(std::function<void (QStringList)> rebuilt);
+};